@@ -0,0 +1,61 @@
+#include "alloc_stats.h"
+
+#ifdef TASK2GIS_ALLOC_STATS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<size_t> g_allocations { 0 };
+std::atomic<size_t> g_deallocations { 0 };
+std::atomic<size_t> g_bytes { 0 };
+
+void* countedAlloc(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void countedFree(void* ptr) noexcept
+{
+    if (!ptr)
+        return;
+    g_deallocations.fetch_add(1, std::memory_order_relaxed);
+    std::free(ptr);
+}
+} // end of anonymous namespace
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* ptr) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr) noexcept { countedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { countedFree(ptr); }
+
+bool alloc_stats::enabled() noexcept
+{
+    return true;
+}
+
+alloc_stats::snapshot alloc_stats::current() noexcept
+{
+    snapshot ret;
+    ret.allocations = g_allocations.load(std::memory_order_relaxed);
+    ret.deallocations = g_deallocations.load(std::memory_order_relaxed);
+    ret.bytes = g_bytes.load(std::memory_order_relaxed);
+    return ret;
+}
+#else
+bool alloc_stats::enabled() noexcept
+{
+    return false;
+}
+
+alloc_stats::snapshot alloc_stats::current() noexcept
+{
+    return snapshot {};
+}
+#endif
@@ -0,0 +1,55 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <cstddef>
+
+/**
+ * @class alloc_stats
+ * @brief Счётчики динамических выделений памяти.
+ * @remarks Счётчики ведутся только в сборке с опцией TASK2GIS_ALLOC_STATS,
+ * в которой подменяются глобальные operator new/delete. В обычной сборке
+ * enabled() возвращает false, а все счётчики равны нулю.
+ */
+class alloc_stats {
+public:
+    /// Значения счётчиков на момент вызова current()
+    struct snapshot {
+        /// количество вызовов operator new
+        size_t allocations = 0;
+        /// количество вызовов operator delete
+        size_t deallocations = 0;
+        /// суммарный объём запрошенной памяти в байтах
+        size_t bytes = 0;
+    };
+
+    /**
+     * @brief Ведутся ли счётчики в текущей сборке?
+     * @return false если программа собрана без TASK2GIS_ALLOC_STATS
+     */
+    static bool enabled() noexcept;
+
+    /**
+     * @brief Возвращает текущие значения счётчиков
+     * @return снимок счётчиков
+     */
+    static snapshot current() noexcept;
+
+    /**
+     * @brief Возвращает разность счётчиков между двумя снимками
+     * @param from снимок, сделанный раньше
+     * @param to снимок, сделанный позже
+     * @return количество выделений и байт между снимками
+     */
+    static snapshot delta(const snapshot& from, const snapshot& to) noexcept;
+};
+
+inline alloc_stats::snapshot alloc_stats::delta(const snapshot& from, const snapshot& to) noexcept
+{
+    snapshot ret;
+    ret.allocations = to.allocations - from.allocations;
+    ret.deallocations = to.deallocations - from.deallocations;
+    ret.bytes = to.bytes - from.bytes;
+    return ret;
+}
+
+#endif // ALLOC_STATS_H
@@ -1,11 +1,58 @@
 #include "application.h"
-#include "file.h"
+#include "alloc_stats.h"
+#include "async_reader.h"
+#include "async_writer.h"
+#include "compression.h"
+#include "external_tree.h"
+#include "task_scheduler.h"
+#include "trace.h"
 #include "tree.h"
+#include "tree_builder.h"
+#include "tree_cache.h"
+#include "tree_columns.h"
+#include "tree_index.h"
+#include "tree_pipeline.h"
+#include "tree_stats.h"
+#include "validator.h"
+#include "json/binary_parser.h"
+#include "json/binary_writer.h"
+#include "json/push_parser.h"
 #include "json/value.h"
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
+#include <utility>
+
+namespace {
+/**
+ * @brief Пишет отметку уровня узла без создания временной строки
+ * @param os поток вывода
+ * @param level глубина узла
+ */
+void writeLevel(std::ostream& os, unsigned level)
+{
+    static constexpr char DASHES[] = "----------------------------------------------------------------";
+    constexpr unsigned BLOCK = sizeof(DASHES) - 1;
+    for (auto left = level; left > 0;) {
+        auto count = std::min(left, BLOCK);
+        os.write(DASHES, count);
+        left -= count;
+    }
+}
+
+/**
+ * @brief Двоичный формат, соответствующий формату файла
+ * @param fmt формат файла, отличный от JSON
+ */
+json::binary_format toBinary(application::format fmt)
+{
+    return (fmt == application::format::Cbor) ? json::binary_format::Cbor : json::binary_format::MessagePack;
+}
+} // end of anonymous namespace
 
 application::application()
 {
@@ -16,34 +63,272 @@ int application::work()
     if (m_input.empty() || m_output.empty())
         throw std::logic_error("parameter is set incorrectly");
 
-    auto tree = tree::parse(json::value::parse(file::ReadAllText(m_input)));
+    if ((!m_columnsOutput.empty() || !m_valueIndexOutput.empty()) && (!m_transforms.empty() || m_memoryLimit > 0))
+        throw std::logic_error("columns output and value index need the whole tree in memory");
+
+    // Конвейер не держит дерево в памяти, поэтому предел памяти соблюдается и без временных файлов
+    if (!m_transforms.empty())
+        return workPipeline();
+    if (m_memoryLimit > 0)
+        return workExternal();
+
+    auto before = alloc_stats::current();
+    auto tree = loadTree();
+    auto loaded = alloc_stats::current();
+
+    // Шаги 2 и 3 независимы: сохраняем дерево в фоне, пока печатаем его в консоль
+    auto saving = std::async(std::launch::async, [&]() { saveTree(tree); });
+    std::future<void> exporting;
+    if (!m_columnsOutput.empty())
+        exporting = std::async(std::launch::async, [&]() { tree_columns::collect(tree).save(m_columnsOutput); });
+    std::future<void> indexing;
+    if (!m_valueIndexOutput.empty())
+        indexing = std::async(std::launch::async, [&]() { tree_index::build(tree).save(m_valueIndexOutput); });
     printTree(tree);
-    saveTree(tree);
+    saving.get();
+    if (exporting.valid())
+        exporting.get();
+    if (indexing.valid())
+        indexing.get();
+
+    if (m_allocStats) {
+        auto load = alloc_stats::delta(before, loaded);
+        auto total = alloc_stats::delta(before, alloc_stats::current());
+        std::cerr << "load: " << load.allocations << " allocations, " << load.bytes << " bytes\n"
+                  << "total: " << total.allocations << " allocations, " << total.bytes << " bytes\n";
+    }
 
     return 0;
 }
 
-void application::printTree(const tree& tree, unsigned level)
+int application::validate()
 {
-    if (tree.isDouble())
-        std::cout << std::string(level, '-') << tree.asDouble() << std::endl;
-    else if (tree.isInteger())
-        std::cout << std::string(level, '-') << tree.asInteger() << std::endl;
-    else if (tree.isString())
-        std::cout << std::string(level, '-') << std::quoted(tree.asString()) << std::endl;
-    else {
-        std::cerr << "Invalid tree was detected!";
+    if (m_input.empty())
+        throw std::logic_error("parameter is set incorrectly");
+
+    std::optional<validator> v;
+    if (m_inputFormat == format::Json)
+        v.emplace();
+    else
+        v.emplace(toBinary(m_inputFormat));
+    readInput([&](std::string_view chunk) { return v->feed(chunk); });
+    auto res = v->finish();
+    if (!res.valid && m_inputFormat != format::Json) {
+        std::cout << "invalid: " << res.message << " at offset " << res.offset << std::endl;
+        return 1;
     }
+    if (!res.valid) {
+        std::cout << "invalid: " << res.message << " at line " << res.line << ", column " << res.column
+                  << " (offset " << res.offset << ")" << std::endl;
+        return 1;
+    }
+
+    std::cout << "valid: " << res.nodes << " nodes, depth " << res.depth << std::endl;
+    return 0;
+}
+
+int application::stats()
+{
+    if (m_input.empty())
+        throw std::logic_error("parameter is set incorrectly");
+
+    std::cout << tree_stats::collect(loadTree());
+
+    auto counters = task_scheduler::instance().stats();
+    std::cerr << "scheduler: threads " << task_scheduler::instance().threads() << ", tasks " << counters.tasks
+              << ", steals " << counters.steals << ", idle "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(counters.idle).count() << " ms\n";
+    return 0;
+}
+
+void application::printTree(const tree& tree)
+{
+    // Если дерево сохраняется в стандартный поток вывода, печатаем его в поток ошибок
+    printTree((m_output == "-") ? std::cerr : std::cout, tree);
+}
 
-    for (const auto& child : tree.childs()) {
-        printTree(child, level + 1);
+void application::printTree(std::ostream& os, const tree& tree)
+{
+    TRACE_SCOPE("application::printTree");
+    auto range = tree.preorder();
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        auto level = it.depth();
+        if (it->isDouble()) {
+            writeLevel(os, level);
+            os << it->asDouble() << std::endl;
+        } else if (it->isInteger()) {
+            writeLevel(os, level);
+            os << it->asInteger() << std::endl;
+        } else if (it->isString()) {
+            writeLevel(os, level);
+            os << std::quoted(it->asString()) << std::endl;
+        } else {
+            std::cerr << "Invalid tree was detected!";
+        }
+    }
+}
+
+void application::readInput(const std::function<bool(std::string_view)>& consumer, size_t chunkSize)
+{
+    async_reader reader(m_input, chunkSize > 0 ? chunkSize : async_reader::DEFAULT_CHUNK_SIZE);
+    std::string_view chunk;
+    bool first = true;
+    while (reader.next(chunk)) {
+        // Отбрасываем преамбулу если UTF-8
+        if (first && m_inputFormat == format::Json && chunk.size() >= 3
+            && chunk.compare(0, 3, "\xef\xbb\xbf") == 0)
+            chunk.remove_prefix(3);
+        first = false;
+        if (!consumer(chunk))
+            break;
+    }
+}
+
+template <typename THandler>
+void application::parseInput(THandler& handler, size_t maxToken, size_t chunkSize)
+{
+    auto parse = [&](auto& parser) {
+        parser.set_max_token_size(maxToken);
+        readInput([&](std::string_view chunk) { return parser.feed(chunk); }, chunkSize);
+        parser.finish();
+        parser.check();
+    };
+
+    if (m_inputFormat == format::Json) {
+        json::push_parser<THandler> parser(handler);
+        parse(parser);
+    } else {
+        json::binary_parser<THandler> parser(handler, toBinary(m_inputFormat));
+        parse(parser);
+    }
+}
+
+tree application::loadTree()
+{
+    TRACE_SCOPE("application::loadTree");
+    std::optional<tree_cache> cache;
+    std::optional<tree_cache::stamp> stamp;
+    tree_cache::parse_options cacheOptions;
+    cacheOptions.keepNumberText = m_keepNumberText;
+    if (m_inputFormat != format::Json)
+        cacheOptions.binary = toBinary(m_inputFormat);
+    if (!m_cacheDir.empty() && m_input != "-") {
+        // Метка снимается до чтения: изменение файла во время разбора не попадёт в кэш
+        stamp = tree_cache::stampOf(m_input);
+        cache.emplace(m_cacheDir);
+        auto cached = cache->load(m_input, cacheOptions);
+        // В строгом режиме посторонние ключи - ошибка, которую сообщит повторный разбор
+        if (cached && !(m_strict && cached->unknownKeys > 0)) {
+            warnUnknownKeys(cached->unknownKeys, cached->firstUnknownKey);
+            return std::move(cached->value);
+        }
+    }
+
+    tree_builder builder(m_strict, m_keepNumberText);
+    parseInput(builder);
+    warnUnknownKeys(builder.unknownKeys(), builder.firstUnknownKey());
+
+    if (!cache || !stamp)
+        return builder.take();
+
+    tree_cache::entry parsed { builder.take(), builder.unknownKeys(), builder.firstUnknownKey() };
+    if (!cache->store(m_input, cacheOptions, *stamp, parsed))
+        std::cerr << "warning: can't write tree cache to " << std::quoted(m_cacheDir) << std::endl;
+    return std::move(parsed.value);
+}
+
+void application::warnUnknownKeys(size_t count, const std::string& first)
+{
+    if (count > 0) {
+        std::cerr << "warning: " << count << " unknown key(s) ignored, first is " << std::quoted(first)
+                  << std::endl;
     }
 }
 
 void application::saveTree(const tree& tree)
 {
-    std::ofstream ofs(m_output);
-    if (!ofs.is_open())
-        throw std::runtime_error("Can't open '" + m_output + "'");
-    ofs << tree.serialize().serialize();
+    TRACE_SCOPE("application::saveTree");
+    if (m_outputFormat != format::Json) {
+        async_writer writer(m_output, async_writer::DEFAULT_QUEUE_SIZE, compressionForPath(m_output));
+        json::binary_writer encoder(
+            toBinary(m_outputFormat), [&](std::string chunk) { writer.write(std::move(chunk)); });
+        tree.serialize(encoder);
+        encoder.flush();
+        writer.close();
+        return;
+    }
+
+    // Текст строится напрямую из дерева блоками, которые записываются, пока строятся следующие
+    async_writer writer(m_output, async_writer::DEFAULT_QUEUE_SIZE, compressionForPath(m_output));
+    tree.serialize([&](std::string chunk) { writer.write(std::move(chunk)); });
+    writer.close();
+}
+
+int application::workExternal()
+{
+    // Временные файлы хранят дерево в виде, из которого генерируется только JSON
+    if (m_outputFormat != format::Json)
+        throw std::logic_error("binary output can't be combined with memory limit");
+
+    external_tree spilled(m_memoryLimit);
+    external_tree_builder builder(spilled, m_strict, m_keepNumberText);
+    parseInput(builder, spilled.bufferSize() * 2, spilled.bufferSize());
+    builder.finish();
+    warnUnknownKeys(builder.unknownKeys(), builder.firstUnknownKey());
+
+    // Печать и сохранение выполняются за один проход по временным файлам
+    auto& os = (m_output == "-") ? std::cerr : std::cout;
+    async_writer writer(m_output, 2, compressionForPath(m_output));
+    spilled.serialize([&](std::string chunk) { writer.write(std::move(chunk)); },
+        [&](const external_tree::node& n, unsigned level) {
+            writeLevel(os, level);
+            if (n.type == external_tree::kind::Integer)
+                os << n.integer << '\n';
+            else if (n.type == external_tree::kind::Double)
+                os << n.number << '\n';
+            else
+                os << std::quoted(n.text) << '\n';
+        });
+    writer.close();
+    os.flush();
+    return 0;
+}
+
+int application::workPipeline()
+{
+    // Двоичные форматы записывают размер контейнера перед его элементами, а конвейер узнаёт его в конце
+    if (m_outputFormat != format::Json)
+        throw std::logic_error("binary output can't be combined with transforms");
+
+    tree_pipeline pipeline(m_strict, m_keepNumberText);
+    for (const auto& transform : m_transforms)
+        pipeline.addStage(transform);
+
+    auto& os = (m_output == "-") ? std::cerr : std::cout;
+    async_writer writer(m_output, async_writer::DEFAULT_QUEUE_SIZE, compressionForPath(m_output));
+    node_event_writer text;
+    std::string chunk;
+    pipeline.run(
+        [&](tree_pipeline::event_builder& builder) {
+            parseInput(builder);
+            warnUnknownKeys(builder.unknownKeys(), builder.firstUnknownKey());
+        },
+        [&](const node_event& event) {
+            text.write(event, chunk);
+            if (chunk.size() >= async_reader::DEFAULT_CHUNK_SIZE)
+                writer.write(std::exchange(chunk, std::string()));
+            if (event.type != node_event::kind::Open)
+                return;
+            writeLevel(os, event.depth);
+            if (auto integer = std::get_if<int>(&event.value))
+                os << *integer << '\n';
+            else if (auto number = std::get_if<double>(&event.value))
+                os << *number << '\n';
+            else
+                os << std::quoted(std::get<std::string>(event.value)) << '\n';
+        });
+    writer.write(std::move(chunk));
+    writer.close();
+    os.flush();
+    return 0;
 }
@@ -1,9 +1,15 @@
 #ifndef APPLICATION_H
 #define APPLICATION_H
 
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class tree;
+struct node_event;
 
 /**
  * @class application
@@ -11,6 +17,13 @@ class tree;
  */
 class application {
 public:
+    /// Формат входного или выходного файла
+    enum class format : uint8_t {
+        Json,
+        MessagePack,
+        Cbor
+    };
+
     /**
      * @brief application constructor
      */
@@ -18,18 +31,100 @@ public:
 
     /**
      * @brief Задать путь к входному файлу
-     * @remarks Выполнять перед вызовом метода work
+     * @remarks Выполнять перед вызовом метода work. "-" означает стандартный поток ввода
      * @param input путь к входному файлу
      */
     void setInput(std::string input);
 
     /**
      * @brief Задать путь к выходному файлу
-     * @remarks Выполнять перед вызовом метода work
+     * @remarks Выполнять перед вызовом метода work. "-" означает стандартный поток вывода,
+     * в этом случае дерево для просмотра печатается в стандартный поток ошибок
      * @param input путь к выходному файлу
      */
     void setOutput(std::string output);
 
+    /**
+     * @brief Задать формат входного файла
+     * @remarks По умолчанию JSON. Двоичные форматы разбираются напрямую в дерево, без текста
+     * @param input формат
+     */
+    void setInputFormat(format input);
+
+    /**
+     * @brief Задать формат выходного файла
+     * @remarks По умолчанию JSON. Двоичный формат нельзя сочетать с пределом памяти
+     * @param output формат
+     */
+    void setOutputFormat(format output);
+
+    /**
+     * @brief Включить вывод счётчиков выделений памяти по шагам работы в std::cerr
+     * @remarks Счётчики доступны только в сборке с опцией TASK2GIS_ALLOC_STATS
+     * @param enabled true чтобы включить вывод
+     */
+    void setAllocStats(bool enabled);
+
+    /**
+     * @brief Считать ли посторонние ключи в узлах дерева ошибкой
+     * @remarks По умолчанию посторонние ключи пропускаются с предупреждением
+     * @param strict true чтобы считать ошибкой
+     */
+    void setStrict(bool strict);
+
+    /**
+     * @brief Сохранять ли при загрузке исходный текст чисел
+     * @remarks Сохранённый текст выводится в выходной файл без изменений, поэтому числа
+     * не округляются и не переформатируются. Текст, не являющийся числом JSON
+     * (например "+1" или ".5"), не сохраняется
+     * @param keep true чтобы сохранять
+     */
+    void setKeepNumberText(bool keep);
+
+    /**
+     * @brief Задать предел памяти для обработки деревьев больше оперативной памяти
+     * @remarks Если предел задан, work не строит дерево в памяти: узлы по мере разбора
+     * выгружаются во временные файлы (см. external_tree), а вывод в консоль и выходной файл
+     * генерируется потоково из этих файлов за один проход
+     * @param bytes предел в байтах; 0 - без предела
+     */
+    void setMemoryLimit(size_t bytes);
+
+    /**
+     * @brief Задать каталог постоянного кэша разобранных деревьев
+     * @remarks Если входной файл не менялся с прошлого запуска, дерево загружается из кэша
+     * без разбора текста (см. tree_cache). Стандартный поток ввода не кэшируется
+     * @param dir путь к каталогу; пустая строка - без кэша
+     */
+    void setCacheDir(std::string dir);
+
+    /**
+     * @brief Задать путь к файлу столбцов значений узлов
+     * @remarks Если путь задан, work дополнительно выгружает значения узлов в виде
+     * типизированных столбцов (см. tree_columns) для аналитики. Столбцы строятся по дереву
+     * в памяти, поэтому их нельзя сочетать с пределом памяти и преобразованиями
+     * @param path путь к файлу; пустая строка - без выгрузки
+     */
+    void setColumnsOutput(std::string path);
+
+    /**
+     * @brief Задать путь к файлу индекса узлов по значению
+     * @remarks Если путь задан, work дополнительно строит хэш-индекс значений узлов
+     * (см. tree_index) и сохраняет его для последующих поисков через отображение в память.
+     * Как и столбцы, индекс нельзя сочетать с пределом памяти и преобразованиями
+     * @param path путь к файлу; пустая строка - без индекса
+     */
+    void setValueIndexOutput(std::string path);
+
+    /**
+     * @brief Добавить преобразование узлов между загрузкой и сохранением
+     * @remarks Если заданы преобразования, work не строит дерево в памяти: узлы проходят
+     * конвейер разбор - преобразования - запись (см. tree_pipeline), каждое преобразование
+     * в своём потоке. Кэш деревьев при этом не используется, выходной файл - только JSON
+     * @param transform преобразование (см. tree_pipeline::transform_type)
+     */
+    void addTransform(std::function<bool(node_event&)> transform);
+
     /**
      * @brief Выполняет основную работу приложения.
      * @remarks Вся логика функции состоит из трех шагов:
@@ -40,24 +135,110 @@ public:
      */
     int work();
 
+    /**
+     * @brief Проверяет, является ли входной файл корректным деревом, не строя само дерево.
+     * @remarks Результат проверки (количество узлов, глубина или позиция первой ошибки)
+     * печатается в консоль. Выходной файл не нужен.
+     * @return 0 если входной файл является корректным деревом
+     */
+    int validate();
+
+    /**
+     * @brief Загружает дерево из входного файла и печатает статистику по его узлам.
+     * @remarks Дерево не печатается и не сохраняется, выходной файл не нужен.
+     * Статистика собирается во всех доступных потоках
+     * @return 0 если успешно
+     */
+    int stats();
+
+    /**
+     * @brief Печатает дерево в том виде, в каком "шаг 2" отображает его в консоли
+     * @remarks Каждый узел - отдельная строка: значение с отступом из '-' по глубине узла
+     * @param os поток вывода
+     * @param tree дерево
+     */
+    static void printTree(std::ostream& os, const tree& tree);
+
 private:
+    /**
+     * @brief Читает входной файл блоками в отдельном потоке и передаёт блоки потребителю
+     * @remarks Сжатый файл распаковывается на лету (см. async_reader).
+     * Преамбула UTF-8 у входного файла в JSON отбрасывается
+     * @param consumer потребитель блоков; если он вернул false, чтение прекращается
+     * @param chunkSize размер блока; 0 - размер по умолчанию
+     */
+    void readInput(const std::function<bool(std::string_view)>& consumer, size_t chunkSize = 0);
+
+    /**
+     * @brief Функция выполняет "шаг 1" (Загрузить дерево из входного файла)
+     * @remarks Данные разбираются по мере чтения и целиком в памяти не хранятся.
+     * Дерево строится напрямую, без промежуточного JSON-значения.
+     * Если задан каталог кэша, дерево берётся из кэша или сохраняется в него после разбора
+     * @throw json::json_exception если разбор не удался
+     * @return дерево
+     */
+    tree loadTree();
+
+    /**
+     * @brief Предупреждает о посторонних ключах, пропущенных при разборе
+     * @param count количество ключей
+     * @param first первый ключ
+     */
+    void warnUnknownKeys(size_t count, const std::string& first);
+
     /**
      * @brief Функция выполняет "шаг 2" (Отобразить дерево в консоли)
-     * @remarks Функция реализована рекурсивно, используя служебный параметр level
+     * @remarks Дерево обходится в прямом порядке без рекурсии, глубина узла берётся из итератора
      * @param tree дерево
-     * @param level глубина рекурсии
      */
-    void printTree(const tree& tree, unsigned level = 0);
+    void printTree(const tree& tree);
 
     /**
      * @brief Функция выполняет "шаг 3" (Сохранить дерево в выходном файле)
+     * @remarks Текст генерируется блоками, которые записываются на диск в отдельном потоке.
+     * Выполняется параллельно с "шагом 2". Выходной файл с расширением ".gz" или ".zst"
+     * сжимается блоками во всех потоках пула
      * @param tree дерево
      */
     void saveTree(const tree& tree);
 
+    /**
+     * @brief Разбирает входной файл парсером, соответствующим формату входного файла
+     * @param handler обработчик разобранных значений
+     * @param maxToken предел размера строки (см. json::push_parser::set_max_token_size)
+     * @param chunkSize размер блока чтения; 0 - размер по умолчанию
+     * @throw json::json_exception если разбор не удался
+     */
+    template <typename THandler>
+    void parseInput(THandler& handler, size_t maxToken = SIZE_MAX, size_t chunkSize = 0);
+
+    /**
+     * @brief Выполняет все три шага, не держа дерево в памяти
+     * @remarks Используется при заданном пределе памяти
+     * @return 0 если успешно
+     */
+    int workExternal();
+
+    /**
+     * @brief Выполняет все три шага конвейером с преобразованиями узлов
+     * @remarks Используется при заданных преобразованиях
+     * @return 0 если успешно
+     */
+    int workPipeline();
+
 private:
     std::string m_input;
     std::string m_output;
+    format m_inputFormat = format::Json;
+    format m_outputFormat = format::Json;
+    bool m_allocStats = false;
+    bool m_strict = false;
+    bool m_keepNumberText = false;
+    size_t m_memoryLimit = 0;
+    std::string m_cacheDir;
+    std::string m_columnsOutput;
+    std::string m_valueIndexOutput;
+    std::vector<std::function<bool(node_event&)>> m_transforms;
 };
 
 inline void application::setInput(std::string input)
@@ -70,4 +251,54 @@ inline void application::setOutput(std::string output)
     m_output = std::move(output);
 }
 
+inline void application::setInputFormat(format input)
+{
+    m_inputFormat = input;
+}
+
+inline void application::setOutputFormat(format output)
+{
+    m_outputFormat = output;
+}
+
+inline void application::setAllocStats(bool enabled)
+{
+    m_allocStats = enabled;
+}
+
+inline void application::setStrict(bool strict)
+{
+    m_strict = strict;
+}
+
+inline void application::setKeepNumberText(bool keep)
+{
+    m_keepNumberText = keep;
+}
+
+inline void application::setMemoryLimit(size_t bytes)
+{
+    m_memoryLimit = bytes;
+}
+
+inline void application::setCacheDir(std::string dir)
+{
+    m_cacheDir = std::move(dir);
+}
+
+inline void application::setColumnsOutput(std::string path)
+{
+    m_columnsOutput = std::move(path);
+}
+
+inline void application::setValueIndexOutput(std::string path)
+{
+    m_valueIndexOutput = std::move(path);
+}
+
+inline void application::addTransform(std::function<bool(node_event&)> transform)
+{
+    m_transforms.push_back(std::move(transform));
+}
+
 #endif // APPLICATION_H
@@ -0,0 +1,134 @@
+#include "async_reader.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+async_reader::async_reader(const std::string& path, size_t chunkSize)
+    : m_stream(&std::cin)
+{
+    if (path != "-") {
+        m_file.open(std::filesystem::u8path(path), std::ios::binary);
+        if (!m_file.is_open())
+            throw std::runtime_error("Can't open '" + path + "'");
+        m_stream = &m_file;
+    }
+
+    for (auto& buf : m_buffers)
+        buf.data.resize(chunkSize);
+    m_thread = std::thread(&async_reader::run, this);
+}
+
+async_reader::~async_reader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+bool async_reader::next(std::string_view& chunk)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Предыдущий блок больше не нужен потребителю - возвращаем его потоку чтения
+    if (m_holding) {
+        m_buffers[m_consumed % 2].full = false;
+        ++m_consumed;
+        m_holding = false;
+        m_cv.notify_all();
+    }
+
+    auto& buf = m_buffers[m_consumed % 2];
+    m_cv.wait(lock, [&]() { return buf.full || m_eof || m_error; });
+
+    if (!buf.full) {
+        if (m_error)
+            std::rethrow_exception(m_error);
+        return false;
+    }
+
+    m_holding = true;
+    chunk = std::string_view(buf.data.data(), buf.size);
+    return true;
+}
+
+void async_reader::run()
+{
+    try {
+        // Формат определяется по первым байтам; они же - начало данных, если файл не сжат
+        m_raw.resize(4);
+        m_rawEnd = readRaw(m_raw.data(), m_raw.size());
+        auto method = detectCompression(std::string_view(m_raw.data(), m_rawEnd));
+        if (method != compression::None) {
+            m_decoder = std::make_unique<decompressor>(method);
+            m_raw.resize(m_buffers[0].data.size());
+        }
+
+        for (size_t produced = 0;; ++produced) {
+            auto& buf = m_buffers[produced % 2];
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&]() { return !buf.full || m_stop; });
+                if (m_stop)
+                    return;
+            }
+
+            // Буфер принадлежит потоку чтения, пока не помечен заполненным
+            auto size = fill(buf.data.data(), buf.data.size());
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (size == 0) {
+                m_eof = true;
+            } else {
+                buf.size = size;
+                buf.full = true;
+            }
+            m_cv.notify_all();
+            if (m_eof)
+                return;
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = std::current_exception();
+        m_cv.notify_all();
+    }
+}
+
+size_t async_reader::fill(char* data, size_t size)
+{
+    if (!m_decoder) {
+        auto got = std::min(m_rawEnd - m_rawBegin, size);
+        std::copy_n(m_raw.data() + m_rawBegin, got, data);
+        m_rawBegin += got;
+        return got + readRaw(data + got, size - got);
+    }
+
+    size_t got = 0;
+    while (got < size) {
+        if (m_rawBegin == m_rawEnd && !m_rawEof) {
+            m_rawBegin = 0;
+            m_rawEnd = readRaw(m_raw.data(), m_raw.size());
+            m_rawEof = (m_rawEnd == 0);
+        }
+        auto res = m_decoder->decode(std::string_view(m_raw.data() + m_rawBegin, m_rawEnd - m_rawBegin),
+            data + got, size - got);
+        m_rawBegin += res.consumed;
+        got += res.produced;
+        if (m_rawEof && res.produced == 0) {
+            if (!m_decoder->finished())
+                throw std::runtime_error("Compressed input file is truncated");
+            break;
+        }
+    }
+    return got;
+}
+
+size_t async_reader::readRaw(char* data, size_t size)
+{
+    m_stream->read(data, static_cast<std::streamsize>(size));
+    if (m_stream->bad())
+        throw std::runtime_error("Can't read input file");
+    return static_cast<size_t>(m_stream->gcount());
+}
@@ -0,0 +1,102 @@
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+#include "compression.h"
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @class async_reader
+ * @brief Чтение файла блоками в отдельном потоке с двойной буферизацией.
+ * @remarks Пока потребитель обрабатывает один блок, поток чтения заполняет второй,
+ * так что ожидание диска перекрывается с работой процессора.
+ * Сжатый файл (gzip или zstd, определяется по первым байтам) распаковывается в том же потоке
+ * чтения, и потребитель получает уже распакованные блоки - без временного файла.
+ * Путь "-" означает стандартный поток ввода.
+ */
+class async_reader {
+public:
+    /// Размер блока чтения по умолчанию
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+    /**
+     * @brief Открывает файл и запускает поток чтения
+     * @param path путь к файлу или "-" для стандартного потока ввода
+     * @param chunkSize размер блока чтения
+     * @throw std::runtime_error если файл не удалось открыть
+     */
+    explicit async_reader(const std::string& path, size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+    /**
+     * @brief Останавливает поток чтения
+     */
+    ~async_reader();
+
+    async_reader(const async_reader&) = delete;
+    async_reader& operator=(const async_reader&) = delete;
+
+    /**
+     * @brief Возвращает очередной блок файла, дожидаясь его чтения при необходимости
+     * @param chunk очередной блок; действителен до следующего вызова next
+     * @throw std::runtime_error если чтение не удалось
+     * @return false если файл прочитан до конца
+     */
+    bool next(std::string_view& chunk);
+
+private:
+    /**
+     * @brief Тело потока чтения
+     */
+    void run();
+
+    /**
+     * @brief Заполняет буфер очередной частью файла, распаковывая её при необходимости
+     * @param data буфер
+     * @param size размер буфера
+     * @throw std::runtime_error если чтение или распаковка не удались
+     * @return количество записанных байтов; меньше size только в конце файла
+     */
+    size_t fill(char* data, size_t size);
+
+    /**
+     * @brief Читает из файла не больше size байтов
+     * @throw std::runtime_error если чтение не удалось
+     */
+    size_t readRaw(char* data, size_t size);
+
+private:
+    struct buffer {
+        std::vector<char> data;
+        size_t size = 0;
+        bool full = false;
+    };
+
+    std::ifstream m_file;
+    std::istream* m_stream;
+    buffer m_buffers[2];
+    /// распаковщик, если файл сжат
+    std::unique_ptr<decompressor> m_decoder;
+    /// прочитанные, но ещё не распакованные байты файла
+    std::vector<char> m_raw;
+    size_t m_rawBegin = 0;
+    size_t m_rawEnd = 0;
+    bool m_rawEof = false;
+    size_t m_consumed = 0;
+    bool m_holding = false;
+    bool m_stop = false;
+    bool m_eof = false;
+    std::exception_ptr m_error;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+};
+
+#endif // ASYNC_READER_H
@@ -0,0 +1,168 @@
+#include "async_writer.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+async_writer::async_writer(const std::string& path, size_t queueSize, compression method)
+    : m_stream(&std::cout)
+    , m_queueSize(queueSize)
+{
+    if (method != compression::None) {
+        m_compressor.emplace(method);
+        m_tasks.emplace();
+        m_queueSize = std::max(queueSize, task_scheduler::instance().threads() * 2);
+    }
+
+    if (path != "-") {
+        m_file.open(std::filesystem::u8path(path), std::ios::binary);
+        if (!m_file.is_open())
+            throw std::runtime_error("Can't open '" + path + "'");
+        m_stream = &m_file;
+    }
+
+    m_thread = std::thread(&async_writer::run, this);
+}
+
+async_writer::~async_writer()
+{
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closing = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+}
+
+void async_writer::write(std::string chunk)
+{
+    if (chunk.empty())
+        return;
+
+    auto block = std::make_shared<pending>();
+    if (m_compressor) {
+        // Словарь следующего блока - конец этого, вместе с хвостом прежнего словаря, если блок короче окна
+        block->dictionary = m_dictionary;
+        if (chunk.size() >= block_compressor::DICTIONARY_SIZE) {
+            m_dictionary.assign(chunk, chunk.size() - block_compressor::DICTIONARY_SIZE, std::string::npos);
+        } else {
+            m_dictionary += chunk;
+            if (m_dictionary.size() > block_compressor::DICTIONARY_SIZE)
+                m_dictionary.erase(0, m_dictionary.size() - block_compressor::DICTIONARY_SIZE);
+        }
+    }
+    block->data = std::move(chunk);
+    block->ready = !m_compressor;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&]() { return m_queue.size() < m_queueSize || m_error; });
+        if (m_error)
+            std::rethrow_exception(m_error);
+        m_queue.push_back(block);
+    }
+    m_cv.notify_all();
+
+    if (m_compressor)
+        m_tasks->run([this, block]() { compress(*block); });
+}
+
+void async_writer::compress(pending& block)
+{
+    if (block.claimed.exchange(true))
+        return;
+
+    block_compressor::block packed;
+    std::exception_ptr error;
+    try {
+        packed = m_compressor->compress(block.data, block.dictionary);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    // Несжатые данные больше не нужны
+    block.data = std::string();
+    block.dictionary = std::string();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        block.packed = std::move(packed);
+        block.error = error;
+        block.ready = true;
+    }
+    m_cv.notify_all();
+}
+
+void async_writer::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+void async_writer::run()
+{
+    auto put = [&](const std::string& data) {
+        m_stream->write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!*m_stream)
+            throw std::runtime_error("Can't write output file");
+    };
+
+    try {
+        if (m_compressor)
+            put(m_compressor->start());
+
+        for (;;) {
+            std::shared_ptr<pending> block;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&]() { return !m_queue.empty() || m_closing; });
+                if (m_queue.empty())
+                    break;
+                block = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            m_cv.notify_all();
+
+            if (!m_compressor) {
+                put(block->data);
+                continue;
+            }
+
+            // Блок, до которого пул ещё не дошёл, сжимается здесь, иначе - ждём его сжатия
+            compress(*block);
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&]() { return block->ready; });
+            }
+            if (block->error)
+                std::rethrow_exception(block->error);
+            m_compressor->append(block->packed);
+            put(block->packed.data);
+            // Задача пула может держать блок до своего запуска - память отпускается сразу
+            block->packed.data = std::string();
+        }
+
+        if (m_compressor)
+            put(m_compressor->finish());
+
+        if (m_stream == &m_file)
+            m_file.close();
+        else
+            m_stream->flush();
+        if (m_stream->fail())
+            throw std::runtime_error("Can't write output file");
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = std::current_exception();
+        m_queue.clear();
+        m_cv.notify_all();
+    }
+}
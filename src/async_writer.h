@@ -0,0 +1,111 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include "compression.h"
+#include "task_scheduler.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+
+/**
+ * @class async_writer
+ * @brief Запись файла блоками в отдельном потоке.
+ * @remarks Производитель передаёт готовые блоки в ограниченную очередь и продолжает работу,
+ * пока поток записи сбрасывает их на диск. Если очередь заполнена, производитель ждёт.
+ * При сжатии блоки сжимаются параллельно в общем пуле потоков (см. block_compressor),
+ * а поток записи пишет их в исходном порядке; блок, до которого пул не успел дойти,
+ * поток записи сжимает сам.
+ * Путь "-" означает стандартный поток вывода.
+ */
+class async_writer {
+public:
+    /// Количество блоков в очереди по умолчанию
+    static constexpr size_t DEFAULT_QUEUE_SIZE = 4;
+
+    /**
+     * @brief Открывает файл на запись и запускает поток записи
+     * @param path путь к файлу или "-" для стандартного потока вывода
+     * @param queueSize максимальное количество блоков, ожидающих записи; при сжатии -
+     * не меньше удвоенного количества потоков пула
+     * @param method формат сжатия файла
+     * @throw std::runtime_error если файл не удалось открыть или формат сжатия не поддерживается
+     */
+    explicit async_writer(
+        const std::string& path, size_t queueSize = DEFAULT_QUEUE_SIZE, compression method = compression::None);
+
+    /**
+     * @brief Дописывает оставшиеся блоки и останавливает поток записи
+     * @remarks Ошибки записи при этом не сообщаются, для их получения нужно вызвать close
+     */
+    ~async_writer();
+
+    async_writer(const async_writer&) = delete;
+    async_writer& operator=(const async_writer&) = delete;
+
+    /**
+     * @brief Ставит блок в очередь на запись
+     * @param chunk блок данных
+     * @throw std::runtime_error если запись ранее завершилась ошибкой
+     */
+    void write(std::string chunk);
+
+    /**
+     * @brief Дожидается записи всех блоков и закрывает файл
+     * @throw std::runtime_error если запись не удалась
+     */
+    void close();
+
+private:
+    /// Блок в очереди на запись
+    struct pending {
+        /// несжатые данные
+        std::string data;
+        /// конец предыдущего блока - словарь для сжатия
+        std::string dictionary;
+        /// результат сжатия
+        block_compressor::block packed;
+        /// блок взят на сжатие
+        std::atomic<bool> claimed { false };
+        /// ошибка сжатия
+        std::exception_ptr error;
+        /// блок сжат; защищён m_mutex
+        bool ready = false;
+    };
+
+    /**
+     * @brief Тело потока записи
+     */
+    void run();
+
+    /**
+     * @brief Сжимает блок, если его ещё никто не взял
+     * @param block блок
+     */
+    void compress(pending& block);
+
+private:
+    std::ofstream m_file;
+    std::ostream* m_stream;
+    std::deque<std::shared_ptr<pending>> m_queue;
+    size_t m_queueSize;
+    bool m_closing = false;
+    std::exception_ptr m_error;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::optional<block_compressor> m_compressor;
+    /// последние байты предыдущего блока
+    std::string m_dictionary;
+    /// задачи сжатия в пуле
+    std::optional<task_group> m_tasks;
+    std::thread m_thread;
+};
+
+#endif // ASYNC_WRITER_H
@@ -0,0 +1,231 @@
+#include "compression.h"
+#include <algorithm>
+#include <stdexcept>
+#include <zlib.h>
+#ifdef TASK2GIS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+constexpr std::string_view GZIP_MAGIC = "\x1f\x8b";
+constexpr std::string_view ZSTD_MAGIC = "\x28\xb5\x2f\xfd";
+
+/// Заголовок gzip без имени файла и времени изменения (RFC 1952)
+constexpr std::string_view GZIP_HEADER { "\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10 };
+/// Пустой последний блок deflate с фиксированными кодами
+constexpr std::string_view DEFLATE_LAST_BLOCK { "\x03\x00", 2 };
+
+bool endsWith(const std::string& text, std::string_view suffix) noexcept
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void putLittleEndian(std::string& output, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i, value >>= 8)
+        output += static_cast<char>(value & 0xFF);
+}
+
+[[noreturn]] void unsupported()
+{
+    throw std::runtime_error("zstd support is not built in (build with TASK2GIS_ZSTD)");
+}
+} // end of anonymous namespace
+
+compression detectCompression(std::string_view head) noexcept
+{
+    if (head.substr(0, GZIP_MAGIC.size()) == GZIP_MAGIC)
+        return compression::Gzip;
+    if (head.substr(0, ZSTD_MAGIC.size()) == ZSTD_MAGIC)
+        return compression::Zstd;
+    return compression::None;
+}
+
+compression compressionForPath(const std::string& path) noexcept
+{
+    if (endsWith(path, ".gz"))
+        return compression::Gzip;
+    if (endsWith(path, ".zst"))
+        return compression::Zstd;
+    return compression::None;
+}
+
+struct decompressor::impl {
+    compression method;
+    z_stream zlib {};
+    /// последний начатый сжатый поток закончился
+    bool ended = false;
+#ifdef TASK2GIS_ZSTD
+    ZSTD_DStream* zstd = nullptr;
+#endif
+};
+
+decompressor::decompressor(compression method)
+    : m_impl(new impl)
+{
+    m_impl->method = method;
+    if (method == compression::Gzip) {
+        // 16 + MAX_WBITS - формат gzip с заголовком и контрольной суммой
+        if (inflateInit2(&m_impl->zlib, 16 + MAX_WBITS) != Z_OK)
+            throw std::runtime_error("Can't initialize gzip decompression");
+        return;
+    }
+#ifdef TASK2GIS_ZSTD
+    m_impl->zstd = ZSTD_createDStream();
+    if (!m_impl->zstd || ZSTD_isError(ZSTD_initDStream(m_impl->zstd)))
+        throw std::runtime_error("Can't initialize zstd decompression");
+#else
+    unsupported();
+#endif
+}
+
+decompressor::~decompressor()
+{
+    if (m_impl->method == compression::Gzip)
+        inflateEnd(&m_impl->zlib);
+#ifdef TASK2GIS_ZSTD
+    if (m_impl->zstd)
+        ZSTD_freeDStream(m_impl->zstd);
+#endif
+}
+
+decompressor::step decompressor::decode(std::string_view input, char* output, size_t size)
+{
+    step ret;
+#ifdef TASK2GIS_ZSTD
+    if (m_impl->method == compression::Zstd) {
+        ZSTD_inBuffer in { input.data(), input.size(), 0 };
+        ZSTD_outBuffer out { output, size, 0 };
+        do {
+            auto hint = ZSTD_decompressStream(m_impl->zstd, &out, &in);
+            if (ZSTD_isError(hint))
+                throw std::runtime_error(std::string("Invalid zstd data: ") + ZSTD_getErrorName(hint));
+            m_impl->ended = (hint == 0);
+        } while (in.pos < in.size && out.pos < out.size);
+        ret.consumed = in.pos;
+        ret.produced = out.pos;
+        return ret;
+    }
+#endif
+
+    auto& zs = m_impl->zlib;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zs.avail_in = static_cast<uInt>(input.size());
+    zs.next_out = reinterpret_cast<Bytef*>(output);
+    zs.avail_out = static_cast<uInt>(size);
+    for (;;) {
+        // Следующий gzip member начинается сразу за концом предыдущего
+        if (m_impl->ended && zs.avail_in > 0) {
+            inflateReset(&zs);
+            m_impl->ended = false;
+        }
+        auto res = inflate(&zs, Z_NO_FLUSH);
+        if (res == Z_STREAM_END)
+            m_impl->ended = true;
+        else if (res != Z_OK && res != Z_BUF_ERROR)
+            throw std::runtime_error(std::string("Invalid gzip data: ") + (zs.msg ? zs.msg : "unknown error"));
+        if (zs.avail_out == 0 || zs.avail_in == 0 || res == Z_BUF_ERROR)
+            break;
+    }
+    ret.consumed = input.size() - zs.avail_in;
+    ret.produced = size - zs.avail_out;
+    return ret;
+}
+
+bool decompressor::finished() const noexcept
+{
+    return m_impl->ended;
+}
+
+std::string decompressor::decodeAll(compression method, std::string_view input)
+{
+    decompressor d(method);
+    std::string ret;
+    size_t size = 0;
+    for (;;) {
+        if (ret.size() - size < input.size() + 4096)
+            ret.resize(ret.size() + std::max(input.size(), ret.size()) + 4096);
+        auto res = d.decode(input, ret.data() + size, ret.size() - size);
+        input.remove_prefix(res.consumed);
+        size += res.produced;
+        if (input.empty() && res.produced == 0)
+            break;
+    }
+    if (!d.finished())
+        throw std::runtime_error("Compressed data is truncated");
+    ret.resize(size);
+    return ret;
+}
+
+block_compressor::block_compressor(compression method)
+    : m_method(method)
+    , m_crc(static_cast<uint32_t>(crc32(0, Z_NULL, 0)))
+{
+#ifndef TASK2GIS_ZSTD
+    if (method == compression::Zstd)
+        unsupported();
+#endif
+}
+
+std::string block_compressor::start() const
+{
+    return (m_method == compression::Gzip) ? std::string(GZIP_HEADER) : std::string();
+}
+
+block_compressor::block block_compressor::compress(std::string_view data, std::string_view dictionary) const
+{
+    block ret;
+    ret.size = data.size();
+#ifdef TASK2GIS_ZSTD
+    if (m_method == compression::Zstd) {
+        ret.data.resize(ZSTD_compressBound(data.size()));
+        auto size = ZSTD_compress(ret.data.data(), ret.data.size(), data.data(), data.size(), ZSTD_CLEVEL_DEFAULT);
+        if (ZSTD_isError(size))
+            throw std::runtime_error(std::string("Can't compress: ") + ZSTD_getErrorName(size));
+        ret.data.resize(size);
+        return ret;
+    }
+#endif
+
+    // Отрицательный размер окна - deflate без заголовка: заголовок и сумма пишутся один раз на поток
+    z_stream zs {};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error("Can't initialize gzip compression");
+    if (!dictionary.empty()) {
+        deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(dictionary.data()),
+            static_cast<uInt>(dictionary.size()));
+    }
+
+    // Z_SYNC_FLUSH добавляет к оценке deflateBound пустой блок из 5 байтов
+    ret.data.resize(deflateBound(&zs, static_cast<uLong>(data.size())) + 16);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef*>(ret.data.data());
+    zs.avail_out = static_cast<uInt>(ret.data.size());
+    auto res = deflate(&zs, Z_SYNC_FLUSH);
+    ret.data.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (res != Z_OK || zs.avail_in != 0)
+        throw std::runtime_error("Can't compress output");
+
+    ret.crc = static_cast<uint32_t>(crc32_z(0, reinterpret_cast<const Bytef*>(data.data()), data.size()));
+    return ret;
+}
+
+void block_compressor::append(const block& written) noexcept
+{
+    m_crc = static_cast<uint32_t>(crc32_combine(m_crc, written.crc, static_cast<z_off_t>(written.size)));
+    m_size += written.size;
+}
+
+std::string block_compressor::finish() const
+{
+    if (m_method != compression::Gzip)
+        return std::string();
+
+    // Размер в конце gzip хранится по модулю 2^32
+    std::string ret(DEFLATE_LAST_BLOCK);
+    putLittleEndian(ret, m_crc);
+    putLittleEndian(ret, static_cast<uint32_t>(m_size));
+    return ret;
+}
@@ -0,0 +1,152 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/// Формат сжатия файла
+enum class compression : uint8_t {
+    None,
+    /// gzip (RFC 1952)
+    Gzip,
+    /// zstd (RFC 8878); доступен в сборке с опцией TASK2GIS_ZSTD
+    Zstd
+};
+
+/**
+ * @brief Определяет формат сжатия по первым байтам файла
+ * @param head начало файла; достаточно 4 байт
+ * @return формат сжатия, None если данные не сжаты
+ */
+compression detectCompression(std::string_view head) noexcept;
+
+/**
+ * @brief Определяет формат сжатия по расширению файла: ".gz" или ".zst"
+ * @param path путь к файлу
+ * @return формат сжатия, None если расширение другое
+ */
+compression compressionForPath(const std::string& path) noexcept;
+
+/**
+ * @class decompressor
+ * @brief Потоковая распаковка gzip и zstd.
+ * @remarks Несколько сжатых потоков подряд (gzip members, кадры zstd) распаковываются
+ * как один поток - так выглядит результат block_compressor и, например, cat a.gz b.gz.
+ */
+class decompressor {
+public:
+    /// Результат шага распаковки
+    struct step {
+        /// количество прочитанных байтов входа
+        size_t consumed = 0;
+        /// количество записанных байтов результата
+        size_t produced = 0;
+    };
+
+    /**
+     * @brief Подготавливает распаковку
+     * @param method формат сжатия, отличный от None
+     * @throw std::runtime_error если формат не поддерживается сборкой
+     */
+    explicit decompressor(compression method);
+    ~decompressor();
+
+    decompressor(const decompressor&) = delete;
+    decompressor& operator=(const decompressor&) = delete;
+
+    /**
+     * @brief Распаковывает очередную часть входа
+     * @remarks Вход может быть пустым: распаковщик может держать готовый результат,
+     * не поместившийся в буфер на прошлом шаге
+     * @param input сжатые данные
+     * @param output буфер результата
+     * @param size размер буфера
+     * @throw std::runtime_error если данные повреждены
+     */
+    step decode(std::string_view input, char* output, size_t size);
+
+    /**
+     * @brief Закончился ли последний начатый сжатый поток?
+     * @return false если вход оборвался посреди потока
+     */
+    bool finished() const noexcept;
+
+    /**
+     * @brief Распаковывает данные целиком
+     * @param method формат сжатия, отличный от None
+     * @param input сжатые данные
+     * @throw std::runtime_error если данные повреждены или оборваны
+     * @return распакованные данные
+     */
+    static std::string decodeAll(compression method, std::string_view input);
+
+private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+};
+
+/**
+ * @class block_compressor
+ * @brief Сжатие независимыми блоками, которые можно сжимать параллельно (как в pigz).
+ * @remarks Для gzip каждый блок сжимается отдельным deflate с последними 32 КБ предыдущего
+ * блока в качестве словаря и завершается Z_SYNC_FLUSH, поэтому блоки, записанные подряд
+ * между start и finish, образуют один обычный gzip-поток почти той же степени сжатия.
+ * Контрольная сумма складывается из сумм блоков (crc32_combine).
+ * Для zstd каждый блок - отдельный кадр; кадры подряд - корректный zstd-поток.
+ * compress можно вызывать из разных потоков одновременно, остальные методы - в порядке записи.
+ */
+class block_compressor {
+public:
+    /// Размер окна deflate: сколько байтов предыдущего блока нужно передавать в compress
+    static constexpr size_t DICTIONARY_SIZE = 32 * 1024;
+
+    /// Сжатый блок
+    struct block {
+        std::string data;
+        /// контрольная сумма несжатых данных (для gzip)
+        uint32_t crc = 0;
+        /// размер несжатых данных
+        size_t size = 0;
+    };
+
+    /**
+     * @brief Подготавливает сжатие
+     * @param method формат сжатия, отличный от None
+     * @throw std::runtime_error если формат не поддерживается сборкой
+     */
+    explicit block_compressor(compression method);
+
+    /**
+     * @brief Начало сжатого потока, записываемое перед первым блоком
+     */
+    std::string start() const;
+
+    /**
+     * @brief Сжимает блок
+     * @param data несжатые данные блока
+     * @param dictionary последние байты предыдущего блока, не больше DICTIONARY_SIZE
+     * @throw std::runtime_error если сжатие не удалось
+     */
+    block compress(std::string_view data, std::string_view dictionary) const;
+
+    /**
+     * @brief Учитывает блок, записанный в поток
+     * @param written сжатый блок
+     */
+    void append(const block& written) noexcept;
+
+    /**
+     * @brief Конец сжатого потока, записываемый после последнего блока
+     */
+    std::string finish() const;
+
+private:
+    compression m_method;
+    uint32_t m_crc;
+    uint64_t m_size = 0;
+};
+
+#endif // COMPRESSION_H
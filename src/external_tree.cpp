@@ -0,0 +1,300 @@
+#include "external_tree.h"
+#include "tree_builder.h"
+#include "json/push_parser.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+/// Размер одного буфера не превышает этого значения, чтобы большой предел не тратился впустую
+constexpr size_t MAX_BUFFER_SIZE = 64 << 20;
+
+template <typename T>
+uint64_t toBits(T value)
+{
+    static_assert(sizeof(T) <= sizeof(uint64_t));
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(value));
+    return bits;
+}
+
+template <typename T>
+T fromBits(uint64_t bits)
+{
+    T value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+} // end of anonymous namespace
+
+external_tree::external_tree(size_t memoryLimit)
+    : m_bufferSize(std::min(memoryLimit / 16, MAX_BUFFER_SIZE))
+    , m_records(m_bufferSize * 2)
+    , m_texts(m_bufferSize * 2)
+{
+    if (memoryLimit < MIN_MEMORY_LIMIT)
+        throw std::invalid_argument("Memory limit must be at least " + std::to_string(MIN_MEMORY_LIMIT) + " bytes");
+}
+
+external_tree::node external_tree::decode(const record& rec, spill_cursor& texts, std::string& text)
+{
+    node ret;
+    ret.type = rec.type;
+    ret.childs = rec.childs;
+    if (rec.type == kind::Integer)
+        ret.integer = fromBits<int>(rec.value);
+    else if (rec.type == kind::Double)
+        ret.number = fromBits<double>(rec.value);
+    if (rec.textSize > 0) {
+        text.resize(rec.textSize);
+        texts.read(rec.textOffset, text.data(), rec.textSize);
+        ret.text = text;
+    }
+    return ret;
+}
+
+void external_tree::serialize(const std::function<void(std::string)>& sink,
+    const std::function<void(const node&, unsigned)>& visit) const
+{
+    // Блок передаётся приёмнику перемещением, без копирования текста
+    std::string out;
+    auto reserve = [&]() { out.reserve(m_bufferSize + m_bufferSize / 8); };
+    reserve();
+    const auto nodeKey = "\"" + tree::NODE_FN + "\" : ";
+    const auto subnodesKey = "\"" + tree::SUBNODES_FN + "\" : [\n";
+    auto indent = [&](unsigned count) { out.append(count, ' '); };
+
+    // Узел дерева уровня level - объект уровня 2 * level, его массив subnodes - уровня 2 * level + 1
+    walk(
+        [&](const node& n, unsigned level) {
+            visit(n, level);
+            indent(level * 2);
+            out += "{\n";
+            indent(level * 2 + 1);
+            out += nodeKey;
+            // Значения форматируются так же, как в tree::serialize
+            if (n.type == kind::String)
+                tree::appendValue(out, n.text);
+            else if (n.type == kind::Integer)
+                tree::appendValue(out, n.integer, n.text);
+            else
+                tree::appendValue(out, n.number, n.text);
+
+            if (n.childs > 0) {
+                out += ",\n";
+                indent(level * 2 + 1);
+                out += subnodesKey;
+            } else {
+                out += '\n';
+            }
+        },
+        [&](const node& n, unsigned level, bool last) {
+            if (n.childs > 0) {
+                indent(level * 2 + 1);
+                out += "]\n";
+            }
+            indent(level * 2);
+            out += '}';
+            if (level > 0)
+                out += last ? "\n" : ",\n";
+
+            if (out.size() >= m_bufferSize) {
+                sink(std::move(out));
+                out = std::string();
+                reserve();
+            }
+        });
+    sink(std::move(out));
+}
+
+external_tree_builder::external_tree_builder(external_tree& tree, bool strict, bool keepNumberText)
+    : m_tree(tree)
+    , m_strict(strict)
+    , m_keepNumberText(keepNumberText)
+{
+}
+
+void external_tree_builder::finish()
+{
+    m_tree.m_records.flush();
+    m_tree.m_texts.flush();
+}
+
+uint64_t external_tree_builder::nextIndex() const noexcept
+{
+    return m_tree.records();
+}
+
+const char* external_tree_builder::checkScalar() const
+{
+    switch (m_role) {
+    case role::Tree:
+        return "tree node must be an object";
+    case role::Subnodes:
+        return "subnodes must be an array";
+    case role::Node:
+    case role::Skip:
+        break;
+    }
+    return nullptr;
+}
+
+const char* external_tree_builder::onNull()
+{
+    if (m_skip > 0)
+        return nullptr;
+    if (m_role == role::Node)
+        return "node must be a string or a number";
+    return checkScalar();
+}
+
+template <typename T>
+const char* external_tree_builder::number(external_tree::kind type, T value, std::string_view text)
+{
+    if (m_skip > 0)
+        return nullptr;
+    if (m_role != role::Node)
+        return checkScalar();
+
+    auto& rec = m_frames.back().rec;
+    rec.type = type;
+    rec.value = toBits(value);
+    rec.textSize = 0;
+    if (m_keepNumberText && json::is_json_number(text)) {
+        rec.textOffset = m_tree.m_texts.append(text.data(), text.size());
+        rec.textSize = static_cast<uint32_t>(text.size());
+    }
+    return nullptr;
+}
+
+const char* external_tree_builder::onInteger(int value, std::string_view text)
+{
+    return number(external_tree::kind::Integer, value, text);
+}
+
+const char* external_tree_builder::onDouble(double value, std::string_view text)
+{
+    return number(external_tree::kind::Double, value, text);
+}
+
+const char* external_tree_builder::onString(std::string_view value)
+{
+    if (m_skip > 0)
+        return nullptr;
+    if (m_role != role::Node)
+        return checkScalar();
+    if (value.size() > UINT32_MAX)
+        return "value is too long";
+
+    auto& rec = m_frames.back().rec;
+    rec.type = external_tree::kind::String;
+    rec.textOffset = m_tree.m_texts.append(value.data(), value.size());
+    rec.textSize = static_cast<uint32_t>(value.size());
+    return nullptr;
+}
+
+const char* external_tree_builder::onKey(std::string_view key)
+{
+    if (m_skip > 0)
+        return nullptr;
+
+    switch (tree_builder::matchField(key)) {
+    case tree_builder::field::Node:
+        m_role = role::Node;
+        break;
+    case tree_builder::field::Subnodes:
+        m_role = role::Subnodes;
+        break;
+    case tree_builder::field::Unknown:
+        if (m_unknownKeys++ == 0)
+            m_firstUnknownKey.assign(key);
+        if (m_strict)
+            return "unknown key";
+        m_role = role::Skip;
+        break;
+    }
+    return nullptr;
+}
+
+const char* external_tree_builder::onStartObject()
+{
+    if (m_skip > 0) {
+        ++m_skip;
+        return nullptr;
+    }
+
+    switch (m_role) {
+    case role::Tree: {
+        if ((m_frames.size() + 1) * sizeof(frame) > m_tree.bufferSize())
+            return "tree is too deep for the memory limit";
+        if (!m_frames.empty())
+            ++m_frames.back().rec.childs;
+
+        // Запись резервируется сейчас, чтобы узлы шли в прямом порядке, и заполняется при закрытии
+        frame f {};
+        f.index = nextIndex();
+        m_tree.m_records.append(&f.rec, sizeof(f.rec));
+        m_frames.push_back(f);
+        return nullptr;
+    }
+    case role::Skip:
+        m_skip = 1;
+        return nullptr;
+    case role::Node:
+        return "node must be a string or a number";
+    case role::Subnodes:
+        return "subnodes must be an array";
+    }
+    return nullptr;
+}
+
+const char* external_tree_builder::onEndObject()
+{
+    if (m_skip > 0) {
+        --m_skip;
+        return nullptr;
+    }
+
+    const auto& top = m_frames.back();
+    if (top.rec.type == external_tree::kind::None)
+        return "node not found";
+    m_tree.m_records.write(top.index * sizeof(top.rec), &top.rec, sizeof(top.rec));
+    m_frames.pop_back();
+    if (!m_frames.empty())
+        m_role = role::Tree;
+    return nullptr;
+}
+
+const char* external_tree_builder::onStartArray()
+{
+    if (m_skip > 0) {
+        ++m_skip;
+        return nullptr;
+    }
+
+    switch (m_role) {
+    case role::Subnodes: {
+        // При повторном ключе subnodes действует последнее значение:
+        // записи прежних дочерних элементов пропускаются при обходе
+        auto& top = m_frames.back();
+        top.rec.childs = 0;
+        top.rec.skip = nextIndex() - top.index - 1;
+        m_role = role::Tree;
+        return nullptr;
+    }
+    case role::Skip:
+        m_skip = 1;
+        return nullptr;
+    case role::Tree:
+        return "tree node must be an object";
+    case role::Node:
+        return "node must be a string or a number";
+    }
+    return nullptr;
+}
+
+const char* external_tree_builder::onEndArray()
+{
+    if (m_skip > 0)
+        --m_skip;
+    return nullptr;
+}
@@ -0,0 +1,276 @@
+#ifndef EXTERNAL_TREE_H
+#define EXTERNAL_TREE_H
+
+#include "spill_file.h"
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class external_tree
+ * @brief Дерево, хранящееся во временных файлах, для деревьев больше оперативной памяти.
+ * @remarks Узлы лежат в файле записей фиксированного размера в прямом порядке обхода,
+ * строки и исходный текст чисел - в отдельном текстовом файле. Запись узла резервируется
+ * при открытии объекта и заполняется при его закрытии, поэтому ключи узла допускаются
+ * в любом порядке, а в памяти держится только путь от корня до текущего узла.
+ * Все буферы соразмерны заданному пределу памяти.
+ */
+class external_tree {
+public:
+    /// Наименьший допустимый предел памяти
+    static constexpr size_t MIN_MEMORY_LIMIT = 1 << 20;
+
+    /// Тип значения узла
+    enum class kind : uint8_t {
+        None,
+        Integer,
+        Double,
+        String
+    };
+
+    /// Узел, передаваемый при обходе
+    struct node {
+        kind type = kind::None;
+        int integer = 0;
+        double number = 0;
+        /// строковое значение или сохранённый исходный текст числа
+        std::string_view text;
+        /// количество дочерних элементов
+        uint64_t childs = 0;
+    };
+
+    /**
+     * @brief Создаёт пустое дерево
+     * @param memoryLimit предел памяти для буферов дерева и его обработки, в байтах
+     * @throw std::invalid_argument если предел меньше MIN_MEMORY_LIMIT
+     * @throw std::runtime_error если не удалось создать временные файлы
+     */
+    explicit external_tree(size_t memoryLimit);
+
+    /**
+     * @brief Размер одного буфера при обработке дерева
+     * @remarks Предел памяти делится на 16 таких частей: по две получают буферы чтения входного
+     * файла, накопления значений в парсере, записи каждого из временных файлов и вывода,
+     * по одной - пути от корня до текущего узла при построении и при обходе
+     */
+    size_t bufferSize() const noexcept;
+
+    /**
+     * @brief Количество записей узлов, включая записи отброшенных дочерних элементов
+     */
+    uint64_t records() const noexcept;
+
+    /**
+     * @brief Обходит дерево в прямом порядке
+     * @remarks enter вызывается как enter(const node& n, unsigned level) перед дочерними
+     * элементами узла, leave - как leave(const node& n, unsigned level, bool last) после них;
+     * last истинно для последнего дочернего элемента и для корня. Текст узла действителен
+     * только во время вызова enter
+     * @throw std::runtime_error если путь от корня до узла не помещается в предел памяти
+     */
+    template <typename TEnter, typename TLeave>
+    void walk(TEnter enter, TLeave leave) const;
+
+    /**
+     * @brief Генерирует JSON-текст дерева блоками, попутно передавая узлы наблюдателю
+     * @remarks Текст совпадает с текстом json::value::serialize для tree::serialize,
+     * включая сохранённый исходный текст чисел. Размер блока - около bufferSize
+     * @param sink приёмник блоков текста
+     * @param visit вызывается для каждого узла в прямом порядке как visit(node, level)
+     */
+    void serialize(const std::function<void(std::string)>& sink,
+        const std::function<void(const node&, unsigned)>& visit) const;
+
+private:
+    friend class external_tree_builder;
+
+    /// Запись узла во временном файле
+    struct record {
+        uint64_t childs;
+        /// количество записей отброшенных дочерних элементов (при повторном ключе subnodes)
+        uint64_t skip;
+        uint64_t textOffset;
+        /// целое или вещественное значение
+        uint64_t value;
+        uint32_t textSize;
+        kind type;
+    };
+
+    /**
+     * @brief Читает узел по записи
+     * @param rec запись
+     * @param texts курсор текстового файла
+     * @param text буфер для текста узла
+     * @return узел
+     */
+    static node decode(const record& rec, spill_cursor& texts, std::string& text);
+
+private:
+    size_t m_bufferSize;
+    spill_file m_records;
+    spill_file m_texts;
+};
+
+/**
+ * @class external_tree_builder
+ * @brief Обработчик json::push_parser, выгружающий дерево во временные файлы external_tree.
+ * @remarks Грамматика и сообщения об ошибках совпадают с tree_builder
+ */
+class external_tree_builder {
+public:
+    /**
+     * @brief Конструирует сборщик
+     * @param tree пустое дерево, в которое выгружаются узлы
+     * @param strict true чтобы считать посторонние ключи ошибкой
+     * @param keepNumberText true чтобы сохранять исходный текст чисел
+     * @warning время жизни сборщика не должно превышать время жизни дерева
+     */
+    external_tree_builder(external_tree& tree, bool strict = false, bool keepNumberText = false);
+
+    /**
+     * @brief Завершает выгрузку
+     * @remarks Вызывать после успешного завершения разбора; освобождает буферы записи
+     */
+    void finish();
+
+    /**
+     * @brief Количество встреченных посторонних ключей
+     */
+    size_t unknownKeys() const noexcept;
+
+    /**
+     * @brief Первый встреченный посторонний ключ
+     * @return ключ, пустая строка если посторонних ключей не было
+     */
+    const std::string& firstUnknownKey() const noexcept;
+
+    const char* onNull();
+    const char* onInteger(int value, std::string_view text);
+    const char* onDouble(double value, std::string_view text);
+    const char* onString(std::string_view value);
+    const char* onKey(std::string_view key);
+    const char* onStartObject();
+    const char* onEndObject();
+    const char* onStartArray();
+    const char* onEndArray();
+
+private:
+    /// Незавершённый узел дерева
+    struct frame {
+        external_tree::record rec;
+        uint64_t index;
+    };
+
+    /// Чем должно быть очередное значение
+    enum class role : uint8_t {
+        Tree,
+        Node,
+        Subnodes,
+        Skip
+    };
+
+    /**
+     * @brief Проверяет, что значение можно принять как значение узла
+     * @return описание ошибки или nullptr
+     */
+    const char* checkScalar() const;
+
+    /**
+     * @brief Принимает числовое значение узла
+     * @param type тип значения
+     * @param value значение
+     * @param text исходный текст числа
+     */
+    template <typename T>
+    const char* number(external_tree::kind type, T value, std::string_view text);
+
+    /**
+     * @brief Номер следующей записи в файле записей
+     */
+    uint64_t nextIndex() const noexcept;
+
+private:
+    external_tree& m_tree;
+    bool m_strict;
+    bool m_keepNumberText;
+    role m_role = role::Tree;
+    std::vector<frame> m_frames;
+    size_t m_skip = 0;
+    size_t m_unknownKeys = 0;
+    std::string m_firstUnknownKey;
+};
+
+inline size_t external_tree::bufferSize() const noexcept
+{
+    return m_bufferSize;
+}
+
+inline uint64_t external_tree::records() const noexcept
+{
+    return m_records.size() / sizeof(record);
+}
+
+template <typename TEnter, typename TLeave>
+void external_tree::walk(TEnter enter, TLeave leave) const
+{
+    if (records() == 0)
+        return;
+
+    struct entry {
+        node n;
+        uint64_t remaining;
+    };
+
+    spill_cursor records(m_records, m_bufferSize);
+    spill_cursor texts(m_texts, m_bufferSize);
+    std::string text;
+    std::vector<entry> stack;
+    uint64_t index = 0;
+
+    // Читает очередной узел и возвращает его без текста, чтобы хранить в стеке
+    auto visit = [&](unsigned level, bool last) {
+        record rec;
+        records.read(index * sizeof(record), &rec, sizeof(rec));
+        index += 1 + rec.skip;
+        auto n = decode(rec, texts, text);
+        enter(n, level);
+        n.text = std::string_view();
+        if (n.childs == 0) {
+            leave(n, level, last);
+            return;
+        }
+        if ((stack.size() + 1) * sizeof(entry) > m_bufferSize)
+            throw std::runtime_error("Tree is too deep for the memory limit");
+        stack.push_back({ n, n.childs });
+    };
+
+    visit(0, true);
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        if (top.remaining == 0) {
+            auto n = top.n;
+            stack.pop_back();
+            auto level = static_cast<unsigned>(stack.size());
+            leave(n, level, stack.empty() || stack.back().remaining == 0);
+            continue;
+        }
+        --top.remaining;
+        auto last = top.remaining == 0;
+        visit(static_cast<unsigned>(stack.size()), last);
+    }
+}
+
+inline size_t external_tree_builder::unknownKeys() const noexcept
+{
+    return m_unknownKeys;
+}
+
+inline const std::string& external_tree_builder::firstUnknownKey() const noexcept
+{
+    return m_firstUnknownKey;
+}
+
+#endif // EXTERNAL_TREE_H
@@ -1,4 +1,6 @@
 #include "file.h"
+#include "compression.h"
+#include "trace.h"
 #include <filesystem>
 #include <fstream>
 
@@ -6,6 +8,7 @@ namespace fs = std::filesystem;
 
 std::vector<uint8_t> file::ReadAllBytes(const std::string& path)
 {
+    TRACE_SCOPE("file::ReadAllBytes");
     std::vector<uint8_t> buffer;
     std::ifstream ifs(std::filesystem::u8path(path), std::ios::binary);
     if (!ifs.is_open())
@@ -18,12 +21,38 @@ std::vector<uint8_t> file::ReadAllBytes(const std::string& path)
     buffer.resize(length);
     ifs.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
 
+    auto bytes = std::string_view(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    if (auto method = detectCompression(bytes); method != compression::None) {
+        auto decoded = decompressor::decodeAll(method, bytes);
+        buffer.assign(decoded.begin(), decoded.end());
+    }
+
     return buffer;
 }
 
 std::string file::ReadAllText(const std::string& path)
 {
-    return ReadAllTextAsStream(path).str();
+    TRACE_SCOPE("file::ReadAllText");
+    std::string text;
+    std::ifstream ifs(std::filesystem::u8path(path), std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("Can't open '" + path + "'");
+
+    ifs.seekg(0, ifs.end);
+    size_t length = static_cast<size_t>(static_cast<std::streamoff>(ifs.tellg()));
+    ifs.seekg(0, ifs.beg);
+
+    text.resize(length);
+    ifs.read(text.data(), text.size());
+
+    if (auto method = detectCompression(text); method != compression::None)
+        text = decompressor::decodeAll(method, text);
+
+    // Отбрасываем преамбулу если UTF-8
+    if (text.size() >= 3 && text.compare(0, 3, "\xef\xbb\xbf") == 0)
+        text.erase(0, 3);
+
+    return text;
 }
 
 std::stringstream file::ReadAllTextAsStream(const std::string& path)
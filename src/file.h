@@ -13,6 +13,7 @@ class file {
 public:
     /**
      * @brief Открывает текстовый файл, считывает весь текст файла в строку и затем закрывает файл.
+     * @remarks Файл, сжатый gzip или zstd, распаковывается
      * @param path Файл, открываемый для чтения.
      * @return Строка, содержащая весь текст файла.
      */
@@ -27,6 +28,7 @@ public:
 
     /**
      * @brief Открывает файл, считывает все байты файла и затем закрывает файл.
+     * @remarks Файл, сжатый gzip или zstd, распаковывается
      * @param path Файл, открываемый для чтения.
      * @return Контейнер, содержащий все байты из файла
      */
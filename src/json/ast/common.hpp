@@ -2,64 +2,72 @@
 #define INC_AST_COMMON_HPP
 
 #include "ast_adapted.hpp"
+#include "json/detail/escape.h"
+#include "json/detail/utf8.h"
 #include <boost/spirit/home/x3.hpp>
+#include <string_view>
 
 namespace json_client {
 namespace x3 = boost::spirit::x3;
 
-struct unfinished_guard : x3::parser<unfinished_guard> {
-    using attribute_type = char;
+/// Строка JSON в кавычках с раскрытием escape-последовательностей (RFC 8259, раздел 7).
+/// Участки без escape-последовательностей ищутся векторными инструкциями и копируются целиком,
+/// содержимое строки должно быть корректным UTF-8.
+struct quoted_string : x3::parser<quoted_string> {
+    using attribute_type = std::string;
 
     template <typename Iterator, typename Context, typename RContext, typename Attribute>
     bool parse(Iterator& first, Iterator const& last, Context const& context,
-        RContext const& rcontext, Attribute& attr) const
+        RContext const&, Attribute& attr) const
     {
-        if (first == last) {
-            boost::throw_exception(
-                x3::expectation_failure<Iterator>(
-                    first, "unfinished string"));
-        }
-        if (*first == '\n' || *first == '\r') {
-            boost::throw_exception(
-                x3::expectation_failure<Iterator>(
-                    first, "unfinished string"));
-        }
-        return false;
-    }
-};
+        x3::skip_over(first, last, context);
+        if (first == last || *first != '"')
+            return false;
 
-struct esc_guard : x3::parser<esc_guard> {
-    using attribute_type = char;
+        // Ищем закрывающую кавычку, перескакивая экранированные символы
+        const char* text = &*first;
+        const auto size = static_cast<size_t>(last - first);
+        size_t pos = 1;
+        bool escaped = false;
+        for (;;) {
+            pos += detail::scanString(text + pos, size - pos);
+            if (pos == size || text[pos] == '\n' || text[pos] == '\r')
+                boost::throw_exception(x3::expectation_failure<Iterator>(first + pos, "unfinished string"));
+            if (text[pos] == '"')
+                break;
+            if (text[pos] != '\\')
+                boost::throw_exception(x3::expectation_failure<Iterator>(first + pos, "unescaped control character in string"));
+            escaped = true;
+            if (++pos == size)
+                boost::throw_exception(x3::expectation_failure<Iterator>(first + pos, "unfinished string"));
+            ++pos;
+        }
 
-    template <typename Iterator, typename Context, typename RContext, typename Attribute>
-    bool parse(Iterator& first, Iterator const& last, Context const& context,
-        RContext const& rcontext, Attribute& attr) const
-    {
-        if (first != last && *first == '\\') {
-            boost::throw_exception(
-                x3::expectation_failure<Iterator>(
-                    first, "invalid escape sequence"));
+        std::string value;
+        auto content = std::string_view(text + 1, pos - 1);
+        auto invalid = detail::validateUtf8(content.data(), content.size());
+        if (invalid != content.size())
+            boost::throw_exception(x3::expectation_failure<Iterator>(first + 1 + invalid, "invalid UTF-8"));
+        if (escaped) {
+            size_t errorPos = 0;
+            if (auto error = detail::unescape(content, value, errorPos))
+                boost::throw_exception(x3::expectation_failure<Iterator>(first + 1 + errorPos, error));
+        } else {
+            value.assign(content);
         }
-        return false;
+        x3::traits::move_to(std::move(value), attr);
+        first += pos + 1;
+        return true;
     }
 };
 } // end of namespace json_client
 
 template <>
-struct json_client::x3::get_info<json_client::unfinished_guard> {
-    typedef std::string result_type;
-    std::string operator()(json_client::unfinished_guard const&) const
-    {
-        return "unfinished_guard";
-    }
-};
-
-template <>
-struct json_client::x3::get_info<json_client::esc_guard> {
+struct json_client::x3::get_info<json_client::quoted_string> {
     typedef std::string result_type;
-    std::string operator()(json_client::esc_guard const&) const
+    std::string operator()(json_client::quoted_string const&) const
     {
-        return "esc_guard";
+        return "quoted_string";
     }
 };
 
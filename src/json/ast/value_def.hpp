@@ -18,8 +18,7 @@ namespace parser {
     using x3::lexeme;
     using x3::lit;
 
-    auto const unfinished_guard_ = unfinished_guard {};
-    auto const esc_guard_ = esc_guard {};
+    auto const quoted_string_ = quoted_string {};
     x3::symbols<> null_kw;
 
     void add_keywords()
@@ -27,8 +26,6 @@ namespace parser {
         static std::once_flag once;
         std::call_once(once, [&]() {
             null_kw.add("null");
-
-            // TODO: escape-символы
         });
     }
 
@@ -53,12 +50,15 @@ namespace parser {
     member_pair_type const member_pair("member_pair");
     object_type const object("object");
 
+    // Число без дробной части и экспоненты разбирается как int, если помещается в него
+    auto const strict_double = x3::real_parser<double, x3::strict_real_policies<double>> {};
+
     auto const null_def = lexeme[null_kw];
-    auto const value_def = null | quoted | double_ | int_ | array | object;
+    auto const value_def = null | quoted | strict_double | int_ | double_ | array | object;
     auto const array_def = lit('[')
         > -(value % ',')
         > lit(']');
-    auto const quoted_def = lexeme['"' >> *(unfinished_guard_ | esc_guard_ | (char_ - '"')) >> '"'];
+    auto const quoted_def = quoted_string_;
     auto const member_pair_def = quoted
         >> ':'
         >> value;
@@ -0,0 +1,17 @@
+#ifndef BINARY_FORMAT_H
+#define BINARY_FORMAT_H
+
+#include <cstdint>
+
+namespace json {
+
+/// Двоичный формат, эквивалентный JSON
+enum class binary_format : uint8_t {
+    /// MessagePack (https://msgpack.org)
+    MessagePack,
+    /// CBOR (RFC 8949)
+    Cbor
+};
+} // end of namespace json
+
+#endif // BINARY_FORMAT_H
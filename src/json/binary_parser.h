@@ -0,0 +1,638 @@
+#ifndef BINARY_PARSER_H
+#define BINARY_PARSER_H
+
+#include "binary_format.h"
+#include "detail/utf8.h"
+#include "value.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace detail {
+/// Читает целое без знака в сетевом порядке байтов
+inline uint64_t readBigEndian(const unsigned char* data, size_t size) noexcept
+{
+    uint64_t ret = 0;
+    for (size_t i = 0; i < size; ++i)
+        ret = (ret << 8) | data[i];
+    return ret;
+}
+
+/// Число половинной точности IEEE 754 (CBOR)
+inline double halfToDouble(uint16_t half) noexcept
+{
+    int exponent = (half >> 10) & 0x1F;
+    int mantissa = half & 0x3FF;
+    double value;
+    if (exponent == 0)
+        value = std::ldexp(mantissa, -24);
+    else if (exponent != 31)
+        value = std::ldexp(mantissa + 1024, exponent - 25);
+    else
+        value = (mantissa == 0) ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+    return (half & 0x8000) ? -value : value;
+}
+
+inline double floatFromBits(uint32_t bits) noexcept
+{
+    float ret;
+    std::memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+
+inline double doubleFromBits(uint64_t bits) noexcept
+{
+    double ret;
+    std::memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+} // end of namespace detail
+
+namespace json {
+
+/**
+ * @class binary_parser
+ * @brief Возобновляемый парсер MessagePack и CBOR, принимающий данные произвольными кусками.
+ * @remarks Передаёт разобранные значения тому же обработчику THandler, что и json::push_parser,
+ * поэтому строить дерево, JSON-значение или проверять документ можно без промежуточного текста.
+ * Ключи словарей должны быть строками, строки - корректным UTF-8. Типы, которых нет в грамматике
+ * JSON этой программы (логические значения, двоичные данные, расширения), считаются ошибкой;
+ * теги CBOR пропускаются. Целые числа вне диапазона int передаются как double, исходного текста
+ * у чисел нет. Элемент, разрезанный границей кусков, копируется во внутренний буфер,
+ * остальные - разбираются прямо из куска.
+ */
+template <typename THandler>
+class binary_parser {
+public:
+    /**
+     * @brief Конструирует парсер
+     * @param handler обработчик разобранных значений
+     * @param format формат данных
+     * @warning время жизни парсера не должно превышать время жизни обработчика
+     */
+    binary_parser(THandler& handler, binary_format format);
+
+    /**
+     * @brief Ограничивает размер строки, см. push_parser::set_max_token_size
+     * @param size предельный размер в байтах
+     */
+    void set_max_token_size(size_t size) noexcept;
+
+    /**
+     * @brief Разбирает очередной кусок данных
+     * @param chunk кусок данных произвольной длины
+     * @return false если обнаружена ошибка
+     */
+    bool feed(std::string_view chunk);
+
+    /**
+     * @brief Сообщает парсеру, что данные закончились
+     * @return false если документ неполон или ранее была обнаружена ошибка
+     */
+    bool finish();
+
+    /**
+     * @brief Была ли обнаружена ошибка?
+     */
+    bool failed() const noexcept;
+
+    /**
+     * @brief Описание первой ошибки
+     * @return описание ошибки, nullptr если ошибок не было
+     */
+    const char* message() const noexcept;
+
+    /**
+     * @brief Смещение элемента с первой ошибкой в байтах от начала данных
+     */
+    size_t offset() const noexcept;
+
+    /**
+     * @brief Бросает исключение, если была обнаружена ошибка
+     * @throw json_exception с описанием и смещением ошибки
+     */
+    void check() const;
+
+private:
+    /// Разобранный заголовок элемента
+    struct token {
+        enum class kind : uint8_t {
+            Null,
+            Integer,
+            Double,
+            String,
+            Array,
+            Map,
+            /// тег CBOR, относящийся к следующему элементу
+            Tag,
+            /// конец контейнера неопределённой длины (CBOR)
+            Break,
+            Unsupported
+        };
+        kind type = kind::Null;
+        bool indefinite = false;
+        int64_t integer = 0;
+        double number = 0;
+        /// длина строки или количество элементов контейнера
+        uint64_t length = 0;
+        /// описание неподдерживаемого типа
+        const char* error = nullptr;
+    };
+
+    /// Открытый контейнер
+    struct frame {
+        bool isMap;
+        bool indefinite;
+        /// ожидается ключ словаря
+        bool expectKey;
+        /// сколько значений осталось; у словаря - пар
+        uint64_t remaining;
+    };
+
+    /**
+     * @brief Размер заголовка элемента по его первому байту
+     */
+    size_t headerSize(unsigned char first) const noexcept;
+
+    /**
+     * @brief Разбирает заголовок элемента
+     * @param data заголовок целиком
+     * @param tok разобранный заголовок
+     */
+    void readHeader(const unsigned char* data, token& tok) const noexcept;
+
+    /**
+     * @brief Сколько байтов нужно для элемента, начинающегося с data
+     * @param data начало элемента
+     * @param size количество доступных байтов, не меньше 1
+     * @return размер элемента или, если недоступен весь заголовок, размер заголовка
+     */
+    uint64_t required(const unsigned char* data, size_t size) const noexcept;
+
+    /**
+     * @brief Разбирает полный элемент
+     * @param data элемент целиком
+     * @return false если обнаружена ошибка
+     */
+    bool step(const unsigned char* data);
+
+    /**
+     * @brief Учитывает завершённое значение в открытых контейнерах, закрывая заполненные
+     * @return false если обработчик отверг закрытие контейнера
+     */
+    bool valueDone();
+
+    /**
+     * @brief Закрывает контейнер на вершине стека
+     */
+    bool closeContainer();
+
+    bool fail(const char* message, size_t offset);
+    bool accept(const char* message);
+
+private:
+    THandler& m_handler;
+    binary_format m_format;
+    size_t m_maxToken = SIZE_MAX;
+    std::vector<frame> m_stack;
+    bool m_done = false;
+    /// начало элемента, разрезанного границей кусков
+    std::string m_pending;
+
+    size_t m_consumed = 0;
+    size_t m_itemStart = 0;
+
+    const char* m_error = nullptr;
+    size_t m_errorOffset = 0;
+};
+
+template <typename THandler>
+binary_parser<THandler>::binary_parser(THandler& handler, binary_format format)
+    : m_handler(handler)
+    , m_format(format)
+{
+    m_stack.reserve(64);
+}
+
+template <typename THandler>
+inline void binary_parser<THandler>::set_max_token_size(size_t size) noexcept
+{
+    m_maxToken = size;
+}
+
+template <typename THandler>
+bool binary_parser<THandler>::feed(std::string_view chunk)
+{
+    auto data = reinterpret_cast<const unsigned char*>(chunk.data());
+    const size_t n = chunk.size();
+    size_t i = 0;
+
+    // Дописываем элемент, начатый в предыдущем куске: сначала заголовок, затем содержимое
+    while (!m_error && !m_pending.empty() && i < n) {
+        auto pending = reinterpret_cast<const unsigned char*>(m_pending.data());
+        auto need = required(pending, m_pending.size());
+        if (need - headerSize(pending[0]) > m_maxToken)
+            return fail("value is too long", m_consumed);
+        auto take = static_cast<size_t>(std::min<uint64_t>(need - m_pending.size(), n - i));
+        m_pending.append(chunk.data() + i, take);
+        i += take;
+        pending = reinterpret_cast<const unsigned char*>(m_pending.data());
+        if (required(pending, m_pending.size()) > m_pending.size())
+            continue;
+        step(pending);
+        m_consumed += m_pending.size();
+        m_pending.clear();
+    }
+
+    while (!m_error && i < n) {
+        auto need = required(data + i, n - i);
+        if (need > n - i) {
+            // Строка длиннее предела не копируется в буфер целиком
+            if (need - headerSize(data[i]) > m_maxToken)
+                return fail("value is too long", m_consumed);
+            m_pending.assign(chunk.data() + i, n - i);
+            break;
+        }
+        step(data + i);
+        m_consumed += static_cast<size_t>(need);
+        i += static_cast<size_t>(need);
+    }
+    return !m_error;
+}
+
+template <typename THandler>
+bool binary_parser<THandler>::finish()
+{
+    if (m_error)
+        return false;
+    if (!m_done || !m_pending.empty())
+        return fail("unexpected end of document", m_consumed);
+    return true;
+}
+
+template <typename THandler>
+inline bool binary_parser<THandler>::failed() const noexcept
+{
+    return m_error != nullptr;
+}
+
+template <typename THandler>
+inline const char* binary_parser<THandler>::message() const noexcept
+{
+    return m_error;
+}
+
+template <typename THandler>
+inline size_t binary_parser<THandler>::offset() const noexcept
+{
+    return m_errorOffset;
+}
+
+template <typename THandler>
+void binary_parser<THandler>::check() const
+{
+    if (m_error)
+        throw json_exception("At offset " + std::to_string(m_errorOffset) + ": " + m_error);
+}
+
+template <typename THandler>
+size_t binary_parser<THandler>::headerSize(unsigned char first) const noexcept
+{
+    if (m_format == binary_format::Cbor) {
+        auto info = first & 0x1F;
+        if (info < 24 || info > 27)
+            return 1;
+        return 1 + (size_t(1) << (info - 24));
+    }
+
+    switch (first) {
+    case 0xC4: case 0xCC: case 0xD0: case 0xD9:
+        return 2;
+    case 0xC5: case 0xC7: case 0xCD: case 0xD1: case 0xDA: case 0xDC: case 0xDE: case 0xD4:
+        return 3;
+    case 0xC8:
+        return 4;
+    case 0xC6: case 0xCA: case 0xCE: case 0xD2: case 0xDB: case 0xDD: case 0xDF: case 0xD5:
+        return 5;
+    case 0xC9:
+        return 6;
+    case 0xCB: case 0xCF: case 0xD3: case 0xD6:
+        return 9;
+    case 0xD7:
+        return 10;
+    case 0xD8:
+        return 18;
+    default:
+        return 1;
+    }
+}
+
+template <typename THandler>
+void binary_parser<THandler>::readHeader(const unsigned char* data, token& tok) const noexcept
+{
+    using kind = typename token::kind;
+    auto first = data[0];
+
+    if (m_format == binary_format::Cbor) {
+        auto major = first >> 5;
+        auto info = first & 0x1F;
+        uint64_t arg = info;
+        if (info >= 24 && info <= 27)
+            arg = detail::readBigEndian(data + 1, size_t(1) << (info - 24));
+        else if (info >= 28 && info < 31) {
+            tok.type = kind::Unsupported;
+            tok.error = "reserved byte";
+            return;
+        }
+        const bool indefinite = (info == 31);
+        switch (major) {
+        case 0:
+        case 1:
+            if (indefinite) {
+                tok.type = kind::Unsupported;
+                tok.error = "reserved byte";
+            } else if (arg <= static_cast<uint64_t>(INT64_MAX)) {
+                tok.type = kind::Integer;
+                tok.integer = (major == 0) ? static_cast<int64_t>(arg) : -1 - static_cast<int64_t>(arg);
+            } else {
+                tok.type = kind::Double;
+                tok.number = (major == 0) ? static_cast<double>(arg) : -1.0 - static_cast<double>(arg);
+            }
+            return;
+        case 2:
+            tok.type = kind::Unsupported;
+            tok.error = "binary data is not supported";
+            return;
+        case 3:
+            tok.type = indefinite ? kind::Unsupported : kind::String;
+            tok.error = "indefinite-length strings are not supported";
+            tok.length = arg;
+            return;
+        case 4:
+        case 5:
+            tok.type = (major == 4) ? kind::Array : kind::Map;
+            tok.indefinite = indefinite;
+            tok.length = arg;
+            return;
+        case 6:
+            tok.type = indefinite ? kind::Unsupported : kind::Tag;
+            tok.error = "reserved byte";
+            return;
+        default:
+            break;
+        }
+
+        // Простые значения и числа с плавающей точкой
+        switch (info) {
+        case 20:
+        case 21:
+            tok.type = kind::Unsupported;
+            tok.error = "booleans are not supported";
+            return;
+        case 22:
+        case 23:
+            tok.type = kind::Null;
+            return;
+        case 25:
+            tok.type = kind::Double;
+            tok.number = detail::halfToDouble(static_cast<uint16_t>(arg));
+            return;
+        case 26:
+            tok.type = kind::Double;
+            tok.number = detail::floatFromBits(static_cast<uint32_t>(arg));
+            return;
+        case 27:
+            tok.type = kind::Double;
+            tok.number = detail::doubleFromBits(arg);
+            return;
+        case 31:
+            tok.type = kind::Break;
+            return;
+        default:
+            tok.type = kind::Unsupported;
+            tok.error = "simple values are not supported";
+            return;
+        }
+    }
+
+    if (first <= 0x7F || first >= 0xE0) {
+        tok.type = kind::Integer;
+        tok.integer = static_cast<int8_t>(first);
+        return;
+    }
+    if (first <= 0x9F) {
+        tok.type = (first <= 0x8F) ? kind::Map : kind::Array;
+        tok.length = first & 0x0F;
+        return;
+    }
+    if (first <= 0xBF) {
+        tok.type = kind::String;
+        tok.length = first & 0x1F;
+        return;
+    }
+
+    switch (first) {
+    case 0xC0:
+        tok.type = kind::Null;
+        return;
+    case 0xC2:
+    case 0xC3:
+        tok.type = kind::Unsupported;
+        tok.error = "booleans are not supported";
+        return;
+    case 0xCA:
+        tok.type = kind::Double;
+        tok.number = detail::floatFromBits(static_cast<uint32_t>(detail::readBigEndian(data + 1, 4)));
+        return;
+    case 0xCB:
+        tok.type = kind::Double;
+        tok.number = detail::doubleFromBits(detail::readBigEndian(data + 1, 8));
+        return;
+    case 0xCC:
+    case 0xCD:
+    case 0xCE:
+    case 0xCF: {
+        auto value = detail::readBigEndian(data + 1, size_t(1) << (first - 0xCC));
+        if (value <= static_cast<uint64_t>(INT64_MAX)) {
+            tok.type = kind::Integer;
+            tok.integer = static_cast<int64_t>(value);
+        } else {
+            tok.type = kind::Double;
+            tok.number = static_cast<double>(value);
+        }
+        return;
+    }
+    case 0xD0:
+        tok.type = kind::Integer;
+        tok.integer = static_cast<int8_t>(data[1]);
+        return;
+    case 0xD1:
+        tok.type = kind::Integer;
+        tok.integer = static_cast<int16_t>(detail::readBigEndian(data + 1, 2));
+        return;
+    case 0xD2:
+        tok.type = kind::Integer;
+        tok.integer = static_cast<int32_t>(detail::readBigEndian(data + 1, 4));
+        return;
+    case 0xD3:
+        tok.type = kind::Integer;
+        tok.integer = static_cast<int64_t>(detail::readBigEndian(data + 1, 8));
+        return;
+    case 0xD9:
+    case 0xDA:
+    case 0xDB:
+        tok.type = kind::String;
+        tok.length = detail::readBigEndian(data + 1, size_t(1) << (first - 0xD9));
+        return;
+    case 0xDC:
+    case 0xDD:
+        tok.type = kind::Array;
+        tok.length = detail::readBigEndian(data + 1, (first == 0xDC) ? 2 : 4);
+        return;
+    case 0xDE:
+    case 0xDF:
+        tok.type = kind::Map;
+        tok.length = detail::readBigEndian(data + 1, (first == 0xDE) ? 2 : 4);
+        return;
+    case 0xC1:
+        tok.type = kind::Unsupported;
+        tok.error = "reserved byte";
+        return;
+    case 0xC4:
+    case 0xC5:
+    case 0xC6:
+        tok.type = kind::Unsupported;
+        tok.error = "binary data is not supported";
+        return;
+    default:
+        tok.type = kind::Unsupported;
+        tok.error = "extension types are not supported";
+        return;
+    }
+}
+
+template <typename THandler>
+uint64_t binary_parser<THandler>::required(const unsigned char* data, size_t size) const noexcept
+{
+    auto header = headerSize(data[0]);
+    if (size < header)
+        return header;
+    token tok;
+    readHeader(data, tok);
+    // Содержимое после заголовка есть только у строк; длина расширений MessagePack
+    // не важна, так как они отвергаются
+    if (tok.type != token::kind::String)
+        return header;
+    // Длина из заголовка не проверена, переполнение считается бесконечно длинной строкой
+    return (tok.length > UINT64_MAX - header) ? UINT64_MAX : header + tok.length;
+}
+
+template <typename THandler>
+bool binary_parser<THandler>::step(const unsigned char* data)
+{
+    using kind = typename token::kind;
+    m_itemStart = m_consumed;
+    if (m_done)
+        return fail("unexpected data after document", m_itemStart);
+
+    token tok;
+    readHeader(data, tok);
+    if (tok.type == kind::Tag)
+        return true;
+    if (tok.type == kind::Unsupported)
+        return fail(tok.error, m_itemStart);
+
+    auto header = headerSize(data[0]);
+    auto text = std::string_view(reinterpret_cast<const char*>(data) + header, static_cast<size_t>(tok.length));
+    if (tok.type == kind::String) {
+        auto invalid = detail::validateUtf8(text.data(), text.size());
+        if (invalid != text.size())
+            return fail("invalid UTF-8", m_itemStart + header + invalid);
+    }
+
+    if (!m_stack.empty() && m_stack.back().isMap && m_stack.back().expectKey) {
+        if (tok.type == kind::Break && m_stack.back().indefinite)
+            return closeContainer() && valueDone();
+        if (tok.type != kind::String)
+            return fail("map key must be a string", m_itemStart);
+        m_stack.back().expectKey = false;
+        return accept(m_handler.onKey(text));
+    }
+
+    switch (tok.type) {
+    case kind::Null:
+        return accept(m_handler.onNull()) && valueDone();
+    case kind::Integer:
+        if (tok.integer >= std::numeric_limits<int>::min() && tok.integer <= std::numeric_limits<int>::max())
+            return accept(m_handler.onInteger(static_cast<int>(tok.integer), std::string_view())) && valueDone();
+        return accept(m_handler.onDouble(static_cast<double>(tok.integer), std::string_view())) && valueDone();
+    case kind::Double:
+        return accept(m_handler.onDouble(tok.number, std::string_view())) && valueDone();
+    case kind::String:
+        return accept(m_handler.onString(text)) && valueDone();
+    case kind::Array:
+    case kind::Map: {
+        const bool isMap = (tok.type == kind::Map);
+        if (!accept(isMap ? m_handler.onStartObject() : m_handler.onStartArray()))
+            return false;
+        m_stack.push_back({ isMap, tok.indefinite, isMap, tok.length });
+        if (!tok.indefinite && tok.length == 0)
+            return closeContainer() && valueDone();
+        return true;
+    }
+    case kind::Break:
+        if (m_stack.empty() || !m_stack.back().indefinite || m_stack.back().isMap)
+            return fail("unexpected break", m_itemStart);
+        return closeContainer() && valueDone();
+    default:
+        return fail("unexpected item", m_itemStart);
+    }
+}
+
+template <typename THandler>
+bool binary_parser<THandler>::valueDone()
+{
+    while (!m_stack.empty()) {
+        auto& top = m_stack.back();
+        if (top.isMap)
+            top.expectKey = true;
+        if (top.indefinite || --top.remaining > 0)
+            return true;
+        if (!closeContainer())
+            return false;
+    }
+    m_done = true;
+    return true;
+}
+
+template <typename THandler>
+bool binary_parser<THandler>::closeContainer()
+{
+    const bool isMap = m_stack.back().isMap;
+    m_stack.pop_back();
+    return accept(isMap ? m_handler.onEndObject() : m_handler.onEndArray());
+}
+
+template <typename THandler>
+bool binary_parser<THandler>::fail(const char* message, size_t offset)
+{
+    if (!m_error) {
+        m_error = message;
+        m_errorOffset = offset;
+    }
+    return false;
+}
+
+template <typename THandler>
+inline bool binary_parser<THandler>::accept(const char* message)
+{
+    return !message || fail(message, m_itemStart);
+}
+} // end of namespace json
+
+#endif // BINARY_PARSER_H
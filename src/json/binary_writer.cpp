@@ -0,0 +1,213 @@
+#include "binary_writer.h"
+#include "value.h"
+#include <cstring>
+
+namespace {
+/// Старшие типы CBOR
+enum cbor_major : uint8_t {
+    UNSIGNED = 0,
+    NEGATIVE = 1,
+    TEXT = 3,
+    ARRAY = 4,
+    MAP = 5
+};
+} // end of anonymous namespace
+
+json::binary_writer::binary_writer(binary_format format)
+    : m_format(format)
+{
+}
+
+json::binary_writer::binary_writer(binary_format format, sink_type sink)
+    : m_format(format)
+    , m_sink(std::move(sink))
+{
+    m_buffer.reserve(CHUNK_SIZE + CHUNK_SIZE / 4);
+}
+
+void json::binary_writer::start_object(size_t size)
+{
+    if (m_format == binary_format::Cbor)
+        cborHeader(MAP, size);
+    else
+        msgpackLength(0x80, 15, 0xDE, size);
+    written();
+}
+
+void json::binary_writer::start_array(size_t size)
+{
+    if (m_format == binary_format::Cbor)
+        cborHeader(ARRAY, size);
+    else
+        msgpackLength(0x90, 15, 0xDC, size);
+    written();
+}
+
+void json::binary_writer::write_null()
+{
+    m_buffer += (m_format == binary_format::Cbor) ? '\xF6' : '\xC0';
+    written();
+}
+
+void json::binary_writer::write_integer(int64_t value)
+{
+    if (m_format == binary_format::Cbor) {
+        if (value >= 0)
+            cborHeader(UNSIGNED, static_cast<uint64_t>(value));
+        else
+            cborHeader(NEGATIVE, static_cast<uint64_t>(-1 - value));
+    } else if (value >= -32 && value <= 127) {
+        // positive и negative fixint
+        m_buffer += static_cast<char>(value);
+    } else if (value >= 0) {
+        auto unsignedValue = static_cast<uint64_t>(value);
+        if (unsignedValue <= UINT8_MAX) {
+            m_buffer += '\xCC';
+            putBigEndian(unsignedValue, 1);
+        } else if (unsignedValue <= UINT16_MAX) {
+            m_buffer += '\xCD';
+            putBigEndian(unsignedValue, 2);
+        } else if (unsignedValue <= UINT32_MAX) {
+            m_buffer += '\xCE';
+            putBigEndian(unsignedValue, 4);
+        } else {
+            m_buffer += '\xCF';
+            putBigEndian(unsignedValue, 8);
+        }
+    } else {
+        auto bits = static_cast<uint64_t>(value);
+        if (value >= INT8_MIN) {
+            m_buffer += '\xD0';
+            putBigEndian(bits, 1);
+        } else if (value >= INT16_MIN) {
+            m_buffer += '\xD1';
+            putBigEndian(bits, 2);
+        } else if (value >= INT32_MIN) {
+            m_buffer += '\xD2';
+            putBigEndian(bits, 4);
+        } else {
+            m_buffer += '\xD3';
+            putBigEndian(bits, 8);
+        }
+    }
+    written();
+}
+
+void json::binary_writer::write_double(double value)
+{
+    // NaN не равен сам себе, но представим во float так же точно
+    auto narrow = static_cast<float>(value);
+    if (static_cast<double>(narrow) == value || value != value) {
+        uint32_t bits;
+        std::memcpy(&bits, &narrow, sizeof(bits));
+        m_buffer += (m_format == binary_format::Cbor) ? '\xFA' : '\xCA';
+        putBigEndian(bits, 4);
+    } else {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        m_buffer += (m_format == binary_format::Cbor) ? '\xFB' : '\xCB';
+        putBigEndian(bits, 8);
+    }
+    written();
+}
+
+void json::binary_writer::write_string(std::string_view value)
+{
+    if (m_format == binary_format::Cbor)
+        cborHeader(TEXT, value.size());
+    else if (value.size() < 32 || value.size() > UINT8_MAX)
+        msgpackLength(0xA0, 31, 0xDA, value.size());
+    else {
+        // У строк, в отличие от контейнеров, есть форма с длиной в 1 байт
+        m_buffer += '\xD9';
+        putBigEndian(value.size(), 1);
+    }
+    m_buffer.append(value.data(), value.size());
+    written();
+}
+
+void json::binary_writer::write(const json::value& value)
+{
+    switch (value.type()) {
+    case json::value::Null:
+        write_null();
+        break;
+    case json::value::Number:
+        if (value.is_integer())
+            write_integer(value.as_integer());
+        else
+            write_double(value.as_double());
+        break;
+    case json::value::String:
+        write_string(value.as_string());
+        break;
+    case json::value::Array: {
+        const auto& elements = value.as_array();
+        start_array(elements.size());
+        for (const auto& element : elements)
+            write(element);
+        break;
+    }
+    case json::value::Object: {
+        const auto& fields = value.as_object();
+        start_object(fields.size());
+        for (const auto& field : fields) {
+            write_string(field.first);
+            write(field.second);
+        }
+        break;
+    }
+    }
+}
+
+void json::binary_writer::flush()
+{
+    if (m_sink && !m_buffer.empty()) {
+        m_sink(std::move(m_buffer));
+        m_buffer = std::string();
+        m_buffer.reserve(CHUNK_SIZE + CHUNK_SIZE / 4);
+    }
+}
+
+void json::binary_writer::cborHeader(uint8_t major, uint64_t argument)
+{
+    auto type = static_cast<char>(major << 5);
+    if (argument < 24) {
+        m_buffer += static_cast<char>(type | static_cast<char>(argument));
+    } else if (argument <= UINT8_MAX) {
+        m_buffer += static_cast<char>(type | 24);
+        putBigEndian(argument, 1);
+    } else if (argument <= UINT16_MAX) {
+        m_buffer += static_cast<char>(type | 25);
+        putBigEndian(argument, 2);
+    } else if (argument <= UINT32_MAX) {
+        m_buffer += static_cast<char>(type | 26);
+        putBigEndian(argument, 4);
+    } else {
+        m_buffer += static_cast<char>(type | 27);
+        putBigEndian(argument, 8);
+    }
+}
+
+void json::binary_writer::msgpackLength(uint8_t fixed, size_t fixedLimit, uint8_t wide, size_t size)
+{
+    if (size <= fixedLimit) {
+        m_buffer += static_cast<char>(fixed | size);
+    } else if (size <= UINT16_MAX) {
+        m_buffer += static_cast<char>(wide);
+        putBigEndian(size, 2);
+    } else {
+        m_buffer += static_cast<char>(wide + 1);
+        putBigEndian(size, 4);
+    }
+}
+
+void json::binary_writer::putBigEndian(uint64_t value, size_t size)
+{
+    char bytes[8];
+    for (size_t i = size; i-- > 0;) {
+        bytes[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+    }
+    m_buffer.append(bytes, size);
+}
@@ -0,0 +1,129 @@
+#ifndef BINARY_WRITER_H
+#define BINARY_WRITER_H
+
+#include "binary_format.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace json {
+class value;
+
+/**
+ * @class binary_writer
+ * @brief Потоковый кодировщик MessagePack и CBOR.
+ * @remarks Каждое значение записывается в наименьшем представлении формата; double записывается
+ * как float, если это не теряет точности. Контейнеры записываются с известным заранее количеством
+ * элементов, поэтому закрывать их не нужно: контейнер заканчивается вместе с последним элементом.
+ * Результат копится в буфере и, если задан приёмник, передаётся ему блоками около CHUNK_SIZE.
+ */
+class binary_writer {
+public:
+    /// Приёмник готовых блоков
+    typedef std::function<void(std::string)> sink_type;
+
+    /// Размер блока, по достижении которого он передаётся в приёмник
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+    /**
+     * @brief Конструирует кодировщик, накапливающий результат целиком (см. take)
+     * @param format формат результата
+     */
+    explicit binary_writer(binary_format format);
+
+    /**
+     * @brief Конструирует кодировщик, отдающий результат блоками
+     * @param format формат результата
+     * @param sink приёмник блоков
+     * @remarks После записи нужно вызвать flush, чтобы передать в приёмник последний блок
+     */
+    binary_writer(binary_format format, sink_type sink);
+
+    /**
+     * @brief Начинает объект
+     * @param size количество пар ключ-значение, которые будут записаны следом
+     */
+    void start_object(size_t size);
+
+    /**
+     * @brief Начинает массив
+     * @param size количество элементов, которые будут записаны следом
+     */
+    void start_array(size_t size);
+
+    void write_null();
+    void write_integer(int64_t value);
+    void write_double(double value);
+
+    /**
+     * @brief Записывает строку; ключ объекта записывается так же
+     * @param value строка в UTF-8
+     */
+    void write_string(std::string_view value);
+
+    /**
+     * @brief Записывает JSON-значение целиком
+     * @remarks Исходный текст чисел не записывается
+     * @param value JSON-значение
+     */
+    void write(const json::value& value);
+
+    /**
+     * @brief Передаёт накопленный блок в приёмник
+     */
+    void flush();
+
+    /**
+     * @brief Забирает накопленный результат
+     */
+    std::string take();
+
+private:
+    /**
+     * @brief Записывает заголовок элемента CBOR
+     * @param major старший тип
+     * @param argument аргумент заголовка: значение, длина или количество элементов
+     */
+    void cborHeader(uint8_t major, uint64_t argument);
+
+    /**
+     * @brief Записывает префикс MessagePack с длиной
+     * @param fixed префикс короткой формы, в младшие биты которого помещается длина
+     * @param fixedLimit наибольшая длина короткой формы
+     * @param wide префикс формы с длиной в 2 байта; префикс формы с 4 байтами следует за ним
+     * @param size длина
+     */
+    void msgpackLength(uint8_t fixed, size_t fixedLimit, uint8_t wide, size_t size);
+
+    /**
+     * @brief Дописывает число в сетевом порядке байтов
+     * @param value число
+     * @param size количество младших байтов числа
+     */
+    void putBigEndian(uint64_t value, size_t size);
+
+    /**
+     * @brief Передаёт блок в приёмник, если он достаточно вырос
+     */
+    void written();
+
+private:
+    binary_format m_format;
+    sink_type m_sink;
+    std::string m_buffer;
+};
+
+inline std::string binary_writer::take()
+{
+    return std::move(m_buffer);
+}
+
+inline void binary_writer::written()
+{
+    if (m_sink && m_buffer.size() >= CHUNK_SIZE)
+        flush();
+}
+} // end of namespace json
+
+#endif // BINARY_WRITER_H
@@ -0,0 +1,222 @@
+#include "escape.h"
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+int hexDigit(char ch) noexcept
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief Читает четыре шестнадцатеричные цифры
+ * @return кодовая единица UTF-16 или -1
+ */
+long readHex4(std::string_view text, size_t pos) noexcept
+{
+    if (pos + 4 > text.size())
+        return -1;
+    long ret = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        auto digit = hexDigit(text[pos + i]);
+        if (digit < 0)
+            return -1;
+        ret = ret * 16 + digit;
+    }
+    return ret;
+}
+
+void appendUtf8(uint32_t cp, std::string& output)
+{
+    if (cp < 0x80) {
+        output.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        output.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        output.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        output.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        output.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        output.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        output.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        output.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        output.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        output.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+#if defined(__SSE2__)
+inline size_t firstBit(unsigned mask) noexcept
+{
+    return static_cast<size_t>(__builtin_ctz(mask));
+}
+#endif
+} // end of anonymous namespace
+
+size_t detail::scanString(const char* text, size_t size) noexcept
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const auto quote = _mm_set1_epi8('"');
+    const auto backslash = _mm_set1_epi8('\\');
+    const auto control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= size; i += 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        // Беззнаковое сравнение x <= 0x1F: max(x, 0x1F) == 0x1F
+        auto isControl = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control);
+        auto hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)), isControl);
+        if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits)))
+            return i + firstBit(mask);
+    }
+#endif
+    for (; i < size; ++i) {
+        auto ch = static_cast<unsigned char>(text[i]);
+        if (ch == '"' || ch == '\\' || ch < 0x20)
+            return i;
+    }
+    return size;
+}
+
+size_t detail::scanEscape(const char* text, size_t size) noexcept
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const auto quote = _mm_set1_epi8('"');
+    const auto backslash = _mm_set1_epi8('\\');
+    const auto control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= size; i += 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        // Беззнаковое сравнение x <= 0x1F: max(x, 0x1F) == 0x1F
+        auto isControl = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control);
+        auto hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)), isControl);
+        if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits)))
+            return i + firstBit(mask);
+    }
+#endif
+    for (; i < size; ++i) {
+        auto ch = static_cast<unsigned char>(text[i]);
+        if (ch == '"' || ch == '\\' || ch < 0x20)
+            return i;
+    }
+    return size;
+}
+
+const char* detail::unescape(std::string_view text, std::string& output, size_t& errorPos)
+{
+    output.clear();
+    output.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+        auto next = text.find('\\', i);
+        if (next == std::string_view::npos)
+            next = text.size();
+        output.append(text.data() + i, next - i);
+        i = next;
+        if (i == text.size())
+            break;
+
+        errorPos = i;
+        if (i + 1 == text.size())
+            return "invalid escape sequence";
+        auto ch = text[i + 1];
+        i += 2;
+        switch (ch) {
+        case '"':
+        case '\\':
+        case '/':
+            output.push_back(ch);
+            break;
+        case 'b':
+            output.push_back('\b');
+            break;
+        case 'f':
+            output.push_back('\f');
+            break;
+        case 'n':
+            output.push_back('\n');
+            break;
+        case 'r':
+            output.push_back('\r');
+            break;
+        case 't':
+            output.push_back('\t');
+            break;
+        case 'u': {
+            auto unit = readHex4(text, i);
+            if (unit < 0)
+                return "invalid unicode escape";
+            i += 4;
+            auto cp = static_cast<uint32_t>(unit);
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                // Старшая половина суррогатной пары должна сопровождаться младшей
+                auto low = (i + 1 < text.size() && text[i] == '\\' && text[i + 1] == 'u') ? readHex4(text, i + 2) : -1;
+                if (low < 0xDC00 || low > 0xDFFF)
+                    return "invalid unicode escape";
+                i += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (static_cast<uint32_t>(low) - 0xDC00);
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                return "invalid unicode escape";
+            }
+            appendUtf8(cp, output);
+            break;
+        }
+        default:
+            return "invalid escape sequence";
+        }
+    }
+    return nullptr;
+}
+
+void detail::escape(std::string_view text, std::string& output)
+{
+    static const char HEX[] = "0123456789abcdef";
+
+    output.push_back('"');
+    size_t i = 0;
+    while (i < text.size()) {
+        auto run = scanEscape(text.data() + i, text.size() - i);
+        output.append(text.data() + i, run);
+        i += run;
+        if (i == text.size())
+            break;
+
+        auto ch = static_cast<unsigned char>(text[i++]);
+        output.push_back('\\');
+        switch (ch) {
+        case '"':
+        case '\\':
+            output.push_back(static_cast<char>(ch));
+            break;
+        case '\b':
+            output.push_back('b');
+            break;
+        case '\f':
+            output.push_back('f');
+            break;
+        case '\n':
+            output.push_back('n');
+            break;
+        case '\r':
+            output.push_back('r');
+            break;
+        case '\t':
+            output.push_back('t');
+            break;
+        default:
+            output.append("u00");
+            output.push_back(HEX[ch >> 4]);
+            output.push_back(HEX[ch & 0xF]);
+            break;
+        }
+    }
+    output.push_back('"');
+}
@@ -0,0 +1,54 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace detail {
+
+/**
+ * @brief Ищет в тексте строки JSON символ, который завершает простой участок строки:
+ * кавычку, обратную косую черту или управляющий символ (< 0x20), который RFC 8259
+ * запрещает в строке без экранирования
+ * @remarks Текст проверяется блоками по 16 байт инструкциями SSE2, остаток - побайтно
+ * @param text текст
+ * @param size размер текста
+ * @return смещение найденного символа или size, если его нет
+ */
+size_t scanString(const char* text, size_t size) noexcept;
+
+/**
+ * @brief Ищет символ, который при записи строки JSON нужно экранировать:
+ * кавычку, обратную косую черту или управляющий символ (< 0x20)
+ * @remarks Текст проверяется блоками по 16 байт инструкциями SSE2, остаток - побайтно
+ * @param text текст
+ * @param size размер текста
+ * @return смещение найденного символа или size, если его нет
+ */
+size_t scanEscape(const char* text, size_t size) noexcept;
+
+/**
+ * @brief Раскрывает escape-последовательности строки JSON (RFC 8259, раздел 7)
+ * @remarks Поддерживаются \" \\ \/ \b \f \n \r \t и \uXXXX, включая суррогатные пары;
+ * кодовые точки записываются в UTF-8. Участки без escape-последовательностей копируются целиком
+ * @param text содержимое строки без кавычек
+ * @param output буфер для результата; прежнее содержимое заменяется
+ * @param errorPos смещение ошибочной последовательности в text
+ * @return nullptr если успешно, иначе описание ошибки
+ */
+const char* unescape(std::string_view text, std::string& output, size_t& errorPos);
+
+/**
+ * @brief Дописывает строку в кавычках, экранируя её по правилам JSON
+ * @remarks Кавычка и обратная косая черта экранируются обратной косой чертой, управляющие
+ * символы - короткими последовательностями или \u00XX. Прочие байты, в том числе UTF-8,
+ * копируются как есть, участки без экранируемых символов - целиком
+ * @param text строка
+ * @param output строка, в конец которой дописывается результат
+ */
+void escape(std::string_view text, std::string& output);
+
+} // end of namespace detail
+
+#endif // ESCAPE_H
@@ -1,9 +1,10 @@
 #include "generator.h"
+#include "escape.h"
+#include "trace.h"
 #include "json/value.h"
 #include <boost/assert.hpp>
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/range/adaptors.hpp>
-#include <iomanip>
 
 using namespace detail;
 
@@ -12,9 +13,25 @@ generator::generator(const json::value& value)
     setValueRef(value, 0);
 }
 
+generator::generator(const json::value& value, sink_type sink)
+    : m_sink(std::move(sink))
+{
+    setValueRef(value, 0);
+}
+
+void generator::flush()
+{
+    if (!m_sink)
+        return;
+    auto chunk = m_ss.str();
+    m_ss.str(std::string());
+    m_sink(std::move(chunk));
+}
+
 void generator::generate()
 {
-    m_ss << std::string(m_level, ' ');
+    TRACE_SCOPE_IF(m_level == 0, "generator::generate");
+    writeIndent();
     generate2nd();
 }
 
@@ -54,12 +71,15 @@ void generator::generateNull()
 
 void generator::generateNumber()
 {
-    if (m_value->is_double()) {
+    // Сохранённый исходный текст числа выводится как есть, без разбора и округления
+    const auto& text = m_value->number_text();
+    if (!text.empty())
+        m_ss << text;
+    else if (m_value->is_double()) {
         auto d = m_value->as_double();
         if (boost::math::isnan(d)) {
             m_ss << "NaN";
-        }
-        if (boost::math::isinf(d)) {
+        } else if (boost::math::isinf(d)) {
             if (d < 0.0) {
                 m_ss << '-';
             }
@@ -76,7 +96,17 @@ void generator::generateNumber()
 
 void generator::generateString()
 {
-    m_ss << std::quoted(m_value->as_string());
+    const auto& str = m_value->as_string();
+    // Строка без экранируемых символов пишется как есть, без промежуточного буфера
+    if (scanEscape(str.data(), str.size()) == str.size()) {
+        m_ss << '"';
+        m_ss.write(str.data(), static_cast<std::streamsize>(str.size()));
+        m_ss << '"';
+        return;
+    }
+    m_escaped.clear();
+    escape(str, m_escaped);
+    m_ss.write(m_escaped.data(), static_cast<std::streamsize>(m_escaped.size()));
 }
 
 void generator::generateArray()
@@ -87,14 +117,17 @@ void generator::generateArray()
     auto prevLevel = m_level;
 
     const auto& array = m_value->as_array();
+    TRACE_SCOPE("generator::generateArray", "elements", static_cast<long long>(array.size()));
     for (const auto& value : array | boost::adaptors::indexed(0)) {
         setValueRef(value.value(), prevLevel + 1);
         generate();
         m_ss << ((value.index() == array.size() - 1) ? "" : ",") << std::endl;
+        flushChunk();
     }
 
     setValueRef(*prevValue, prevLevel);
-    m_ss << std::string(m_level, ' ') << ']';
+    writeIndent();
+    m_ss << ']';
 }
 
 void generator::generateObject()
@@ -118,8 +151,10 @@ void generator::generateObject()
         generate2nd();
 
         m_ss << ((memPair.index() == object.size() - 1) ? "" : ",") << std::endl;
+        flushChunk();
     }
 
     setValueRef(*prevValue, prevLevel);
-    m_ss << std::string(m_level, ' ') << '}';
+    writeIndent();
+    m_ss << '}';
 }
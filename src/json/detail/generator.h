@@ -1,6 +1,8 @@
 #ifndef GENERATOR_H
 #define GENERATOR_H
 
+#include <algorithm>
+#include <functional>
 #include <sstream>
 
 namespace json {
@@ -14,10 +16,21 @@ namespace detail {
  * @brief Генератор строк из JSON-значения
  */
 class generator {
+public:
+    /// Приёмник готовых блоков строки
+    typedef std::function<void(std::string)> sink_type;
+
+    /// Размер блока, по достижении которого он передаётся в приёмник
+    static constexpr std::streamoff CHUNK_SIZE = 1 << 20;
+
+private:
     std::stringstream m_ss;
 
     const json::value* m_value;
     unsigned m_level;
+    sink_type m_sink;
+    /// буфер для строк с экранируемыми символами
+    std::string m_escaped;
 
 public:
     /**
@@ -28,6 +41,16 @@ public:
      */
     generator(const json::value& value);
 
+    /**
+     * @brief Конструирует генератор, отдающий результат блоками по мере генерации
+     * @param value ссылка на JSON-значение
+     * @param sink приёмник блоков размером около CHUNK_SIZE
+     * @warning время жизни генератора не должно превышать
+     * время жизни значения, на которое ссылается value
+     * @remarks После generate нужно вызвать flush, чтобы передать в приёмник последний блок
+     */
+    generator(const json::value& value, sink_type sink);
+
     /**
      * @brief Выполняет рекурсивную генерации строки,
      * сохраняет результат во внутреннем состоянии объекта
@@ -40,6 +63,11 @@ public:
      */
     std::string string() const;
 
+    /**
+     * @brief Передаёт в приёмник всё, что ещё не было передано
+     */
+    void flush();
+
 private:
     /**
      * @brief Выполняет рекурсивную генерации строки,
@@ -83,6 +111,16 @@ private:
      * @param level глубина рекурсии
      */
     void setValueRef(const json::value& value, unsigned level);
+
+    /**
+     * @brief Передаёт накопленный текст в приёмник, если набран целый блок
+     */
+    void flushChunk();
+
+    /**
+     * @brief Пишет отступ текущего уровня без создания временной строки
+     */
+    void writeIndent();
 };
 
 inline std::string generator::string() const
@@ -95,6 +133,22 @@ inline void generator::setValueRef(const json::value& value, unsigned level)
     m_value = &value;
     m_level = level;
 }
+inline void generator::flushChunk()
+{
+    if (m_sink && m_ss.tellp() >= CHUNK_SIZE)
+        flush();
+}
+
+inline void generator::writeIndent()
+{
+    static constexpr char SPACES[] = "                                                                ";
+    constexpr unsigned BLOCK = sizeof(SPACES) - 1;
+    for (auto left = m_level; left > 0;) {
+        auto count = std::min(left, BLOCK);
+        m_ss.write(SPACES, count);
+        left -= count;
+    }
+}
 } // end of namespace detail
 
 #endif // GENERATOR_H
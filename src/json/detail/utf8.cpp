@@ -0,0 +1,326 @@
+#include "utf8.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8_HAS_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+#if defined(UTF8_HAS_SIMD)
+// Классы ошибок алгоритма Keiser и Lemire ("Validating UTF-8 In Less Than One Instruction Per Byte").
+// Пара соседних байтов раскладывается на старший и младший полубайты первого байта и старший
+// полубайт второго; каждый полубайт по таблице даёт набор ошибок, возможных при таком значении,
+// и пара некорректна, если все три набора пересекаются.
+constexpr uint8_t TOO_SHORT = 1 << 0; // 11______ 0_______, 11______ 11______
+constexpr uint8_t TOO_LONG = 1 << 1; // 0_______ 10______
+constexpr uint8_t OVERLONG_3 = 1 << 2; // 11100000 100_____
+constexpr uint8_t TOO_LARGE = 1 << 3; // 11110100 1001____, 11110100 101_____, 11110101+ 10______
+constexpr uint8_t SURROGATE = 1 << 4; // 11101101 101_____
+constexpr uint8_t OVERLONG_2 = 1 << 5; // 1100000_ 10______
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6; // 11110101+ 1000____
+constexpr uint8_t OVERLONG_4 = 1 << 6; // 11110000 1000____
+constexpr uint8_t TWO_CONTS = 1 << 7; // 10______ 10______
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+/// ошибки по старшему полубайту первого байта пары
+alignas(16) constexpr uint8_t BYTE_1_HIGH[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+/// ошибки по младшему полубайту первого байта пары
+alignas(16) constexpr uint8_t BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+/// ошибки по старшему полубайту второго байта пары
+alignas(16) constexpr uint8_t BYTE_2_HIGH[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+/// Наибольшие значения последних байтов блока, после которых последовательность не обрывается
+alignas(32) constexpr uint8_t MAX_TAIL[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF
+};
+
+/// Состояние векторной проверки между блоками по 16 байт
+struct ssse3_state {
+    /// предыдущий блок
+    __m128i prev;
+    /// ненулевой, если предыдущий блок оборвался посреди последовательности
+    __m128i prevIncomplete;
+    /// накопленные ошибки
+    __m128i error;
+};
+
+/// Состояние векторной проверки между блоками по 32 байта
+struct avx2_state {
+    __m256i prev;
+    __m256i prevIncomplete;
+    __m256i error;
+};
+
+__attribute__((target("ssse3"))) inline void checkSsse3(ssse3_state& state, __m128i input) noexcept
+{
+    // Блок из ASCII корректен, если перед ним не оборвалась последовательность
+    if (_mm_movemask_epi8(input) == 0) {
+        state.error = _mm_or_si128(state.error, state.prevIncomplete);
+        state.prevIncomplete = _mm_setzero_si128();
+        state.prev = input;
+        return;
+    }
+
+    const auto nibble = _mm_set1_epi8(0x0F);
+    auto prev1 = _mm_alignr_epi8(input, state.prev, 15);
+    auto special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH)),
+                          _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+            _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW)), _mm_and_si128(prev1, nibble))),
+        _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH)),
+            _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+    // Третий и четвёртый байты длинных последовательностей должны быть байтами продолжения
+    auto must23 = _mm_or_si128(
+        _mm_subs_epu8(_mm_alignr_epi8(input, state.prev, 14), _mm_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+        _mm_subs_epu8(_mm_alignr_epi8(input, state.prev, 13), _mm_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+    auto must23x80 = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+    state.error = _mm_or_si128(state.error, _mm_xor_si128(must23x80, special));
+    state.prevIncomplete = _mm_subs_epu8(input, _mm_load_si128(reinterpret_cast<const __m128i*>(MAX_TAIL + 16)));
+    state.prev = input;
+}
+
+__attribute__((target("ssse3"))) bool validateSsse3(const unsigned char* text, size_t size) noexcept
+{
+    ssse3_state state { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+        checkSsse3(state, _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)));
+    // Хвост дополняется нулями: ASCII не меняет результат, а оборванная последовательность даёт ошибку
+    if (i < size) {
+        alignas(16) unsigned char tail[16] = {};
+        std::memcpy(tail, text + i, size - i);
+        checkSsse3(state, _mm_load_si128(reinterpret_cast<const __m128i*>(tail)));
+    }
+    auto error = _mm_or_si128(state.error, state.prevIncomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+/// Таблица из 16 значений в обеих 128-битных половинах регистра
+__attribute__((target("avx2"))) inline __m256i table(const uint8_t* values) noexcept
+{
+    return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(values)));
+}
+
+__attribute__((target("avx2"))) inline void checkAvx2(avx2_state& state, __m256i input) noexcept
+{
+    if (_mm256_movemask_epi8(input) == 0) {
+        state.error = _mm256_or_si256(state.error, state.prevIncomplete);
+        state.prevIncomplete = _mm256_setzero_si256();
+        state.prev = input;
+        return;
+    }
+
+    const auto nibble = _mm256_set1_epi8(0x0F);
+    // Сдвиг на N байтов через границу 128-битных половин регистра
+    auto joined = _mm256_permute2x128_si256(state.prev, input, 0x21);
+    auto prev1 = _mm256_alignr_epi8(input, joined, 15);
+    auto special = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(table(BYTE_1_HIGH), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+            _mm256_shuffle_epi8(table(BYTE_1_LOW), _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(table(BYTE_2_HIGH), _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+    auto must23 = _mm256_or_si256(
+        _mm256_subs_epu8(_mm256_alignr_epi8(input, joined, 14), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+        _mm256_subs_epu8(_mm256_alignr_epi8(input, joined, 13), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+    auto must23x80 = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+    state.error = _mm256_or_si256(state.error, _mm256_xor_si256(must23x80, special));
+    state.prevIncomplete = _mm256_subs_epu8(input, _mm256_load_si256(reinterpret_cast<const __m256i*>(MAX_TAIL)));
+    state.prev = input;
+}
+
+__attribute__((target("avx2"))) bool validateAvx2(const unsigned char* text, size_t size) noexcept
+{
+    avx2_state state { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+        checkAvx2(state, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)));
+    if (i < size) {
+        alignas(32) unsigned char tail[32] = {};
+        std::memcpy(tail, text + i, size - i);
+        checkAvx2(state, _mm256_load_si256(reinterpret_cast<const __m256i*>(tail)));
+    }
+    auto error = _mm256_or_si256(state.error, state.prevIncomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+#endif
+
+typedef bool (*validate_function)(const unsigned char* text, size_t size) noexcept;
+
+struct implementation {
+    const char* name;
+    /// векторная проверка текста из целых последовательностей; nullptr - только побайтная
+    validate_function validate;
+};
+
+const implementation& selectImplementation() noexcept
+{
+    static const implementation impl = []() -> implementation {
+#if defined(UTF8_HAS_SIMD)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return { "avx2", validateAvx2 };
+        if (__builtin_cpu_supports("ssse3"))
+            return { "ssse3", validateSsse3 };
+#endif
+        return { "scalar", nullptr };
+    }();
+    return impl;
+}
+
+/**
+ * @brief Длина начала текста, состоящего из целых последовательностей
+ * @remarks Отрезает последовательность, которую продолжит следующий кусок
+ */
+size_t completePrefix(const unsigned char* text, size_t size) noexcept
+{
+    for (size_t back = 1; back <= 3 && back <= size; ++back) {
+        auto ch = text[size - back];
+        if ((ch & 0xC0) == 0x80)
+            continue;
+        size_t length = ch < 0xC0 ? 1 : ch < 0xE0 ? 2 : ch < 0xF0 ? 3 : 4;
+        return back < length ? size - back : size;
+    }
+    return size;
+}
+} // end of anonymous namespace
+
+size_t detail::validateUtf8(const char* text, size_t size) noexcept
+{
+    utf8_validator validator;
+    if (validator.feed(std::string_view(text, size)) && validator.finish())
+        return size;
+    return validator.errorOffset();
+}
+
+const char* detail::utf8Implementation() noexcept
+{
+    return selectImplementation().name;
+}
+
+bool detail::utf8_validator::feed(std::string_view chunk) noexcept
+{
+    if (m_failed)
+        return false;
+
+    auto text = reinterpret_cast<const unsigned char*>(chunk.data());
+    const size_t size = chunk.size();
+    size_t i = 0;
+    // Дописываем последовательность, начатую в предыдущем куске
+    if (m_need > 0)
+        i = scalar(text, 0, size, true);
+
+    if (!m_failed && i < size) {
+        if (auto validate = selectImplementation().validate) {
+            auto end = i + completePrefix(text + i, size - i);
+            // Векторная проверка отвечает только "да" или "нет", позицию ошибки ищем побайтно
+            if (end > i && !validate(text + i, end - i))
+                scalar(text, i, end, false);
+            i = end;
+        }
+        if (!m_failed)
+            scalar(text, i, size, false);
+    }
+    m_offset += size;
+    return !m_failed;
+}
+
+bool detail::utf8_validator::finish() noexcept
+{
+    if (!m_failed && m_need > 0) {
+        m_failed = true;
+        m_errorOffset = m_sequenceStart;
+    }
+    return !m_failed;
+}
+
+size_t detail::utf8_validator::scalar(const unsigned char* text, size_t begin, size_t end, bool stopAtBoundary) noexcept
+{
+    size_t i = begin;
+    while (i < end) {
+        if (m_need > 0) {
+            auto ch = text[i];
+            if (ch < m_low || ch > m_high) {
+                m_failed = true;
+                m_errorOffset = m_sequenceStart;
+                return i;
+            }
+            m_low = 0x80;
+            m_high = 0xBF;
+            --m_need;
+            ++i;
+            continue;
+        }
+        if (stopAtBoundary)
+            return i;
+
+        // Участки ASCII пропускаем по 8 байт
+        for (uint64_t word; i + 8 <= end; i += 8) {
+            std::memcpy(&word, text + i, sizeof(word));
+            if (word & 0x8080808080808080ull)
+                break;
+        }
+        if (i == end)
+            break;
+        auto ch = text[i];
+        if (ch < 0x80) {
+            ++i;
+            continue;
+        }
+
+        m_sequenceStart = m_offset + i;
+        if (ch >= 0xC2 && ch <= 0xDF) {
+            m_need = 1;
+        } else if (ch >= 0xE0 && ch <= 0xEF) {
+            // E0 - без избыточно длинных форм, ED - без суррогатов
+            m_need = 2;
+            m_low = (ch == 0xE0) ? 0xA0 : 0x80;
+            m_high = (ch == 0xED) ? 0x9F : 0xBF;
+        } else if (ch >= 0xF0 && ch <= 0xF4) {
+            // F0 - без избыточно длинных форм, F4 - не больше U+10FFFF
+            m_need = 3;
+            m_low = (ch == 0xF0) ? 0x90 : 0x80;
+            m_high = (ch == 0xF4) ? 0x8F : 0xBF;
+        } else {
+            m_failed = true;
+            m_errorOffset = m_sequenceStart;
+            return i;
+        }
+        ++i;
+    }
+    return i;
+}
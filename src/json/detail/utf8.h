@@ -0,0 +1,87 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+#include <string_view>
+
+namespace detail {
+
+/**
+ * @brief Ищет первую некорректную последовательность UTF-8 (RFC 3629)
+ * @remarks Некорректными считаются лишние байты продолжения, обрезанные и избыточно длинные
+ * последовательности, суррогаты и кодовые точки больше U+10FFFF. Текст проверяется векторно
+ * (алгоритм Keiser и Lemire) блоками по 32 байта инструкциями AVX2 или по 16 байт SSSE3 -
+ * набор инструкций выбирается при первом вызове по возможностям процессора; без них текст
+ * проверяется побайтно. Точная позиция ошибки уточняется побайтным проходом.
+ * @param text текст
+ * @param size размер текста
+ * @return смещение первого байта некорректной последовательности или size, если её нет
+ */
+size_t validateUtf8(const char* text, size_t size) noexcept;
+
+/**
+ * @brief Набор инструкций, которым проверяется UTF-8
+ * @return "avx2", "ssse3" или "scalar"
+ */
+const char* utf8Implementation() noexcept;
+
+/**
+ * @class utf8_validator
+ * @brief Проверка UTF-8 текста, поступающего произвольными кусками.
+ * @remarks Последовательность, разрезанная границей кусков, проверяется побайтно,
+ * основная часть каждого куска - векторно, как в validateUtf8.
+ */
+class utf8_validator {
+public:
+    /**
+     * @brief Проверяет очередной кусок текста
+     * @param chunk кусок текста
+     * @return false если обнаружена ошибка
+     */
+    bool feed(std::string_view chunk) noexcept;
+
+    /**
+     * @brief Сообщает, что текст закончился
+     * @return false если текст оборвался посреди последовательности или ранее была обнаружена ошибка
+     */
+    bool finish() noexcept;
+
+    /**
+     * @brief Была ли обнаружена ошибка?
+     */
+    bool failed() const noexcept { return m_failed; }
+
+    /**
+     * @brief Смещение первого байта некорректной последовательности от начала текста
+     */
+    size_t errorOffset() const noexcept { return m_errorOffset; }
+
+private:
+    /**
+     * @brief Проверяет байты куска побайтно, продолжая незавершённую последовательность
+     * @param text кусок текста
+     * @param begin смещение первого проверяемого байта в куске
+     * @param end смещение за последним проверяемым байтом
+     * @param stopAtBoundary остановиться, как только незавершённая последовательность закончится
+     * @return смещение, на котором проверка остановилась, или end; при ошибке выставляет m_failed
+     */
+    size_t scalar(const unsigned char* text, size_t begin, size_t end, bool stopAtBoundary) noexcept;
+
+private:
+    /// количество проверенных байтов в предыдущих кусках
+    size_t m_offset = 0;
+    /// сколько байтов продолжения ещё ожидается
+    unsigned m_need = 0;
+    /// допустимый диапазон следующего байта продолжения
+    unsigned char m_low = 0x80;
+    unsigned char m_high = 0xBF;
+    /// смещение начала незавершённой последовательности
+    size_t m_sequenceStart = 0;
+
+    bool m_failed = false;
+    size_t m_errorOffset = 0;
+};
+
+} // end of namespace detail
+
+#endif // UTF8_H
@@ -0,0 +1,58 @@
+#ifndef PARSE_RESULT_H
+#define PARSE_RESULT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace json {
+
+/// Код ошибки разбора
+enum class parse_error : uint8_t {
+    /// ошибок нет
+    None,
+    /// текст закончился раньше документа
+    UnexpectedEnd,
+    /// символ, недопустимый в этом месте документа
+    UnexpectedCharacter,
+    /// строка не закрыта кавычкой или содержит управляющий символ
+    UnfinishedString,
+    /// некорректная escape-последовательность
+    InvalidEscape,
+    /// некорректное число
+    InvalidNumber,
+    /// некорректная последовательность UTF-8
+    InvalidUtf8,
+    /// значение превысило предельный размер
+    TooLong,
+    /// данные после конца документа
+    TrailingData,
+    /// значение отвергнуто обработчиком, например не подходит под схему дерева
+    Rejected
+};
+
+/**
+ * @struct parse_result
+ * @brief Результат разбора без исключений.
+ * @remarks Не владеет памятью: описание ошибки - строковая константа, поэтому результат
+ * можно получать и копировать без выделения памяти.
+ */
+struct parse_result {
+    /// код первой ошибки
+    parse_error code = parse_error::None;
+    /// смещение первой ошибки в байтах от начала текста
+    size_t offset = 0;
+    /// номер строки первой ошибки, начиная с 1
+    size_t line = 0;
+    /// номер столбца первой ошибки, начиная с 1
+    size_t column = 0;
+    /// описание первой ошибки, nullptr если ошибок нет
+    const char* message = nullptr;
+
+    /**
+     * @brief Успешен ли разбор?
+     */
+    explicit operator bool() const noexcept { return code == parse_error::None; }
+};
+} // end of namespace json
+
+#endif // PARSE_RESULT_H
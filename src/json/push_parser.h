@@ -0,0 +1,620 @@
+#ifndef PUSH_PARSER_H
+#define PUSH_PARSER_H
+
+#include "detail/escape.h"
+#include "detail/utf8.h"
+#include "parse_result.h"
+#include "value.h"
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace json {
+
+/**
+ * @brief Является ли текст числом в синтаксисе RFC 8259?
+ * @remarks Грамматика парсера шире: она допускает, например, "+1", ".5" и "5.".
+ * Такой текст нельзя без изменений переносить в выходной JSON.
+ * @param text текст числа
+ * @return false если не является
+ */
+inline bool is_json_number(std::string_view text) noexcept
+{
+    auto isDigit = [](char ch) { return ch >= '0' && ch <= '9'; };
+    size_t i = 0;
+    const size_t n = text.size();
+    if (i < n && text[i] == '-')
+        ++i;
+    if (i == n || !isDigit(text[i]))
+        return false;
+    if (text[i++] != '0') {
+        while (i < n && isDigit(text[i]))
+            ++i;
+    }
+    if (i < n && text[i] == '.') {
+        if (++i == n || !isDigit(text[i]))
+            return false;
+        while (i < n && isDigit(text[i]))
+            ++i;
+    }
+    if (i < n && (text[i] == 'e' || text[i] == 'E')) {
+        if (++i < n && (text[i] == '+' || text[i] == '-'))
+            ++i;
+        if (i == n || !isDigit(text[i]))
+            return false;
+        while (i < n && isDigit(text[i]))
+            ++i;
+    }
+    return i == n;
+}
+
+/**
+ * @class push_parser
+ * @brief Возобновляемый парсер JSON, принимающий текст произвольными кусками.
+ * @remarks Грамматика совпадает с грамматикой json::value::parse. Состояние разбора
+ * сохраняется между вызовами feed, в том числе посреди строки, числа или ключевого слова,
+ * поэтому текст не нужно держать в памяти целиком.
+ *
+ * Разобранные значения передаются обработчику THandler, который должен предоставлять методы
+ * @code
+ * const char* onNull();
+ * const char* onInteger(int value, std::string_view text);
+ * const char* onDouble(double value, std::string_view text);
+ * const char* onString(std::string_view value);
+ * const char* onKey(std::string_view key);
+ * const char* onStartObject();
+ * const char* onEndObject();
+ * const char* onStartArray();
+ * const char* onEndArray();
+ * @endcode
+ * Каждый метод возвращает nullptr если значение принято, либо описание ошибки,
+ * которое останавливает разбор. Переданные std::string_view действительны только во время вызова.
+ * Для чисел вместе с разобранным значением передаётся исходный текст числа.
+ * Текст должен быть в UTF-8: некорректная последовательность считается ошибкой "invalid UTF-8"
+ * со смещением её первого байта.
+ */
+template <typename THandler>
+class push_parser {
+public:
+    /**
+     * @brief Конструирует парсер
+     * @param handler обработчик разобранных значений
+     * @warning время жизни парсера не должно превышать время жизни обработчика
+     */
+    explicit push_parser(THandler& handler);
+
+    /**
+     * @brief Ограничивает размер строки или числа, пересекающих границу кусков
+     * @remarks Такие значения накапливаются во внутреннем буфере; значение длиннее предела
+     * считается ошибкой, так что память парсера остаётся ограниченной
+     * @param size предельный размер в байтах
+     */
+    void set_max_token_size(size_t size) noexcept;
+
+    /**
+     * @brief Разбирает очередной кусок текста
+     * @param chunk кусок текста произвольной длины
+     * @return false если обнаружена ошибка
+     */
+    bool feed(std::string_view chunk);
+
+    /**
+     * @brief Сообщает парсеру, что текст закончился
+     * @return false если документ неполон или ранее была обнаружена ошибка
+     */
+    bool finish();
+
+    /**
+     * @brief Была ли обнаружена ошибка?
+     * @return false если ошибок не было
+     */
+    bool failed() const noexcept;
+
+    /**
+     * @brief Описание первой ошибки
+     * @return описание ошибки, nullptr если ошибок не было
+     */
+    const char* message() const noexcept;
+
+    /**
+     * @brief Смещение первой ошибки в байтах от начала текста
+     */
+    size_t offset() const noexcept;
+
+    /**
+     * @brief Номер строки первой ошибки, начиная с 1
+     */
+    size_t line() const noexcept;
+
+    /**
+     * @brief Номер столбца первой ошибки, начиная с 1
+     */
+    size_t column() const noexcept;
+
+    /**
+     * @brief Код, позиция и описание первой ошибки
+     * @remarks Не выделяет память и не бросает исключений
+     */
+    parse_result result() const noexcept;
+
+    /**
+     * @brief Бросает исключение, если была обнаружена ошибка
+     * @throw json_exception с описанием и позицией ошибки
+     */
+    void check() const;
+
+private:
+    enum class state : uint8_t {
+        Value,
+        ArrayFirst,
+        ObjectFirst,
+        AfterValue,
+        Key,
+        Colon,
+        String,
+        Number,
+        Literal,
+        Done
+    };
+
+    /**
+     * @brief Запоминает первую ошибку
+     * @param code код ошибки
+     * @param message описание ошибки
+     * @param offset абсолютное смещение ошибки
+     * @return всегда false
+     */
+    bool fail(parse_error code, const char* message, size_t offset);
+
+    /**
+     * @brief Разбирает очередной кусок текста, уже проверенный на корректность UTF-8
+     * @param chunk кусок текста
+     * @return false если обнаружена ошибка
+     */
+    bool parse(std::string_view chunk);
+
+    /**
+     * @brief Передаёт результат вызова обработчика, запоминая ошибку обработчика
+     * @param message результат вызова обработчика
+     * @return false если обработчик отверг значение
+     */
+    bool accept(const char* message);
+
+    /**
+     * @brief Переход в состояние после завершённого значения
+     */
+    void valueDone();
+
+    /**
+     * @brief Разбирает накопленное число и передаёт его обработчику
+     * @param token текст числа
+     */
+    bool emitNumber(std::string_view token);
+
+    /**
+     * @brief Дописывает часть значения во внутренний буфер
+     * @param part часть значения
+     * @return false если значение превысило предельный размер
+     */
+    bool appendToken(std::string_view part);
+
+    static bool isSpace(char ch);
+    static bool isNumberChar(char ch);
+
+private:
+    THandler& m_handler;
+    state m_state = state::Value;
+    bool m_isKey = false;
+    unsigned m_literalPos = 0;
+    std::vector<char> m_stack;
+    std::string m_token;
+    size_t m_maxToken = SIZE_MAX;
+    /// в текущей строке есть escape-последовательности
+    bool m_escaped = false;
+    /// предыдущий кусок закончился обратной косой чертой внутри строки
+    bool m_escapeNext = false;
+    /// строка с раскрытыми escape-последовательностями
+    std::string m_unescaped;
+    detail::utf8_validator m_utf8;
+
+    size_t m_consumed = 0;
+    size_t m_tokenStart = 0;
+    size_t m_line = 1;
+    size_t m_lineStart = 0;
+
+    const char* m_error = nullptr;
+    parse_error m_errorCode = parse_error::None;
+    size_t m_errorOffset = 0;
+    size_t m_errorLine = 0;
+    size_t m_errorColumn = 0;
+};
+
+template <typename THandler>
+push_parser<THandler>::push_parser(THandler& handler)
+    : m_handler(handler)
+{
+    m_stack.reserve(64);
+}
+
+template <typename THandler>
+inline void push_parser<THandler>::set_max_token_size(size_t size) noexcept
+{
+    m_maxToken = size;
+}
+
+template <typename THandler>
+bool push_parser<THandler>::feed(std::string_view chunk)
+{
+    if (m_error)
+        return false;
+    if (m_utf8.feed(chunk))
+        return parse(chunk);
+
+    // Текст до некорректной последовательности разбирается, чтобы сообщить о первой ошибке документа
+    auto errorOffset = m_utf8.errorOffset();
+    if (errorOffset > m_consumed && !parse(chunk.substr(0, errorOffset - m_consumed)))
+        return false;
+    return fail(parse_error::InvalidUtf8, "invalid UTF-8", errorOffset);
+}
+
+template <typename THandler>
+bool push_parser<THandler>::parse(std::string_view chunk)
+{
+    static constexpr std::string_view NULL_KW = "null";
+    const char* p = chunk.data();
+    const size_t n = chunk.size();
+    size_t i = 0;
+
+    while (i < n) {
+        switch (m_state) {
+        case state::String: {
+            auto begin = i;
+            // Символ после обратной косой черты в конце предыдущего куска относится к ней
+            if (m_escapeNext) {
+                m_escapeNext = false;
+                ++i;
+            }
+            for (;;) {
+                i += detail::scanString(p + i, n - i);
+                if (i == n || p[i] != '\\')
+                    break;
+                m_escaped = true;
+                if (i + 1 == n) {
+                    m_escapeNext = true;
+                    i = n;
+                    break;
+                }
+                i += 2;
+            }
+            if (i == n) {
+                if (!appendToken(std::string_view(p + begin, n - begin)))
+                    return false;
+                break;
+            }
+            if (p[i] != '"') {
+                // Перевод строки внутри строки скорее означает, что не хватает закрывающей кавычки
+                auto message = (p[i] == '\n' || p[i] == '\r') ? "unfinished string" : "unescaped control character in string";
+                return fail(parse_error::UnfinishedString, message, m_consumed + i);
+            }
+
+            // Строка целиком внутри куска и без escape-последовательностей передаётся без копирования
+            auto str = std::string_view(p + begin, i - begin);
+            if (!m_token.empty()) {
+                m_token.append(str);
+                str = m_token;
+            }
+            if (m_escaped) {
+                m_escaped = false;
+                size_t errorPos = 0;
+                if (auto error = detail::unescape(str, m_unescaped, errorPos))
+                    return fail(parse_error::InvalidEscape, error, m_tokenStart + 1 + errorPos);
+                str = m_unescaped;
+            }
+            ++i;
+            if (m_isKey) {
+                if (!accept(m_handler.onKey(str)))
+                    return false;
+                m_state = state::Colon;
+            } else {
+                if (!accept(m_handler.onString(str)))
+                    return false;
+                valueDone();
+            }
+            m_token.clear();
+            break;
+        }
+
+        case state::Number: {
+            auto begin = i;
+            while (i < n && isNumberChar(p[i]))
+                ++i;
+            auto str = std::string_view(p + begin, i - begin);
+            if (i == n) {
+                if (!appendToken(str))
+                    return false;
+                break;
+            }
+            if (!m_token.empty()) {
+                m_token.append(str);
+                str = m_token;
+            }
+            if (!emitNumber(str))
+                return false;
+            m_token.clear();
+            break;
+        }
+
+        case state::Literal:
+            while (i < n && m_literalPos < NULL_KW.size()) {
+                if (p[i] != NULL_KW[m_literalPos])
+                    return fail(parse_error::UnexpectedCharacter, "unexpected character", m_tokenStart);
+                ++i, ++m_literalPos;
+            }
+            if (m_literalPos == NULL_KW.size()) {
+                if (!accept(m_handler.onNull()))
+                    return false;
+                valueDone();
+            }
+            break;
+
+        default: {
+            while (i < n && isSpace(p[i])) {
+                if (p[i] == '\n') {
+                    ++m_line;
+                    m_lineStart = m_consumed + i + 1;
+                }
+                ++i;
+            }
+            if (i == n)
+                break;
+
+            auto ch = p[i];
+            m_tokenStart = m_consumed + i;
+            switch (m_state) {
+            case state::Value:
+            case state::ArrayFirst:
+                if (m_state == state::ArrayFirst && ch == ']') {
+                    ++i;
+                    m_stack.pop_back();
+                    if (!accept(m_handler.onEndArray()))
+                        return false;
+                    valueDone();
+                } else if (ch == '{') {
+                    ++i;
+                    m_stack.push_back('{');
+                    if (!accept(m_handler.onStartObject()))
+                        return false;
+                    m_state = state::ObjectFirst;
+                } else if (ch == '[') {
+                    ++i;
+                    m_stack.push_back('[');
+                    if (!accept(m_handler.onStartArray()))
+                        return false;
+                    m_state = state::ArrayFirst;
+                } else if (ch == '"') {
+                    ++i;
+                    m_isKey = false;
+                    m_state = state::String;
+                } else if (ch == 'n') {
+                    m_literalPos = 0;
+                    m_state = state::Literal;
+                } else if (isNumberChar(ch) && ch != 'e' && ch != 'E') {
+                    m_state = state::Number;
+                } else {
+                    return fail(parse_error::UnexpectedCharacter, "unexpected character", m_tokenStart);
+                }
+                break;
+
+            case state::ObjectFirst:
+            case state::Key:
+                if (m_state == state::ObjectFirst && ch == '}') {
+                    ++i;
+                    m_stack.pop_back();
+                    if (!accept(m_handler.onEndObject()))
+                        return false;
+                    valueDone();
+                } else if (ch == '"') {
+                    ++i;
+                    m_isKey = true;
+                    m_state = state::String;
+                } else {
+                    return fail(parse_error::UnexpectedCharacter, "expected key", m_tokenStart);
+                }
+                break;
+
+            case state::Colon:
+                if (ch != ':')
+                    return fail(parse_error::UnexpectedCharacter, "expected ':'", m_tokenStart);
+                ++i;
+                m_state = state::Value;
+                break;
+
+            case state::AfterValue: {
+                auto top = m_stack.back();
+                if (ch == ',') {
+                    ++i;
+                    m_state = (top == '{') ? state::Key : state::Value;
+                } else if (ch == '}' && top == '{') {
+                    ++i;
+                    m_stack.pop_back();
+                    if (!accept(m_handler.onEndObject()))
+                        return false;
+                    valueDone();
+                } else if (ch == ']' && top == '[') {
+                    ++i;
+                    m_stack.pop_back();
+                    if (!accept(m_handler.onEndArray()))
+                        return false;
+                    valueDone();
+                } else {
+                    return fail(parse_error::UnexpectedCharacter, top == '{' ? "expected ',' or '}'" : "expected ',' or ']'",
+                        m_tokenStart);
+                }
+                break;
+            }
+
+            case state::Done:
+                return fail(parse_error::TrailingData, "unexpected data after document", m_tokenStart);
+
+            default:
+                break;
+            }
+            break;
+        }
+        }
+    }
+
+    m_consumed += n;
+    return true;
+}
+
+template <typename THandler>
+bool push_parser<THandler>::finish()
+{
+    if (m_error)
+        return false;
+    if (!m_utf8.finish())
+        return fail(parse_error::InvalidUtf8, "invalid UTF-8", m_utf8.errorOffset());
+
+    switch (m_state) {
+    case state::Done:
+        return true;
+    case state::Number:
+        if (!emitNumber(m_token))
+            return false;
+        m_token.clear();
+        return m_state == state::Done || fail(parse_error::UnexpectedEnd, "unexpected end of document", m_consumed);
+    case state::String:
+        return fail(parse_error::UnfinishedString, "unfinished string", m_consumed);
+    default:
+        return fail(parse_error::UnexpectedEnd, "unexpected end of document", m_consumed);
+    }
+}
+
+template <typename THandler>
+inline bool push_parser<THandler>::failed() const noexcept
+{
+    return m_error != nullptr;
+}
+
+template <typename THandler>
+inline const char* push_parser<THandler>::message() const noexcept
+{
+    return m_error;
+}
+
+template <typename THandler>
+inline size_t push_parser<THandler>::offset() const noexcept
+{
+    return m_errorOffset;
+}
+
+template <typename THandler>
+inline size_t push_parser<THandler>::line() const noexcept
+{
+    return m_errorLine;
+}
+
+template <typename THandler>
+inline size_t push_parser<THandler>::column() const noexcept
+{
+    return m_errorColumn;
+}
+
+template <typename THandler>
+inline parse_result push_parser<THandler>::result() const noexcept
+{
+    return { m_errorCode, m_errorOffset, m_errorLine, m_errorColumn, m_error };
+}
+
+template <typename THandler>
+void push_parser<THandler>::check() const
+{
+    if (m_error) {
+        throw json_exception("In line " + std::to_string(m_errorLine) + ", column "
+            + std::to_string(m_errorColumn) + ": " + m_error);
+    }
+}
+
+template <typename THandler>
+bool push_parser<THandler>::fail(parse_error code, const char* message, size_t offset)
+{
+    if (!m_error) {
+        m_error = message;
+        m_errorCode = code;
+        m_errorOffset = offset;
+        m_errorLine = m_line;
+        m_errorColumn = offset - m_lineStart + 1;
+    }
+    return false;
+}
+
+template <typename THandler>
+inline bool push_parser<THandler>::accept(const char* message)
+{
+    return !message || fail(parse_error::Rejected, message, m_tokenStart);
+}
+
+template <typename THandler>
+inline void push_parser<THandler>::valueDone()
+{
+    m_state = m_stack.empty() ? state::Done : state::AfterValue;
+}
+
+template <typename THandler>
+bool push_parser<THandler>::emitNumber(std::string_view token)
+{
+    auto begin = token.data();
+    auto end = token.data() + token.size();
+
+    // std::from_chars не принимает явный плюс, а грамматика json::value::parse принимает
+    if (end - begin > 1 && *begin == '+' && begin[1] != '-' && begin[1] != '+')
+        ++begin;
+
+    // Число без дробной части и экспоненты, помещающееся в int, остаётся целым
+    if (token.find_first_of(".eE") == std::string_view::npos) {
+        int value = 0;
+        auto res = std::from_chars(begin, end, value);
+        if (res.ec == std::errc() && res.ptr == end) {
+            if (!accept(m_handler.onInteger(value, token)))
+                return false;
+            valueDone();
+            return true;
+        }
+    }
+
+    double value = 0;
+    auto res = std::from_chars(begin, end, value);
+    if (res.ec != std::errc() || res.ptr != end)
+        return fail(parse_error::InvalidNumber, "invalid number", m_tokenStart);
+    if (!accept(m_handler.onDouble(value, token)))
+        return false;
+    valueDone();
+    return true;
+}
+
+template <typename THandler>
+inline bool push_parser<THandler>::appendToken(std::string_view part)
+{
+    if (part.size() > m_maxToken - m_token.size())
+        return fail(parse_error::TooLong, "value is too long", m_tokenStart);
+    m_token.append(part);
+    return true;
+}
+
+template <typename THandler>
+inline bool push_parser<THandler>::isSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\v' || ch == '\f';
+}
+
+template <typename THandler>
+inline bool push_parser<THandler>::isNumberChar(char ch)
+{
+    return (ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.' || ch == 'e' || ch == 'E';
+}
+} // end of namespace json
+
+#endif // PUSH_PARSER_H
@@ -1,13 +1,20 @@
 #include "value.h"
 #include "ast/config.hpp"
 #include "ast/value.hpp"
+#include "binary_parser.h"
+#include "binary_writer.h"
 #include "detail/generator.h"
+#include "push_parser.h"
+#include "value_builder.h"
+#include "trace.h"
 #include <boost/range/adaptors.hpp>
 
 using iterator_type = std::string::const_iterator;
 using ast_program = json_client::ast::value;
 
 namespace {
+/// Переносит данные из AST в JSON-значение.
+/// AST после обхода больше не нужен, поэтому строки и ключи забираются перемещением.
 struct AstHandler {
     typedef json::value result_type;
 
@@ -23,40 +30,28 @@ struct AstHandler {
     {
         return json::value::number(arg);
     }
-    json::value operator()(const std::string& arg) const
+    json::value operator()(std::string& arg) const
     {
-        return json::value::string(arg);
+        return json::value::string(std::move(arg));
     }
-    json::value operator()(const json_client::ast::array& arg) const
+    json::value operator()(json_client::ast::array& arg) const
     {
         auto ret = json::value::array(arg.size());
-        for (const auto& val : arg | boost::adaptors::indexed(0)) {
+        for (auto&& val : arg | boost::adaptors::indexed(0)) {
             ret.at(val.index()) = boost::apply_visitor(*this, val.value());
         }
         return ret;
     }
-    json::value operator()(const json_client::ast::object& arg) const
+    json::value operator()(json_client::ast::object& arg) const
     {
         auto ret = json::value::object();
-        for (const auto& val : arg) {
+        for (auto& val : arg) {
             // TODO: решить спорный вопрос с присвоением ключа
-            ret[val.first] = boost::apply_visitor(*this, val.second);
+            ret[std::move(val.first)] = boost::apply_visitor(*this, val.second);
         }
         return ret;
     }
 };
-
-void validateInputString(const std::string& value)
-{
-    auto it = std::find_if(value.begin(), value.end(), [](const char ch) {
-        return (ch == '\n' || ch == '\r' || ch == '\\');
-    });
-    if (value.end() != it) {
-        std::stringstream ss;
-        ss << "unsupported character '" << static_cast<int>(*it) << "'";
-        throw json::json_exception(ss.str());
-    }
-}
 }; // end of anonymous namespace
 
 json::value::value(int value)
@@ -69,14 +64,14 @@ json::value::value(double value)
 {
 }
 
-json::value::value(const std::string& value)
-    : m_value(value)
+json::value::value(std::string value)
+    : m_value(std::move(value))
 {
-    validateInputString(value);
 }
 
 json::value json::value::parse(const std::string& value)
 {
+    TRACE_SCOPE("json::value::parse", "bytes", static_cast<long long>(value.size()));
     ast_program program;
     std::stringstream ess;
 
@@ -102,6 +97,27 @@ json::value json::value::parse(const std::string& value)
     return boost::apply_visitor(AstHandler {}, program);
 }
 
+json::parse_result json::value::parse(std::string_view text, value& out)
+{
+    TRACE_SCOPE("json::value::parse(push)", "bytes", static_cast<long long>(text.size()));
+    value_builder builder;
+    push_parser<value_builder> parser(builder);
+    if (parser.feed(text) && parser.finish())
+        out = builder.take();
+    return parser.result();
+}
+
+json::value json::value::parse_binary(std::string_view data, binary_format format)
+{
+    TRACE_SCOPE("json::value::parse_binary", "bytes", static_cast<long long>(data.size()));
+    value_builder builder;
+    binary_parser<value_builder> parser(builder, format);
+    parser.feed(data);
+    parser.finish();
+    parser.check();
+    return builder.take();
+}
+
 std::string json::value::serialize() const
 {
     detail::generator gen(*this);
@@ -109,6 +125,20 @@ std::string json::value::serialize() const
     return gen.string();
 }
 
+void json::value::serialize(const std::function<void(std::string)>& sink) const
+{
+    detail::generator gen(*this, sink);
+    gen.generate();
+    gen.flush();
+}
+
+std::string json::value::serialize_binary(binary_format format) const
+{
+    binary_writer writer(format);
+    writer.write(*this);
+    return writer.take();
+}
+
 json::array::array(json::array::size_type size)
     : m_elements(size)
 {
@@ -116,6 +146,10 @@ json::array::array(json::array::size_type size)
 
 json::value& json::object::operator[](const std::string& key)
 {
-    validateInputString(key);
     return m_elements[key];
 }
+
+json::value& json::object::operator[](std::string&& key)
+{
+    return m_elements[std::move(key)];
+}
@@ -1,17 +1,22 @@
 #ifndef INC_VALUE_HPP
 #define INC_VALUE_HPP
 
+#include "binary_format.h"
+#include "parse_result.h"
 #include "utils.h"
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
 namespace json {
 
 class value;
+class value_builder;
 
 /**
  * @class json_exception
@@ -100,6 +105,7 @@ public:
 
 private:
     friend class json::value;
+    friend class json::value_builder;
     storage_type m_elements;
 };
 
@@ -160,6 +166,15 @@ public:
      */
     const json::value& at(const std::string& key) const;
 
+    /**
+     * @brief Предоставляет доступ к элементу JSON-объекта.
+     * @param key ключ по которому производится поиск элемента
+     * @throw json_exception если не найдено
+     * @remarks Возвращенный json::value должен иметь такое же или меньшее время жизни, как this
+     * @return Ссылка на элемент
+     */
+    json::value& at(const std::string& key);
+
     /**
      * @brief Предоставляет доступ к элементу JSON-объекта.
      * @param key ключ по которому производится поиск элемента
@@ -169,6 +184,13 @@ public:
      */
     json::value& operator[](const std::string& key);
 
+    /**
+     * @brief Аналог operator[](const std::string&), забирающий ключ перемещением
+     * @param key ключ по которому производится поиск элемента
+     * @return Ссылка на значение, хранящееся в поле
+     */
+    json::value& operator[](std::string&& key);
+
     /**
      * @brief Возвращает итератор на искомый элемент в JSON-объекте.
      * @param key ключ искомого элемента
@@ -221,9 +243,9 @@ public:
     /**
      * @brief Конструктор, создающий значение типа "String"
      * @param value Значение C++ из которого создается JSON-значение
-     * @remarks Этот конструктор работает за O(n), поскольку он пытается определить, есть ли в указанной строке символы, которые должны быть правильно экранированы в JSON.
+     * @remarks Строка забирается перемещением и не проверяется: допустимы любые байты, экранирование выполняется при сериализации (см. detail::escape).
      */
-    explicit value(const std::string& value);
+    explicit value(std::string value);
 
     /**
      * @brief Копирующий конструктор
@@ -268,11 +290,27 @@ public:
     static value number(int value);
 
     /**
-     * @brief Создает значение типа "number"
+     * @brief Создает значение типа "number", запоминая его исходный текст
+     * @param value Значение C++ из которого создается JSON-значение
+     * @param text Исходный текст числа в синтаксисе JSON; при сериализации выводится без изменений
+     * @return JSON-значение типа "number"
+     */
+    static value number(double value, std::string text);
+
+    /**
+     * @brief Создает значение типа "number", запоминая его исходный текст
      * @param value Значение C++ из которого создается JSON-значение
-     * @remarks Функция работает за O(n), поскольку пытается определить, есть ли в указанной строке символы, которые должны быть правильно экранированы в JSON.
+     * @param text Исходный текст числа в синтаксисе JSON; при сериализации выводится без изменений
      * @return JSON-значение типа "number"
      */
+    static value number(int value, std::string text);
+
+    /**
+     * @brief Создает значение типа "string"
+     * @param value Значение C++ из которого создается JSON-значение
+     * @remarks Строка забирается перемещением и не проверяется: допустимы любые байты, экранирование выполняется при сериализации (см. detail::escape).
+     * @return JSON-значение типа "string"
+     */
     static value string(std::string value);
 
     /**
@@ -329,6 +367,14 @@ public:
      */
     bool is_double() const;
 
+    /**
+     * @brief Исходный текст числа, если он был сохранён при создании значения
+     * @remarks Текст сохраняется только явно (см. number(double, std::string)),
+     * любое присваивание значения его сбрасывает
+     * @return исходный текст числа или пустая строка
+     */
+    const std::string& number_text() const;
+
     /**
      * @brief Текущее значение является строковым значением?
      * @return false если не является
@@ -359,12 +405,43 @@ public:
      */
     static value parse(const std::string& value);
 
+    /**
+     * @brief Выполняет парсинг строки без исключений
+     * @remarks Текст разбирается json::push_parser: ошибка не бросает исключение и не выделяет
+     * память, поэтому отказ на некорректном документе стоит не дороже разбора корректного
+     * @param text текст документа
+     * @param out JSON-значение; изменяется только при успешном разборе
+     * @return результат разбора с кодом и позицией первой ошибки
+     */
+    static parse_result parse(std::string_view text, value& out);
+
+    /**
+     * @brief Разбирает JSON-значение, записанное в MessagePack или CBOR
+     * @param data закодированное значение
+     * @param format формат данных
+     * @throw json_exception если данные некорректны или содержат типы, которых нет в JSON
+     */
+    static value parse_binary(std::string_view data, binary_format format);
+
     /**
      * @brief Выполняет сериализацию текущего JSON-значения в C++ строку
      * @return Представление значения в виде строки
      */
     std::string serialize() const;
 
+    /**
+     * @brief Выполняет сериализацию текущего JSON-значения, передавая строку блоками по мере готовности
+     * @param sink приёмник блоков строки
+     */
+    void serialize(const std::function<void(std::string)>& sink) const;
+
+    /**
+     * @brief Кодирует текущее JSON-значение в MessagePack или CBOR
+     * @param format формат результата
+     * @return закодированное значение
+     */
+    std::string serialize_binary(binary_format format) const;
+
     /**
      * @brief Конвертирует JSON-значение в C++ double.
      * @throw json_exception если JSON-значение не является типом "Number"
@@ -403,6 +480,14 @@ public:
      */
     const json::object& as_object() const;
 
+    /**
+     * @brief Конвертирует JSON-значение в JSON-объект
+     * @throw json_exception если JSON-значение не является типом "Object"
+     * @remarks Возвращенный json::object должен иметь такое же или меньшее время жизни, как this
+     * @return Представление значение в виде объекта
+     */
+    json::object& as_object();
+
     /**
      * @brief Конвертирует JSON-значение в C++ строку.
      * @throw json_exception если JSON-значение не является типом "String"
@@ -411,6 +496,15 @@ public:
      */
     const std::string& as_string() const;
 
+    /**
+     * @brief Конвертирует JSON-значение в C++ строку.
+     * @throw json_exception если JSON-значение не является типом "String"
+     * @remarks Возвращенный std::string должен иметь такое же или меньшее время жизни, как this.
+     * Строку можно забрать перемещением, если само значение больше не нужно.
+     * @return Представление значения в виде строки
+     */
+    std::string& as_string();
+
     /**
      * @brief Предоставляет доступ к элементу JSON-объекта.
      * @param key ключ по которому производится поиск элемента
@@ -420,6 +514,15 @@ public:
      */
     const json::value& at(const std::string& key) const;
 
+    /**
+     * @brief Предоставляет доступ к элементу JSON-объекта.
+     * @param key ключ по которому производится поиск элемента
+     * @throw json_exception если не найдено
+     * @remarks Возвращенный json::value должен иметь такое же или меньшее время жизни, как this
+     * @return Ссылка на элемент
+     */
+    json::value& at(const std::string& key);
+
     /**
      * @brief Предоставляет доступ к элементу в массиве.
      * @param index индекс элемента в массиве
@@ -445,8 +548,18 @@ public:
      */
     json::value& operator[](const std::string& key);
 
+    /**
+     * @brief Предоставляет доступ к полю JSON-объекта, забирая имя поля перемещением
+     * @param key имя искомого поля
+     * @throw json_exception если JSON-значение не является типом "Object"
+     * @remarks Возвращенный json::value должен иметь такое же или меньшее время жизни, как this
+     * @return Ссылка на элемент
+     */
+    json::value& operator[](std::string&& key);
+
 private:
     std::optional<std::variant<int, double, std::string, json::array, json::object>> m_value;
+    std::string m_numberText;
 };
 
 inline array::iterator array::begin() { return m_elements.begin(); }
@@ -490,6 +603,11 @@ inline const value& object::at(const std::string& key) const
     return it->second;
 }
 
+inline value& object::at(const std::string& key)
+{
+    return const_cast<json::value&>(static_cast<const object&>(*this).at(key));
+}
+
 inline object::const_iterator object::find(const std::string& key) const
 {
     return m_elements.find(key);
@@ -510,6 +628,25 @@ inline value value::number(int _value)
     return value { std::move(_value) };
 }
 
+inline value value::number(double _value, std::string text)
+{
+    auto ret = value { std::move(_value) };
+    ret.m_numberText = std::move(text);
+    return ret;
+}
+
+inline value value::number(int _value, std::string text)
+{
+    auto ret = value { std::move(_value) };
+    ret.m_numberText = std::move(text);
+    return ret;
+}
+
+inline const std::string& value::number_text() const
+{
+    return m_numberText;
+}
+
 inline value value::string(std::string _value)
 {
     return value { std::move(_value) };
@@ -533,11 +670,13 @@ inline value value::object()
 inline bool value::has_field(const std::string& key) const
 {
     bool has = false;
-    std::visit(overloaded { [](const auto&) {},
-                   [&](const json::object& value) {
-                       has = (value.find(key) != value.end());
-                   } },
-        m_value.value_or(json::object {}));
+    if (m_value.has_value()) {
+        std::visit(overloaded { [](const auto&) {},
+                       [&](const json::object& value) {
+                           has = (value.find(key) != value.end());
+                       } },
+            m_value.value());
+    }
     return has;
 }
 
@@ -605,15 +744,17 @@ inline bool value::is_object() const { return type() == Object; }
 inline size_t value::size() const
 {
     size_t ret = 0;
-    std::visit(overloaded {
-                   [](const auto&) {},
-                   [&](const json::array& arg) {
-                       ret = arg.size();
-                   },
-                   [&](const json::object& arg) {
-                       ret = arg.size();
-                   } },
-        m_value.value_or(json::array {}));
+    if (m_value.has_value()) {
+        std::visit(overloaded {
+                       [](const auto&) {},
+                       [&](const json::array& arg) {
+                           ret = arg.size();
+                       },
+                       [&](const json::object& arg) {
+                           ret = arg.size();
+                       } },
+            m_value.value());
+    }
     return ret;
 }
 
@@ -702,6 +843,16 @@ inline const object& value::as_object() const
     return ret.value();
 }
 
+inline object& value::as_object()
+{
+    return const_cast<json::object&>(static_cast<const value&>(*this).as_object());
+}
+
+inline std::string& value::as_string()
+{
+    return const_cast<std::string&>(static_cast<const value&>(*this).as_string());
+}
+
 inline const std::string& value::as_string() const
 {
     auto ret = std::optional<std::reference_wrapper<const std::string>> {};
@@ -740,6 +891,11 @@ inline const value& value::at(const std::string& key) const
     return ret.value();
 }
 
+inline value& value::at(const std::string& key)
+{
+    return const_cast<json::value&>(static_cast<const value&>(*this).at(key));
+}
+
 inline value& value::at(size_t index)
 {
     return as_array().at(index);
@@ -768,6 +924,25 @@ inline value& value::operator[](const std::string& key)
 
     return ret.value();
 }
+
+inline value& value::operator[](std::string&& key)
+{
+    auto ret = std::optional<std::reference_wrapper<json::value>> {};
+
+    if (m_value.has_value()) {
+        std::visit(overloaded {
+                       [](auto&) {},
+                       [&](json::object& arg) {
+                           ret = arg[std::move(key)];
+                       } },
+            m_value.value());
+    }
+
+    if (!ret.has_value())
+        throw json_exception("Key not found");
+
+    return ret.value();
+}
 } // end of namespace json
 
 #endif // INC_VALUE_HPP
@@ -0,0 +1,89 @@
+#include "value_builder.h"
+#include "push_parser.h"
+
+json::value_builder::value_builder(bool keepNumberText)
+    : m_keepNumberText(keepNumberText)
+{
+    m_stack.reserve(64);
+}
+
+const char* json::value_builder::onNull()
+{
+    add(json::value::null());
+    return nullptr;
+}
+
+const char* json::value_builder::onInteger(int value, std::string_view text)
+{
+    if (m_keepNumberText && json::is_json_number(text))
+        add(json::value::number(value, std::string(text)));
+    else
+        add(json::value::number(value));
+    return nullptr;
+}
+
+const char* json::value_builder::onDouble(double value, std::string_view text)
+{
+    if (m_keepNumberText && json::is_json_number(text))
+        add(json::value::number(value, std::string(text)));
+    else
+        add(json::value::number(value));
+    return nullptr;
+}
+
+const char* json::value_builder::onString(std::string_view value)
+{
+    add(json::value::string(std::string(value)));
+    return nullptr;
+}
+
+const char* json::value_builder::onKey(std::string_view key)
+{
+    m_key.assign(key);
+    return nullptr;
+}
+
+const char* json::value_builder::onStartObject()
+{
+    m_stack.push_back(&add(json::value::object()));
+    return nullptr;
+}
+
+const char* json::value_builder::onEndObject()
+{
+    m_stack.pop_back();
+    return nullptr;
+}
+
+const char* json::value_builder::onStartArray()
+{
+    m_stack.push_back(&add(json::value::array()));
+    return nullptr;
+}
+
+const char* json::value_builder::onEndArray()
+{
+    m_stack.pop_back();
+    return nullptr;
+}
+
+json::value& json::value_builder::add(json::value&& value)
+{
+    if (m_stack.empty()) {
+        m_root = std::move(value);
+        return m_root;
+    }
+
+    auto& parent = *m_stack.back();
+    if (parent.is_array()) {
+        // Указатели на предыдущие элементы массива к этому моменту уже сняты со стека
+        auto& elements = parent.as_array().m_elements;
+        elements.push_back(std::move(value));
+        return elements.back();
+    }
+
+    auto& slot = parent[std::move(m_key)];
+    slot = std::move(value);
+    m_key.clear();
+    return slot;
+}
@@ -0,0 +1,61 @@
+#ifndef VALUE_BUILDER_H
+#define VALUE_BUILDER_H
+
+#include "value.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace json {
+
+/**
+ * @class value_builder
+ * @brief Обработчик json::push_parser, собирающий JSON-значение.
+ */
+class value_builder {
+public:
+    /**
+     * @brief Конструирует пустой сборщик
+     * @param keepNumberText true чтобы сохранять в числах их исходный текст (см. json::value::number_text)
+     */
+    explicit value_builder(bool keepNumberText = false);
+
+    /**
+     * @brief Забирает собранное значение
+     * @remarks Вызывать после успешного завершения разбора
+     * @return собранное JSON-значение
+     */
+    json::value take();
+
+    const char* onNull();
+    const char* onInteger(int value, std::string_view text);
+    const char* onDouble(double value, std::string_view text);
+    const char* onString(std::string_view value);
+    const char* onKey(std::string_view key);
+    const char* onStartObject();
+    const char* onEndObject();
+    const char* onStartArray();
+    const char* onEndArray();
+
+private:
+    /**
+     * @brief Помещает значение в текущий контейнер или делает его корнем
+     * @param value значение
+     * @return ссылка на размещённое значение
+     */
+    json::value& add(json::value&& value);
+
+private:
+    bool m_keepNumberText;
+    json::value m_root;
+    std::vector<json::value*> m_stack;
+    std::string m_key;
+};
+
+inline json::value value_builder::take()
+{
+    return std::move(m_root);
+}
+} // end of namespace json
+
+#endif // VALUE_BUILDER_H
@@ -1,9 +1,103 @@
 #include "application.h"
+#include "server.h"
+#include "task_scheduler.h"
+#include "trace.h"
+#include "tree_pipeline.h"
 #include <boost/program_options.hpp>
+#include <chrono>
+#include <climits>
 #include <iostream>
 
 namespace po = boost::program_options;
 
+namespace {
+/**
+ * @brief Разбирает размер в байтах с необязательным суффиксом K, M или G
+ * @param option название опции для сообщения об ошибке
+ * @param text текст размера, например "512M"
+ * @throw po::validation_error если текст не является размером
+ * @return размер в байтах
+ */
+size_t parseSize(const char* option, const std::string& text)
+{
+    size_t pos = 0;
+    unsigned long long value = 0;
+    try {
+        value = std::stoull(text, &pos);
+    } catch (const std::exception&) {
+        pos = 0;
+    }
+    if (pos == 0 || text[0] == '-')
+        throw po::validation_error(po::validation_error::invalid_option_value, option, text);
+
+    unsigned shift = 0;
+    if (pos < text.size()) {
+        switch (text[pos++]) {
+        case 'k': case 'K': shift = 10; break;
+        case 'm': case 'M': shift = 20; break;
+        case 'g': case 'G': shift = 30; break;
+        default: pos = 0; break;
+        }
+    }
+    if (pos != text.size() || value > (SIZE_MAX >> shift))
+        throw po::validation_error(po::validation_error::invalid_option_value, option, text);
+    return static_cast<size_t>(value) << shift;
+}
+
+/**
+ * @brief Разбирает название формата файла
+ * @param option название опции для сообщения об ошибке
+ * @param text название формата: json, msgpack или cbor
+ * @throw po::validation_error если формат неизвестен
+ * @return формат
+ */
+application::format parseFormat(const char* option, const std::string& text)
+{
+    if (text == "json")
+        return application::format::Json;
+    if (text == "msgpack")
+        return application::format::MessagePack;
+    if (text == "cbor")
+        return application::format::Cbor;
+    throw po::validation_error(po::validation_error::invalid_option_value, option, text);
+}
+
+/**
+ * @brief Разбирает описание преобразования узлов
+ * @param text trim, lower, scale=K или prune-depth=N
+ * @throw po::validation_error если описание некорректно
+ * @return преобразование
+ */
+tree_pipeline::transform_type parseTransform(const std::string& text)
+{
+    auto invalid = [&]() { return po::validation_error(po::validation_error::invalid_option_value, "transform", text); };
+    if (text == "trim")
+        return tree_pipeline::trimStrings();
+    if (text == "lower")
+        return tree_pipeline::lowercase();
+
+    auto pos = text.find('=');
+    if (pos == std::string::npos)
+        throw invalid();
+    auto name = text.substr(0, pos);
+    auto arg = text.substr(pos + 1);
+    size_t end = 0;
+    try {
+        if (name == "scale") {
+            auto factor = std::stod(arg, &end);
+            if (end == arg.size())
+                return tree_pipeline::scaleNumbers(factor);
+        } else if (name == "prune-depth" && !arg.empty() && arg[0] != '-') {
+            auto depth = std::stoul(arg, &end);
+            if (end == arg.size() && depth <= UINT_MAX)
+                return tree_pipeline::pruneDeeperThan(static_cast<unsigned>(depth));
+        }
+    } catch (const std::exception&) {
+    }
+    throw invalid();
+}
+} // end of anonymous namespace
+
 int main(int argc, char** argv)
 {
     int status = 1;
@@ -13,7 +107,25 @@ int main(int argc, char** argv)
     desc.add_options() ///
         ("help,h", "produce help message") ///
         ("input,i", po::value<std::string>(), "forward path to input file") ///
-        ("output,o", po::value<std::string>(), "forward path to output file");
+        ("output,o", po::value<std::string>(), "forward path to output file") ///
+        ("input-format", po::value<std::string>(), "format of input file: json (default), msgpack or cbor") ///
+        ("output-format", po::value<std::string>(), "format of output file: json (default), msgpack or cbor") ///
+        ("stats-only", "only print statistics of tree nodes, output file is not needed") ///
+        ("serve", po::value<std::string>(), "stay resident and serve requests on this Unix socket") ///
+        ("connections", po::value<size_t>(), "with --serve: number of connections served at once, 0 - one per core") ///
+        ("max-request-size", po::value<std::string>(), "with --serve: largest request body, e.g. 16M; 64M by default") ///
+        ("idle-timeout", po::value<unsigned>(), "with --serve: close connections that send nothing for this many seconds, 0 - never; 10 by default") ///
+        ("validate", "only check that input file is a valid tree, output file is not needed") ///
+        ("keep-number-text", "write numbers to output file exactly as they were in input file") ///
+        ("threads", po::value<size_t>(), "number of threads for parallel stages, 0 - one per core") ///
+        ("memory-limit", po::value<std::string>(), "process trees larger than RAM within this memory, e.g. 512M; temporary files go to TMPDIR") ///
+        ("cache-dir", po::value<std::string>(), "reuse trees parsed by earlier runs from this directory") ///
+        ("columns", po::value<std::string>(), "also export node values as typed columns (int64, double, strings) with parent ids to this raw binary file") ///
+        ("value-index", po::value<std::string>(), "also save a hash index of nodes by value to this file; it is loaded by mmap") ///
+        ("transform", po::value<std::vector<std::string>>()->composing(), "transform nodes on their way to output, repeatable, applied in order: trim, lower, scale=K, prune-depth=N") ///
+        ("strict", "treat unknown keys in tree nodes as errors") ///
+        ("alloc-stats", "print allocation counters (build with TASK2GIS_ALLOC_STATS)") ///
+        ("trace", po::value<std::string>(), "write Chrome trace events of hot paths to this file (build with TASK2GIS_TRACE)");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -25,23 +137,104 @@ int main(int argc, char** argv)
     }
 
     isValidArgs = true;
-    if (vm.count("input") == 0) {
+    if (vm.count("input") == 0 && vm.count("serve") == 0) {
         std::cerr << "Path to input file was not set.\n";
         isValidArgs = false;
     }
 
-    if (vm.count("output") == 0) {
+    if (vm.count("output") == 0 && vm.count("validate") == 0 && vm.count("stats-only") == 0
+        && vm.count("serve") == 0) {
         std::cerr << "Path to output file was not set.\n";
         isValidArgs = false;
     }
 
+    auto inputFormat = application::format::Json;
+    auto outputFormat = application::format::Json;
+    if (vm.count("input-format"))
+        inputFormat = parseFormat("input-format", vm["input-format"].as<std::string>());
+    if (vm.count("output-format"))
+        outputFormat = parseFormat("output-format", vm["output-format"].as<std::string>());
+
+    if (outputFormat != application::format::Json && vm.count("memory-limit")) {
+        std::cerr << "Binary output format can't be combined with memory limit.\n";
+        isValidArgs = false;
+    }
+
+    if (outputFormat != application::format::Json && vm.count("transform")) {
+        std::cerr << "Binary output format can't be combined with transforms.\n";
+        isValidArgs = false;
+    }
+
+    if ((vm.count("columns") || vm.count("value-index")) && (vm.count("transform") || vm.count("memory-limit"))) {
+        std::cerr << "Columns output and value index can't be combined with transforms or memory limit.\n";
+        isValidArgs = false;
+    }
+
+    if (vm.count("threads"))
+        task_scheduler::configure(vm["threads"].as<size_t>());
+
+    if (isValidArgs && vm.count("trace")) {
+        if (trace::enabled())
+            trace::start(vm["trace"].as<std::string>());
+        else
+            std::cerr << "warning: --trace needs a build with TASK2GIS_TRACE\n";
+    }
+
     if (!isValidArgs)
         std::cerr << "Please run '" << argv[0] << " --help' for more info\n";
-    else {
+    else if (vm.count("serve")) {
+        server::limits bounds;
+        if (vm.count("connections"))
+            bounds.connections = vm["connections"].as<size_t>();
+        if (vm.count("max-request-size"))
+            bounds.maxBodySize = parseSize("max-request-size", vm["max-request-size"].as<std::string>());
+        if (vm.count("idle-timeout"))
+            bounds.idleTimeout = std::chrono::seconds(vm["idle-timeout"].as<unsigned>());
+        server srv(vm["serve"].as<std::string>(), bounds);
+        status = srv.run();
+    } else if (vm.count("validate")) {
+        application app;
+        app.setInput(vm["input"].as<std::string>());
+        app.setInputFormat(inputFormat);
+        status = app.validate();
+    } else if (vm.count("stats-only")) {
+        application app;
+        app.setInput(vm["input"].as<std::string>());
+        app.setInputFormat(inputFormat);
+        app.setStrict(vm.count("strict") > 0);
+        if (vm.count("cache-dir"))
+            app.setCacheDir(vm["cache-dir"].as<std::string>());
+        status = app.stats();
+    } else {
         application app;
         app.setInput(vm["input"].as<std::string>());
         app.setOutput(vm["output"].as<std::string>());
+        app.setInputFormat(inputFormat);
+        app.setOutputFormat(outputFormat);
+        app.setAllocStats(vm.count("alloc-stats") > 0);
+        app.setStrict(vm.count("strict") > 0);
+        app.setKeepNumberText(vm.count("keep-number-text") > 0);
+        if (vm.count("cache-dir"))
+            app.setCacheDir(vm["cache-dir"].as<std::string>());
+        if (vm.count("memory-limit"))
+            app.setMemoryLimit(parseSize("memory-limit", vm["memory-limit"].as<std::string>()));
+        if (vm.count("columns"))
+            app.setColumnsOutput(vm["columns"].as<std::string>());
+        if (vm.count("value-index"))
+            app.setValueIndexOutput(vm["value-index"].as<std::string>());
+        if (vm.count("transform")) {
+            for (const auto& text : vm["transform"].as<std::vector<std::string>>())
+                app.addTransform(parseTransform(text));
+        }
         status = app.work();
     }
+    if (vm.count("trace")) {
+        try {
+            trace::stop();
+        } catch (const std::exception& e) {
+            std::cerr << "error: " << e.what() << "\n";
+            status = 1;
+        }
+    }
     return status;
 }
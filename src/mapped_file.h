@@ -0,0 +1,49 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @class mapped_file
+ * @brief Файл, отображённый в память только для чтения.
+ * @remarks Если файл не удалось открыть или он пуст, data возвращает nullptr, а size - 0
+ */
+class mapped_file {
+public:
+    /**
+     * @brief Отображает файл в память
+     * @param path путь к файлу
+     */
+    explicit mapped_file(const std::string& path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    /**
+     * @brief Начало содержимого файла
+     */
+    const char* data() const noexcept;
+
+    /**
+     * @brief Размер файла
+     */
+    size_t size() const noexcept;
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+inline const char* mapped_file::data() const noexcept
+{
+    return m_data;
+}
+
+inline size_t mapped_file::size() const noexcept
+{
+    return m_size;
+}
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,111 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include "spsc_queue.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/**
+ * @class mpsc_queue
+ * @brief Ограниченная очередь без блокировок для нескольких производителей и одного потребителя.
+ * @remarks Очередь Вьюкова: у каждой ячейки кольцевого буфера свой номер последовательности,
+ * по которому производитель видит, что ячейка свободна, а потребитель - что она заполнена.
+ * Производители занимают место сдвигом хвоста через CAS, потребитель один и голову двигает
+ * без атомарных операций чтения-записи.
+ * try_pop вызывается только из одного потока.
+ */
+template <typename T>
+class mpsc_queue {
+public:
+    /**
+     * @brief Создаёт очередь
+     * @param capacity минимальная вместимость; округляется вверх до степени двойки
+     */
+    explicit mpsc_queue(size_t capacity);
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    /**
+     * @brief Кладёт элемент в конец очереди
+     * @param value элемент
+     * @return false если очередь заполнена
+     */
+    bool try_push(T value);
+
+    /**
+     * @brief Забирает элемент из начала очереди
+     * @param value элемент
+     * @return false если очередь пуста
+     */
+    bool try_pop(T& value);
+
+private:
+    struct cell {
+        /// равен номеру места, если ячейка свободна, и номеру места + 1, если заполнена
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> m_cells;
+    size_t m_mask;
+
+    /// следующее место для производителей
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail { 0 };
+    /// следующий элемент для потребителя
+    alignas(CACHE_LINE_SIZE) size_t m_head = 0;
+};
+
+template <typename T>
+mpsc_queue<T>::mpsc_queue(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    m_cells.reset(new cell[size]);
+    m_mask = size - 1;
+    for (size_t i = 0; i < size; ++i)
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool mpsc_queue<T>::try_push(T value)
+{
+    auto pos = m_tail.load(std::memory_order_relaxed);
+    for (;;) {
+        auto& c = m_cells[pos & m_mask];
+        auto sequence = c.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                c.value = std::move(value);
+                c.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // Ячейку ещё не освободил потребитель: очередь заполнена
+            return false;
+        } else {
+            // Место занял другой производитель
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool mpsc_queue<T>::try_pop(T& value)
+{
+    auto& c = m_cells[m_head & m_mask];
+    if (c.sequence.load(std::memory_order_acquire) != m_head + 1)
+        return false;
+    value = std::move(c.value);
+    // Ячейка становится свободной для места m_head + размер буфера
+    c.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+    ++m_head;
+    return true;
+}
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,203 @@
+#include "persistent_tree.h"
+#include <atomic>
+#include <iterator>
+
+persistent_tree::node::~node()
+{
+    // Последняя ссылка на дочерний узел снимается здесь же, после того как его собственные дочерние
+    // узлы перенесены в стек, поэтому деструкторы узлов не вызывают друг друга по цепочке
+    std::vector<node_ptr> stack = std::move(m_childs);
+    while (!stack.empty()) {
+        auto child = std::move(stack.back());
+        stack.pop_back();
+        if (child.use_count() == 1) {
+            // use_count() читается без упорядочения. Барьер связывает его с освобождением ссылок
+            // в других потоках, так что их чтения узла завершены до того, как узел будет изменён
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Узел создан изменяемым и больше никому не виден, поэтому его можно разобрать
+            auto& childs = const_cast<node&>(*child).m_childs;
+            std::move(childs.begin(), childs.end(), std::back_inserter(stack));
+            childs.clear();
+        }
+    }
+}
+
+persistent_tree::persistent_tree(value_type value)
+{
+    auto root = std::shared_ptr<node>(new node);
+    root->m_value = std::move(value);
+    m_root = std::move(root);
+}
+
+persistent_tree::persistent_tree(const tree& source)
+{
+    auto make = [](const tree& from) {
+        auto ret = std::shared_ptr<node>(new node);
+        ret->m_value = from.m_node;
+        ret->m_numberText = from.numberText();
+        ret->m_childs.reserve(from.m_subnodes.size());
+        return ret;
+    };
+
+    struct frame {
+        const tree* source;
+        node* target;
+        size_t next;
+    };
+
+    auto root = make(source);
+    std::vector<frame> stack { { &source, root.get(), 0 } };
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        if (top.next == top.source->m_subnodes.size()) {
+            stack.pop_back();
+            continue;
+        }
+        const auto& child = top.source->m_subnodes[top.next++];
+        auto copy = make(child);
+        auto target = copy.get();
+        top.target->m_childs.push_back(std::move(copy));
+        stack.push_back({ &child, target, 0 });
+    }
+    m_root = std::move(root);
+}
+
+persistent_tree::persistent_tree(node_ptr root) noexcept
+    : m_root(std::move(root))
+{
+}
+
+const persistent_tree::node& persistent_tree::at(const path& where) const
+{
+    const node* current = m_root.get();
+    for (auto index : where) {
+        if (index >= current->m_childs.size())
+            throw tree_exception("path is out of tree");
+        current = current->m_childs[index].get();
+    }
+    return *current;
+}
+
+tree persistent_tree::toTree() const
+{
+    struct frame {
+        const node* source;
+        size_t next;
+        std::vector<tree> childs;
+    };
+
+    auto make = [](const node& from, std::vector<tree> childs) {
+        tree ret(0, std::move(childs));
+        ret.m_node = from.m_value;
+        ret.setNumberText(from.m_numberText);
+        return ret;
+    };
+
+    // Поддерево строится после всех своих дочерних элементов и переносится в массив родителя
+    std::vector<frame> stack;
+    stack.push_back({ m_root.get(), 0, {} });
+    stack.back().childs.reserve(m_root->m_childs.size());
+    for (;;) {
+        auto& top = stack.back();
+        if (top.next < top.source->m_childs.size()) {
+            const auto& child = *top.source->m_childs[top.next++];
+            stack.push_back({ &child, 0, {} });
+            stack.back().childs.reserve(child.m_childs.size());
+            continue;
+        }
+        auto built = make(*top.source, std::move(top.childs));
+        stack.pop_back();
+        if (stack.empty())
+            return built;
+        stack.back().childs.push_back(std::move(built));
+    }
+}
+
+template <typename TChange>
+persistent_tree::node_ptr persistent_tree::copyPath(const path& where, TChange change) const
+{
+    std::vector<const node*> nodes;
+    nodes.reserve(where.size() + 1);
+    const node* current = m_root.get();
+    for (auto index : where) {
+        if (index >= current->m_childs.size())
+            throw tree_exception("path is out of tree");
+        nodes.push_back(current);
+        current = current->m_childs[index].get();
+    }
+
+    // Новый узел поднимается к корню, каждый предок пути копируется со ссылкой на новую версию потомка
+    node_ptr result = change(*current);
+    for (size_t i = where.size(); i-- > 0;) {
+        auto copy = copyNode(*nodes[i]);
+        copy->m_childs[where[i]] = std::move(result);
+        result = std::move(copy);
+    }
+    return result;
+}
+
+persistent_tree persistent_tree::assign(const path& where, value_type value) const
+{
+    return persistent_tree(copyPath(where, [&](const node& target) {
+        auto copy = copyNode(target);
+        copy->m_value = std::move(value);
+        copy->m_numberText.clear();
+        return copy;
+    }));
+}
+
+persistent_tree persistent_tree::replace(const path& where, const persistent_tree& subtree) const
+{
+    return persistent_tree(copyPath(where, [&](const node&) { return subtree.m_root; }));
+}
+
+persistent_tree persistent_tree::insert(const path& parent, size_t index, const persistent_tree& subtree) const
+{
+    return persistent_tree(copyPath(parent, [&](const node& target) {
+        if (index > target.m_childs.size())
+            throw tree_exception("index out of bounds");
+        auto copy = copyNode(target);
+        copy->m_childs.insert(copy->m_childs.begin() + static_cast<std::ptrdiff_t>(index), subtree.m_root);
+        return copy;
+    }));
+}
+
+persistent_tree persistent_tree::erase(const path& where) const
+{
+    if (where.empty())
+        throw tree_exception("can't erase root");
+
+    auto index = where.back();
+    auto parent = path(where.begin(), where.end() - 1);
+    return persistent_tree(copyPath(parent, [&](const node& target) {
+        if (index >= target.m_childs.size())
+            throw tree_exception("path is out of tree");
+        auto copy = copyNode(target);
+        copy->m_childs.erase(copy->m_childs.begin() + static_cast<std::ptrdiff_t>(index));
+        return copy;
+    }));
+}
+
+std::shared_ptr<persistent_tree::node> persistent_tree::copyNode(const node& source)
+{
+    return std::shared_ptr<node>(new node(source));
+}
+
+tree_versions::tree_versions(persistent_tree initial)
+    : m_current(std::move(initial))
+{
+}
+
+persistent_tree tree_versions::current() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_current;
+}
+
+void tree_versions::publish(persistent_tree next)
+{
+    // Прежняя версия освобождается вне блокировки: её узлы могут быть больше никому не нужны
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::swap(m_current, next);
+    lock.unlock();
+}
@@ -0,0 +1,259 @@
+#ifndef PERSISTENT_TREE_H
+#define PERSISTENT_TREE_H
+
+#include "tree.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <variant>
+#include <vector>
+
+/**
+ * @class persistent_tree
+ * @brief Неизменяемое дерево с общими между версиями узлами.
+ * @remarks Узлы неизменяемы и разделяются версиями через счётчики ссылок, поэтому копия
+ * persistent_tree - снимок версии за O(1) без копирования узлов. Изменение создаёт новую версию,
+ * копируя только узлы на пути от корня до изменённого узла (path copying): для каждого узла пути
+ * копируются его значение и массив указателей на дочерние элементы, сами поддеревья остаются общими.
+ * Для сбалансированного дерева с ограниченным ветвлением это O(log n); узел с большим числом
+ * дочерних элементов добавляет к стоимости размер своего массива указателей.
+ * Снимки можно читать из любого числа потоков одновременно, в том числе пока другой поток
+ * строит новые версии. Последнюю версию между потоками передаёт tree_versions.
+ */
+class persistent_tree {
+public:
+    /// Значение узла
+    typedef std::variant<std::string, int, double> value_type;
+    /// Путь к узлу: индексы дочерних элементов, начиная от корня; пустой путь - корень
+    typedef std::vector<size_t> path;
+
+    class node;
+    typedef std::shared_ptr<const node> node_ptr;
+
+    /**
+     * @class node
+     * @brief Неизменяемый узел дерева
+     */
+    class node {
+    public:
+        bool isInteger() const noexcept;
+        bool isDouble() const noexcept;
+        bool isString() const noexcept;
+
+        /**
+         * @throw std::bad_variant_access если узел хранит значение другого типа
+         */
+        int asInteger() const;
+
+        /**
+         * @throw std::bad_variant_access если узел хранит значение другого типа
+         */
+        double asDouble() const;
+
+        /**
+         * @throw std::bad_variant_access если узел хранит значение другого типа
+         */
+        const std::string& asString() const;
+
+        /**
+         * @brief Значение узла
+         */
+        const value_type& value() const noexcept;
+
+        /**
+         * @brief Исходный текст числа, см. tree::numberText
+         */
+        const std::string& numberText() const noexcept;
+
+        /**
+         * @brief Дочерние элементы
+         */
+        const std::vector<node_ptr>& childs() const noexcept;
+
+        /**
+         * @brief Освобождает поддеревья, на которые больше никто не ссылается
+         * @remarks Поддеревья разбираются без рекурсии, поэтому освобождение глубокой версии
+         * не переполняет стек
+         */
+        ~node();
+
+    private:
+        friend class persistent_tree;
+
+        node() = default;
+        node(const node&) = default;
+
+        value_type m_value;
+        std::string m_numberText;
+        std::vector<node_ptr> m_childs;
+    };
+
+    /**
+     * @brief Конструирует дерево из одного узла
+     * @param value значение узла
+     */
+    explicit persistent_tree(value_type value);
+
+    /**
+     * @brief Конструирует дерево с теми же значениями, что у tree
+     * @remarks Дерево обходится без рекурсии
+     * @param source исходное дерево
+     */
+    explicit persistent_tree(const tree& source);
+
+    /**
+     * @brief Корневой узел версии
+     */
+    const node& root() const noexcept;
+
+    /**
+     * @brief Узел по пути
+     * @param where путь к узлу
+     * @throw tree_exception если пути нет в дереве
+     * @return ссылка на узел; действительна, пока жив хотя бы один снимок, содержащий узел
+     */
+    const node& at(const path& where) const;
+
+    /**
+     * @brief Строит изменяемое дерево с теми же значениями
+     * @remarks Дерево обходится без рекурсии
+     * @return независимая копия версии
+     */
+    tree toTree() const;
+
+    /**
+     * @brief Новая версия с другим значением узла
+     * @remarks Исходный текст числа у узла сбрасывается
+     * @param where путь к узлу
+     * @param value новое значение
+     * @throw tree_exception если пути нет в дереве
+     */
+    persistent_tree assign(const path& where, value_type value) const;
+
+    /**
+     * @brief Новая версия, в которой поддерево заменено другим
+     * @param where путь к заменяемому поддереву; пустой путь заменяет всё дерево
+     * @param subtree новое поддерево; его узлы становятся общими для обеих версий
+     * @throw tree_exception если пути нет в дереве
+     */
+    persistent_tree replace(const path& where, const persistent_tree& subtree) const;
+
+    /**
+     * @brief Новая версия со вставленным поддеревом
+     * @param parent путь к узлу, в который вставляется поддерево
+     * @param index позиция среди дочерних элементов; не больше их количества
+     * @param subtree вставляемое поддерево
+     * @throw tree_exception если пути нет в дереве или позиция за пределами
+     */
+    persistent_tree insert(const path& parent, size_t index, const persistent_tree& subtree) const;
+
+    /**
+     * @brief Новая версия без поддерева
+     * @param where путь к удаляемому поддереву; корень удалить нельзя
+     * @throw tree_exception если пути нет в дереве или путь пуст
+     */
+    persistent_tree erase(const path& where) const;
+
+private:
+    explicit persistent_tree(node_ptr root) noexcept;
+
+    /**
+     * @brief Копирует путь от корня до узла, заменяя узел результатом change
+     * @param where путь к узлу
+     * @param change функция, строящая новый узел по старому
+     * @return корень новой версии
+     */
+    template <typename TChange>
+    node_ptr copyPath(const path& where, TChange change) const;
+
+    /**
+     * @brief Копия узла без дочерних поддеревьев, но с общими указателями на них
+     */
+    static std::shared_ptr<node> copyNode(const node& source);
+
+private:
+    node_ptr m_root;
+};
+
+/**
+ * @class tree_versions
+ * @brief Последняя версия persistent_tree, общая для пишущего и читающих потоков.
+ * @remarks Читатели получают снимок текущей версии и работают с ним без блокировок;
+ * писатель строит новую версию из снимка и публикует её. Снимок, полученный читателем,
+ * остаётся целым после публикации новых версий.
+ */
+class tree_versions {
+public:
+    /**
+     * @brief Конструирует хранилище с начальной версией
+     * @param initial начальная версия
+     */
+    explicit tree_versions(persistent_tree initial);
+
+    /**
+     * @brief Снимок текущей версии
+     */
+    persistent_tree current() const;
+
+    /**
+     * @brief Делает версию текущей
+     * @param next новая версия
+     */
+    void publish(persistent_tree next);
+
+private:
+    mutable std::mutex m_mutex;
+    persistent_tree m_current;
+};
+
+inline bool persistent_tree::node::isInteger() const noexcept
+{
+    return std::holds_alternative<int>(m_value);
+}
+
+inline bool persistent_tree::node::isDouble() const noexcept
+{
+    return std::holds_alternative<double>(m_value);
+}
+
+inline bool persistent_tree::node::isString() const noexcept
+{
+    return std::holds_alternative<std::string>(m_value);
+}
+
+inline int persistent_tree::node::asInteger() const
+{
+    return std::get<int>(m_value);
+}
+
+inline double persistent_tree::node::asDouble() const
+{
+    return std::get<double>(m_value);
+}
+
+inline const std::string& persistent_tree::node::asString() const
+{
+    return std::get<std::string>(m_value);
+}
+
+inline const persistent_tree::value_type& persistent_tree::node::value() const noexcept
+{
+    return m_value;
+}
+
+inline const std::string& persistent_tree::node::numberText() const noexcept
+{
+    return m_numberText;
+}
+
+inline const std::vector<persistent_tree::node_ptr>& persistent_tree::node::childs() const noexcept
+{
+    return m_childs;
+}
+
+inline const persistent_tree::node& persistent_tree::root() const noexcept
+{
+    return *m_root;
+}
+
+#endif // PERSISTENT_TREE_H
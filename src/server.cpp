@@ -0,0 +1,456 @@
+#include "server.h"
+#include "application.h"
+#include "tree_ancestry.h"
+#include "tree_builder.h"
+#include "tree_index.h"
+#include "tree_stats.h"
+#include "validator.h"
+#include "json/push_parser.h"
+#include "json/value.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <optional>
+#include <variant>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+std::atomic<bool> g_stopRequested { false };
+
+extern "C" void onStopSignal(int)
+{
+    g_stopRequested = true;
+}
+
+/**
+ * @brief Читает из сокета ровно size байт
+ * @return false если соединение закрыто или прервано
+ */
+bool readExact(int fd, char* data, size_t size)
+{
+    while (size > 0) {
+        auto res = ::recv(fd, data, size, 0);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        data += res;
+        size -= static_cast<size_t>(res);
+    }
+    return true;
+}
+
+/**
+ * @brief Отправляет в сокет все данные
+ * @return false если соединение закрыто или прервано
+ */
+bool writeAll(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        auto res = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        data.remove_prefix(static_cast<size_t>(res));
+    }
+    return true;
+}
+
+/**
+ * @brief Буферизованное чтение строк заголовков и тел запросов из сокета
+ */
+class connection_reader {
+public:
+    explicit connection_reader(int fd)
+        : m_fd(fd)
+    {
+    }
+
+    /**
+     * @brief Читает строку до '\n'
+     * @param line строка без '\n'
+     * @return false если соединение закрыто или строка слишком длинная
+     */
+    bool readLine(std::string& line)
+    {
+        static constexpr size_t MAX_LINE = 256;
+        line.clear();
+        for (;;) {
+            auto end = std::find(m_buffer + m_begin, m_buffer + m_end, '\n');
+            line.append(m_buffer + m_begin, end);
+            if (end != m_buffer + m_end) {
+                m_begin = static_cast<size_t>(end - m_buffer) + 1;
+                return true;
+            }
+            m_begin = m_end = 0;
+            if (line.size() > MAX_LINE || !fill())
+                return false;
+        }
+    }
+
+    /**
+     * @brief Читает ровно size байт
+     * @param data буфер; его размер устанавливается равным size
+     * @return false если соединение закрыто
+     */
+    bool readBody(std::string& data, size_t size)
+    {
+        data.resize(size);
+        auto buffered = std::min(size, m_end - m_begin);
+        std::memcpy(data.data(), m_buffer + m_begin, buffered);
+        m_begin += buffered;
+        return readExact(m_fd, data.data() + buffered, size - buffered);
+    }
+
+private:
+    bool fill()
+    {
+        for (;;) {
+            auto res = ::recv(m_fd, m_buffer, sizeof(m_buffer), 0);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                return false;
+            m_end = static_cast<size_t>(res);
+            return true;
+        }
+    }
+
+private:
+    int m_fd;
+    char m_buffer[4096];
+    size_t m_begin = 0;
+    size_t m_end = 0;
+};
+
+/**
+ * @brief Обработчик push_parser, принимающий одно значение - искомое значение запроса query
+ */
+class query_value {
+public:
+    const char* onNull() { return NOT_SCALAR; }
+    const char* onInteger(int value, std::string_view) { return set(value); }
+    const char* onDouble(double value, std::string_view) { return set(value); }
+    const char* onString(std::string_view value) { return set(std::string(value)); }
+    const char* onKey(std::string_view) { return NOT_SCALAR; }
+    const char* onStartObject() { return NOT_SCALAR; }
+    const char* onEndObject() { return NOT_SCALAR; }
+    const char* onStartArray() { return NOT_SCALAR; }
+    const char* onEndArray() { return NOT_SCALAR; }
+
+    /// искомое значение; std::monostate - значение ещё не разобрано
+    std::variant<std::monostate, std::string, int, double> value;
+
+private:
+    static constexpr const char* NOT_SCALAR = "must be a string or a number";
+
+    template <typename T>
+    const char* set(T&& arg)
+    {
+        value = std::forward<T>(arg);
+        return nullptr;
+    }
+};
+
+/**
+ * @brief Строит дерево из тела запроса
+ * @param body JSON-документ дерева
+ * @param strict считать посторонние ключи ошибкой
+ * @param keepNumberText сохранять исходный текст чисел
+ * @param output буфер для описания ошибки
+ * @return дерево или std::nullopt, если документ некорректен
+ */
+std::optional<tree> parseTree(std::string_view body, bool strict, bool keepNumberText, std::string& output)
+{
+    // Некорректный документ отвергается без исключений: при потоке ошибочных запросов
+    // отказ не должен стоить дороже разбора
+    tree_builder builder(strict, keepNumberText);
+    json::push_parser<tree_builder> parser(builder);
+    parser.feed(body);
+    if (!parser.finish()) {
+        auto res = parser.result();
+        output = "In line " + std::to_string(res.line) + ", column " + std::to_string(res.column) + ": "
+            + res.message;
+        return std::nullopt;
+    }
+    return builder.take();
+}
+} // end of anonymous namespace
+
+server::server(std::string socketPath)
+    : server(std::move(socketPath), limits())
+{
+}
+
+server::server(std::string socketPath, limits bounds)
+    : m_socketPath(std::move(socketPath))
+    , m_limits(bounds)
+{
+    if (m_limits.connections == 0)
+        m_limits.connections = std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool server::process(std::string_view header, std::string_view body, std::string& output)
+{
+    std::istringstream words { std::string(header) };
+    std::string command, flag;
+    words >> command;
+    bool strict = false, keepNumberText = false;
+    while (words >> flag) {
+        if (flag == "strict")
+            strict = true;
+        else if (flag == "keep-number-text")
+            keepNumberText = true;
+        else {
+            output = "unknown flag '" + flag + "'";
+            return false;
+        }
+    }
+
+    output.clear();
+    if (command == "validate") {
+        auto res = validator::validate(body);
+        if (!res.valid) {
+            output = std::string(res.message) + " at line " + std::to_string(res.line) + ", column "
+                + std::to_string(res.column) + " (offset " + std::to_string(res.offset) + ")";
+            return false;
+        }
+        output = "valid: " + std::to_string(res.nodes) + " nodes, depth " + std::to_string(res.depth) + "\n";
+        return true;
+    }
+
+    if (command == "query")
+        return query(body, strict, output);
+
+    if (command != "print" && command != "convert" && command != "stats") {
+        output = "unknown command '" + command + "'";
+        return false;
+    }
+
+    auto tree = parseTree(body, strict, keepNumberText, output);
+    if (!tree)
+        return false;
+
+    if (command == "convert") {
+        tree->serialize([&](std::string chunk) { output += chunk; });
+        return true;
+    }
+
+    std::ostringstream os;
+    if (command == "print")
+        application::printTree(os, *tree);
+    else
+        os << tree_stats::collect(*tree, false);
+    output = os.str();
+    return true;
+}
+
+bool server::query(std::string_view body, bool strict, std::string& output)
+{
+    auto lineEnd = body.find('\n');
+    if (lineEnd == std::string_view::npos) {
+        output = "query value is missing";
+        return false;
+    }
+
+    query_value handler;
+    json::push_parser<query_value> valueParser(handler);
+    valueParser.feed(body.substr(0, lineEnd));
+    if (!valueParser.finish()) {
+        output = std::string("query value: ") + valueParser.message();
+        return false;
+    }
+
+    auto tree = parseTree(body.substr(lineEnd + 1), strict, false, output);
+    if (!tree)
+        return false;
+
+    // Индексы строятся на каждый запрос: дерево приходит в запросе и живёт только во время него
+    auto index = tree_index::build(*tree);
+    auto ids = std::visit(overloaded {
+                              [](std::monostate) { return tree_index::ids(); },
+                              [&](const std::string& arg) { return index.find(std::string_view(arg)); },
+                              [&](auto arg) { return index.find(arg); } },
+        handler.value);
+
+    output = "found: " + std::to_string(ids.size()) + " nodes";
+    if (!ids.empty()) {
+        // Номера отсортированы, а общий предок узлов - общий предок первого и последнего из них
+        auto ancestry = tree_ancestry::build(*tree);
+        output += ", common ancestor " + std::to_string(ancestry.lca(*ids.begin(), *(ids.end() - 1)));
+        output += '\n';
+        for (auto id : ids) {
+            output += std::to_string(id);
+            output += " depth ";
+            output += std::to_string(ancestry.depth(id));
+            output += '\n';
+        }
+    } else {
+        output += '\n';
+    }
+    return true;
+}
+
+void server::work()
+{
+    for (;;) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&]() { return m_stopping || !m_pending.empty(); });
+            if (m_stopping)
+                return;
+            fd = m_pending.front();
+            m_pending.pop_front();
+            m_clients.insert(fd);
+        }
+        // Место в очереди освободилось: принимающий поток может взять следующее соединение
+        m_cv.notify_all();
+        serve(fd);
+    }
+}
+
+void server::serve(int fd)
+{
+    // Чтение, не получившее данных за время ожидания, завершается ошибкой, и соединение закрывается
+    if (m_limits.idleTimeout.count() > 0) {
+        timeval timeout {};
+        timeout.tv_sec = static_cast<time_t>(m_limits.idleTimeout.count());
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    // Буферы соединения живут всё время соединения и переиспользуются между запросами
+    connection_reader reader(fd);
+    std::string line, body, output, response;
+
+    try {
+        while (reader.readLine(line)) {
+            // Длина тела - второе слово заголовка, остальное передаётся в process
+            auto commandEnd = line.find(' ');
+            auto lengthEnd = line.find(' ', commandEnd == std::string::npos ? line.size() : commandEnd + 1);
+            unsigned long long length = 0;
+            bool valid = commandEnd != std::string::npos;
+            output = "invalid request header";
+            if (valid) {
+                auto lengthText = line.substr(commandEnd + 1, lengthEnd == std::string::npos ? std::string::npos : lengthEnd - commandEnd - 1);
+                char* end = nullptr;
+                length = std::strtoull(lengthText.c_str(), &end, 10);
+                valid = !lengthText.empty() && *end == '\0' && lengthText[0] != '-';
+            }
+            if (valid && length > m_limits.maxBodySize) {
+                valid = false;
+                output = "request body is too large, limit is " + std::to_string(m_limits.maxBodySize) + " bytes";
+            }
+            if (!valid) {
+                // Тело не читается, поэтому граница следующего запроса неизвестна и соединение закрывается
+                writeAll(fd, "ERROR " + std::to_string(output.size()) + "\n" + output);
+                break;
+            }
+            if (!reader.readBody(body, static_cast<size_t>(length)))
+                break;
+
+            auto header = line.erase(commandEnd, lengthEnd == std::string::npos ? std::string::npos : lengthEnd - commandEnd);
+            bool ok = false;
+            try {
+                ok = process(header, body, output);
+            } catch (const std::exception& e) {
+                output = e.what();
+            }
+
+            response.assign(ok ? "OK " : "ERROR ");
+            response.append(std::to_string(output.size()));
+            response.push_back('\n');
+            response.append(output);
+            if (!writeAll(fd, response))
+                break;
+        }
+    } catch (const std::exception&) {
+        // Нехватка памяти под буферы одного соединения не должна останавливать сервер
+    }
+
+    // Номер закрытого сокета может сразу достаться новому соединению, поэтому он забывается до закрытия
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_clients.erase(fd);
+    ::close(fd);
+}
+
+int server::run()
+{
+    sockaddr_un addr {};
+    if (m_socketPath.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path is too long: '" + m_socketPath + "'");
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, m_socketPath.c_str(), m_socketPath.size() + 1);
+
+    auto listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0)
+        throw std::runtime_error(std::string("Can't create socket: ") + std::strerror(errno));
+    ::unlink(m_socketPath.c_str());
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0
+        || ::listen(listener, SOMAXCONN) < 0) {
+        auto error = std::string(std::strerror(errno));
+        ::close(listener);
+        throw std::runtime_error("Can't listen on '" + m_socketPath + "': " + error);
+    }
+
+    g_stopRequested = false;
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+    m_stopping = false;
+    m_workers.reserve(m_limits.connections);
+    for (size_t i = 0; i < m_limits.connections; ++i)
+        m_workers.emplace_back(&server::work, this);
+    std::cerr << "listening on " << m_socketPath << std::endl;
+
+    // Ожидание с таймаутом позволяет заметить сигнал, не прерывая accept из обработчика.
+    // Соединение принимается, только когда в очереди есть место, иначе клиент ждёт в очереди сокета
+    pollfd pfd { listener, POLLIN, 0 };
+    while (!g_stopRequested) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_cv.wait_for(lock, std::chrono::milliseconds(100),
+                    [&]() { return m_pending.size() < m_limits.connections; }))
+                continue;
+        }
+        auto ready = ::poll(&pfd, 1, 100);
+        if (ready <= 0)
+            continue;
+        auto client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.push_back(client);
+        }
+        m_cv.notify_all();
+    }
+
+    ::close(listener);
+    ::unlink(m_socketPath.c_str());
+
+    // Соединения из очереди закрываются сразу, а ожидание запросов в открытых прерывается
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        for (auto fd : m_pending)
+            ::close(fd);
+        m_pending.clear();
+        for (auto fd : m_clients)
+            ::shutdown(fd, SHUT_RDWR);
+    }
+    m_cv.notify_all();
+    for (auto& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+    return 0;
+}
@@ -0,0 +1,129 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @class server
+ * @brief Резидентный режим: обработка запросов локальных клиентов через Unix-сокет.
+ * @remarks Процесс запускается один раз, поэтому затраты на старт, загрузку библиотек
+ * и инициализацию парсера не повторяются для каждого дерева.
+ *
+ * Соединения обслуживаются постоянным набором потоков; соединение может передать сколько
+ * угодно запросов подряд, а его буферы переиспользуются между запросами. Принятые соединения
+ * ждут свободного потока в ограниченной очереди; пока она заполнена, новые соединения
+ * не принимаются и остаются в очереди сокета. Соединение, от которого дольше limits::idleTimeout
+ * не приходит ни байта, закрывается, чтобы простаивающий клиент не занимал поток.
+ * Запрос - строка заголовка
+ * @code
+ * <команда> <длина тела>[ strict][ keep-number-text]\n<тело>
+ * @endcode
+ * где тело - JSON-документ дерева. Ответ имеет вид "OK <длина>\n<данные>"
+ * либо "ERROR <длина>\n<описание ошибки>". Команды:
+ * - validate - проверить дерево, не строя его ("valid: N nodes, depth D");
+ * - print - текст, который "шаг 2" печатает в консоль;
+ * - convert - текст, который "шаг 3" сохраняет в выходной файл;
+ * - stats - статистика по узлам, как в режиме --stats-only;
+ * - query - найти узлы со значением. Первая строка тела - искомое значение в синтаксисе JSON
+ *   (строка или число), остальное - дерево. Ответ - строка "found: N nodes[, common ancestor A]"
+ *   и по строке "<номер> depth <глубина>" на каждый найденный узел; узлы обозначаются номерами
+ *   в прямом порядке обхода, как в tree_index и tree_ancestry.
+ *
+ * Работа завершается по SIGINT или SIGTERM; файл сокета при этом удаляется.
+ */
+class server {
+public:
+    /// Наибольший размер тела запроса по умолчанию
+    static constexpr size_t DEFAULT_MAX_BODY_SIZE = size_t(64) << 20;
+    /// Время ожидания данных от клиента по умолчанию
+    static constexpr std::chrono::seconds DEFAULT_IDLE_TIMEOUT { 10 };
+
+    /// Ограничения сервера
+    struct limits {
+        /// количество потоков, обслуживающих соединения; 0 - по числу ядер
+        size_t connections = 0;
+        /// наибольший допустимый размер тела запроса
+        size_t maxBodySize = DEFAULT_MAX_BODY_SIZE;
+        /// сколько ждать данных от клиента до закрытия соединения, между запросами и внутри запроса; 0 - без ограничения
+        std::chrono::seconds idleTimeout = DEFAULT_IDLE_TIMEOUT;
+    };
+
+    /**
+     * @brief Конструирует сервер с ограничениями по умолчанию
+     * @param socketPath путь к Unix-сокету; существующий файл сокета заменяется
+     */
+    explicit server(std::string socketPath);
+
+    /**
+     * @brief Конструирует сервер
+     * @param socketPath путь к Unix-сокету; существующий файл сокета заменяется
+     * @param bounds ограничения сервера
+     */
+    server(std::string socketPath, limits bounds);
+
+    server(const server&) = delete;
+    server& operator=(const server&) = delete;
+
+    /**
+     * @brief Принимает соединения до получения SIGINT или SIGTERM
+     * @remarks Перед возвратом закрывает открытые соединения и дожидается потоков, которые их обслуживали
+     * @throw std::runtime_error если сокет не удалось создать
+     * @return 0 если работа завершена сигналом
+     */
+    int run();
+
+    /**
+     * @brief Выполняет один запрос
+     * @param header строка заголовка без длины тела: команда и флаги
+     * @param body тело запроса
+     * @param output буфер для ответа или описания ошибки; прежнее содержимое заменяется
+     * @return false если запрос не выполнен и output содержит описание ошибки
+     */
+    static bool process(std::string_view header, std::string_view body, std::string& output);
+
+private:
+    /**
+     * @brief Тело потока, обслуживающего соединения из очереди
+     */
+    void work();
+
+    /**
+     * @brief Обслуживает соединение до его закрытия клиентом или до истечения времени ожидания данных
+     * @param fd сокет соединения
+     */
+    void serve(int fd);
+
+    /**
+     * @brief Выполняет запрос query
+     * @param body искомое значение и дерево
+     * @param strict считать посторонние ключи ошибкой
+     * @param output буфер для ответа или описания ошибки
+     * @return false если запрос не выполнен
+     */
+    static bool query(std::string_view body, bool strict, std::string& output);
+
+private:
+    std::string m_socketPath;
+    limits m_limits;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    /// принятые соединения, ждущие свободного потока
+    std::deque<int> m_pending;
+    /// соединения, которые обслуживаются сейчас; при остановке они закрываются, чтобы разбудить потоки
+    std::set<int> m_clients;
+    bool m_stopping = false;
+};
+
+#endif // SERVER_H
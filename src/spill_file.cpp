@@ -0,0 +1,134 @@
+#include "spill_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+[[noreturn]] void throwError(const char* what)
+{
+    throw std::runtime_error(std::string("Temporary file: ") + what + ": " + std::strerror(errno));
+}
+} // end of anonymous namespace
+
+spill_file::spill_file(size_t bufferSize)
+    : m_bufferSize(std::max<size_t>(bufferSize, 1))
+{
+    auto path = (std::filesystem::temp_directory_path() / "task2gis-XXXXXX").string();
+    m_fd = ::mkstemp(path.data());
+    if (m_fd < 0)
+        throwError("can't create");
+    ::unlink(path.c_str());
+}
+
+spill_file::~spill_file()
+{
+    ::close(m_fd);
+}
+
+uint64_t spill_file::append(const void* data, size_t size)
+{
+    auto offset = this->size();
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        if (m_buffer.size() == m_bufferSize)
+            flushBuffer();
+        if (m_buffer.capacity() < m_bufferSize)
+            m_buffer.reserve(m_bufferSize);
+        auto part = std::min(size, m_bufferSize - m_buffer.size());
+        m_buffer.insert(m_buffer.end(), bytes, bytes + part);
+        bytes += part;
+        size -= part;
+    }
+    return offset;
+}
+
+void spill_file::write(uint64_t offset, const void* data, size_t size)
+{
+    auto bytes = static_cast<const char*>(data);
+
+    // Часть, попадающая в буфер, перезаписывается в памяти
+    if (offset + size > m_flushed) {
+        auto from = std::max(offset, m_flushed);
+        std::memcpy(m_buffer.data() + (from - m_flushed), bytes + (from - offset), offset + size - from);
+        size = static_cast<size_t>(from - offset);
+    }
+
+    while (size > 0) {
+        auto res = ::pwrite(m_fd, bytes, size, static_cast<off_t>(offset));
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            throwError("can't write");
+        }
+        bytes += res;
+        offset += static_cast<uint64_t>(res);
+        size -= static_cast<size_t>(res);
+    }
+}
+
+void spill_file::read(uint64_t offset, void* data, size_t size) const
+{
+    auto bytes = static_cast<char*>(data);
+
+    if (offset + size > m_flushed) {
+        auto from = std::max(offset, m_flushed);
+        std::memcpy(bytes + (from - offset), m_buffer.data() + (from - m_flushed), offset + size - from);
+        size = static_cast<size_t>(from - offset);
+    }
+
+    while (size > 0) {
+        auto res = ::pread(m_fd, bytes, size, static_cast<off_t>(offset));
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            throwError("can't read");
+        }
+        if (res == 0) {
+            errno = EIO;
+            throwError("unexpected end of file");
+        }
+        bytes += res;
+        offset += static_cast<uint64_t>(res);
+        size -= static_cast<size_t>(res);
+    }
+}
+
+void spill_file::flush()
+{
+    flushBuffer();
+    m_buffer.shrink_to_fit();
+}
+
+void spill_file::flushBuffer()
+{
+    auto flushed = m_flushed;
+    m_flushed += m_buffer.size();
+    write(flushed, m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+}
+
+spill_cursor::spill_cursor(const spill_file& file, size_t windowSize)
+    : m_file(file)
+    , m_window(std::max<size_t>(windowSize, 1))
+{
+}
+
+void spill_cursor::read(uint64_t offset, void* data, size_t size)
+{
+    // Данные больше окна читаются напрямую
+    if (size > m_window.size()) {
+        m_file.read(offset, data, size);
+        return;
+    }
+
+    if (offset < m_start || offset + size > m_start + m_size) {
+        m_start = offset;
+        m_size = static_cast<size_t>(std::min<uint64_t>(m_window.size(), m_file.size() - offset));
+        m_file.read(m_start, m_window.data(), m_size);
+    }
+    std::memcpy(data, m_window.data() + (offset - m_start), size);
+}
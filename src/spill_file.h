@@ -0,0 +1,120 @@
+#ifndef SPILL_FILE_H
+#define SPILL_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class spill_file
+ * @brief Временный файл для выгрузки данных, не помещающихся в память.
+ * @remarks Файл создаётся в каталоге временных файлов (переменная окружения TMPDIR)
+ * и сразу удаляется из файловой системы, поэтому исчезает при любом завершении программы.
+ * Данные дописываются в конец через буфер ограниченного размера; уже записанные байты
+ * можно перезаписать или прочитать по смещению.
+ */
+class spill_file {
+public:
+    /**
+     * @brief Создаёт пустой временный файл
+     * @param bufferSize размер буфера записи
+     * @throw std::runtime_error если файл не удалось создать
+     */
+    explicit spill_file(size_t bufferSize);
+
+    /**
+     * @brief Закрывает и тем самым освобождает файл
+     */
+    ~spill_file();
+
+    spill_file(const spill_file&) = delete;
+    spill_file& operator=(const spill_file&) = delete;
+
+    /**
+     * @brief Дописывает данные в конец файла
+     * @param data данные
+     * @param size размер данных
+     * @throw std::runtime_error если запись не удалась
+     * @return смещение записанных данных
+     */
+    uint64_t append(const void* data, size_t size);
+
+    /**
+     * @brief Перезаписывает ранее дописанные данные
+     * @param offset смещение
+     * @param data данные
+     * @param size размер данных; offset + size не должен превышать размер файла
+     * @throw std::runtime_error если запись не удалась
+     */
+    void write(uint64_t offset, const void* data, size_t size);
+
+    /**
+     * @brief Читает ранее дописанные данные
+     * @param offset смещение
+     * @param data буфер для данных
+     * @param size размер данных; offset + size не должен превышать размер файла
+     * @throw std::runtime_error если чтение не удалось
+     */
+    void read(uint64_t offset, void* data, size_t size) const;
+
+    /**
+     * @brief Сбрасывает буфер записи на диск и освобождает его память
+     * @throw std::runtime_error если запись не удалась
+     */
+    void flush();
+
+    /**
+     * @brief Размер файла вместе с данными в буфере записи
+     */
+    uint64_t size() const noexcept;
+
+private:
+    /**
+     * @brief Сбрасывает буфер записи на диск, сохраняя его память для следующих данных
+     */
+    void flushBuffer();
+
+private:
+    int m_fd = -1;
+    size_t m_bufferSize;
+    /// данные, дописанные после смещения m_flushed и ещё не сброшенные на диск
+    std::vector<char> m_buffer;
+    uint64_t m_flushed = 0;
+};
+
+/**
+ * @class spill_cursor
+ * @brief Чтение временного файла через окно ограниченного размера.
+ * @remarks Рассчитано на чтение по возрастанию смещений, но допускает и произвольный доступ
+ */
+class spill_cursor {
+public:
+    /**
+     * @brief Конструирует курсор
+     * @param file файл
+     * @param windowSize размер окна чтения
+     * @warning время жизни курсора не должно превышать время жизни файла
+     */
+    spill_cursor(const spill_file& file, size_t windowSize);
+
+    /**
+     * @brief Читает данные по смещению
+     * @param offset смещение
+     * @param data буфер для данных
+     * @param size размер данных
+     */
+    void read(uint64_t offset, void* data, size_t size);
+
+private:
+    const spill_file& m_file;
+    std::vector<char> m_window;
+    uint64_t m_start = 0;
+    size_t m_size = 0;
+};
+
+inline uint64_t spill_file::size() const noexcept
+{
+    return m_flushed + m_buffer.size();
+}
+
+#endif // SPILL_FILE_H
@@ -0,0 +1,100 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/// Размер строки кэша: счётчики разных потоков держим в разных строках, чтобы не было ложного разделения
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * @class spsc_queue
+ * @brief Ограниченная очередь без блокировок для одного производителя и одного потребителя.
+ * @remarks Кольцевой буфер размером в степень двойки. Производитель пишет только хвост,
+ * потребитель - только голову, поэтому достаточно пары атомарных счётчиков без CAS.
+ * Каждая сторона кэширует последнее прочитанное значение чужого счётчика и перечитывает его,
+ * только когда очередь по кэшу выглядит полной (пустой).
+ * try_push вызывается только из потока производителя, try_pop - только из потока потребителя.
+ */
+template <typename T>
+class spsc_queue {
+public:
+    /**
+     * @brief Создаёт очередь
+     * @param capacity минимальная вместимость; округляется вверх до степени двойки
+     */
+    explicit spsc_queue(size_t capacity);
+
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    /**
+     * @brief Кладёт элемент в конец очереди
+     * @param value элемент
+     * @return false если очередь заполнена
+     */
+    bool try_push(T value);
+
+    /**
+     * @brief Забирает элемент из начала очереди
+     * @param value элемент
+     * @return false если очередь пуста
+     */
+    bool try_pop(T& value);
+
+private:
+    std::unique_ptr<T[]> m_items;
+    size_t m_mask;
+
+    /// следующий элемент для потребителя
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head { 0 };
+    /// m_tail, прочитанный потребителем
+    size_t m_tailCache = 0;
+
+    /// следующее место для производителя
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail { 0 };
+    /// m_head, прочитанный производителем
+    size_t m_headCache = 0;
+};
+
+template <typename T>
+spsc_queue<T>::spsc_queue(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    m_items.reset(new T[size]);
+    m_mask = size - 1;
+}
+
+template <typename T>
+bool spsc_queue<T>::try_push(T value)
+{
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_headCache > m_mask) {
+        m_headCache = m_head.load(std::memory_order_acquire);
+        if (tail - m_headCache > m_mask)
+            return false;
+    }
+    m_items[tail & m_mask] = std::move(value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool spsc_queue<T>::try_pop(T& value)
+{
+    auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tailCache) {
+        m_tailCache = m_tail.load(std::memory_order_acquire);
+        if (head == m_tailCache)
+            return false;
+    }
+    value = std::move(m_items[head & m_mask]);
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+#endif // SPSC_QUEUE_H
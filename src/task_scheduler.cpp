@@ -0,0 +1,193 @@
+#include "task_scheduler.h"
+#include <algorithm>
+
+namespace {
+/// пул, которому принадлежит текущий рабочий поток
+thread_local task_scheduler* t_scheduler = nullptr;
+/// номер текущего рабочего потока в его пуле
+thread_local size_t t_index = 0;
+
+std::atomic<size_t> g_configuredThreads { 0 };
+} // end of anonymous namespace
+
+task_scheduler::task_scheduler(size_t threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Поток, ожидающий группу задач, сам выполняет задачи, поэтому рабочих потоков на один меньше
+    auto workers = threads - 1;
+    for (size_t i = 0; i < workers + 1; ++i)
+        m_queues.push_back(std::make_unique<queue>());
+    m_workers.reserve(workers);
+    for (size_t i = 0; i < workers; ++i)
+        m_workers.emplace_back(&task_scheduler::run, this, i);
+}
+
+task_scheduler::~task_scheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_sleepCv.notify_all();
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+void task_scheduler::configure(size_t threads)
+{
+    g_configuredThreads = threads;
+}
+
+task_scheduler& task_scheduler::instance()
+{
+    static task_scheduler scheduler(g_configuredThreads.load());
+    return scheduler;
+}
+
+task_scheduler::counters task_scheduler::stats() const noexcept
+{
+    counters ret;
+    ret.tasks = m_tasks.load(std::memory_order_relaxed);
+    ret.steals = m_steals.load(std::memory_order_relaxed);
+    ret.idle = std::chrono::nanoseconds(m_idle.load(std::memory_order_relaxed));
+    return ret;
+}
+
+void task_scheduler::push(task_type task)
+{
+    auto& target = (t_scheduler == this) ? *m_queues[t_index] : *m_queues.back();
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.tasks.push_back(std::move(task));
+    }
+    m_queued.fetch_add(1, std::memory_order_release);
+
+    // Захват мьютекса гарантирует, что засыпающий поток не пропустит уведомление
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_sleepCv.notify_one();
+}
+
+bool task_scheduler::runOne()
+{
+    if (m_queued.load(std::memory_order_acquire) == 0)
+        return false;
+
+    task_type task;
+    auto own = (t_scheduler == this);
+    auto count = m_queues.size();
+    auto self = own ? t_index : count - 1;
+
+    // Свою очередь разбираем с конца: там самые свежие и самые мелкие задачи
+    if (own) {
+        auto& mine = *m_queues[self];
+        std::lock_guard<std::mutex> lock(mine.mutex);
+        if (!mine.tasks.empty()) {
+            task = std::move(mine.tasks.back());
+            mine.tasks.pop_back();
+        }
+    }
+
+    // Чужие очереди и общую очередь разбираем с начала: там самые крупные задачи
+    for (size_t i = 0; !task && i < count; ++i) {
+        auto index = (self + 1 + i) % count;
+        if (own && index == self)
+            continue;
+        auto& other = *m_queues[index];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            if (index != count - 1)
+                m_steals.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!task)
+        return false;
+
+    m_queued.fetch_sub(1, std::memory_order_relaxed);
+    task();
+    m_tasks.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void task_scheduler::block(const std::atomic<size_t>& pending)
+{
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        // Счётчик увеличивается до проверки группы, а завершающая задача читает его после
+        // уменьшения счётчика группы, поэтому уведомление не теряется
+        m_waiting.fetch_add(1);
+        m_sleepCv.wait(lock, [&]() { return pending.load() == 0 || m_queued.load(std::memory_order_acquire) > 0; });
+        m_waiting.fetch_sub(1);
+    }
+    auto idle = std::chrono::steady_clock::now() - start;
+    m_idle.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(idle).count(), std::memory_order_relaxed);
+}
+
+void task_scheduler::notifyWaiters()
+{
+    if (m_waiting.load() == 0)
+        return;
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_sleepCv.notify_all();
+}
+
+void task_scheduler::run(size_t index)
+{
+    t_scheduler = this;
+    t_index = index;
+
+    for (;;) {
+        if (runOne())
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepCv.wait(lock, [&]() { return m_stop || m_queued.load(std::memory_order_acquire) > 0; });
+        auto idle = std::chrono::steady_clock::now() - start;
+        m_idle.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(idle).count(),
+            std::memory_order_relaxed);
+        if (m_stop)
+            return;
+    }
+}
+
+task_group::task_group(task_scheduler& scheduler)
+    : m_scheduler(scheduler)
+{
+}
+
+task_group::~task_group()
+{
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void task_group::wait()
+{
+    unsigned spins = 0;
+    while (m_pending.load(std::memory_order_acquire) > 0) {
+        if (m_scheduler.runOne()) {
+            spins = 0;
+        } else if (++spins < SPIN_COUNT) {
+            std::this_thread::yield();
+        } else {
+            // Оставшиеся задачи группы выполняются другими потоками, и они могут быть долгими
+            m_scheduler.block(m_pending);
+            spins = 0;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    if (m_error) {
+        auto error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,229 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class task_group;
+
+/**
+ * @class task_scheduler
+ * @brief Пул потоков с перехватом задач (work stealing).
+ * @remarks У каждого рабочего потока своя очередь: поток кладёт и берёт свои задачи с конца очереди,
+ * а простаивающие потоки перехватывают задачи из начала чужих очередей. Поток, ожидающий
+ * завершения группы задач (task_group::wait), сам выполняет задачи, поэтому пул на N потоков
+ * создаёт N - 1 рабочих потоков и не перегружает ядра при вложенных fork/join.
+ */
+class task_scheduler {
+public:
+    /// Счётчики работы пула
+    struct counters {
+        /// количество выполненных задач
+        size_t tasks = 0;
+        /// количество задач, перехваченных из чужих очередей
+        size_t steals = 0;
+        /// суммарное время простоя рабочих потоков и потоков, заблокированных в task_group::wait
+        std::chrono::nanoseconds idle { 0 };
+    };
+
+    /**
+     * @brief Создаёт пул
+     * @param threads количество потоков, считая поток, ожидающий задачи; 0 - по числу ядер
+     */
+    explicit task_scheduler(size_t threads = 0);
+
+    /**
+     * @brief Останавливает рабочие потоки
+     * @warning к этому моменту все группы задач должны быть завершены
+     */
+    ~task_scheduler();
+
+    task_scheduler(const task_scheduler&) = delete;
+    task_scheduler& operator=(const task_scheduler&) = delete;
+
+    /**
+     * @brief Задаёт количество потоков общего пула
+     * @remarks Действует, только если вызвана до первого обращения к instance()
+     * @param threads количество потоков; 0 - по числу ядер
+     */
+    static void configure(size_t threads);
+
+    /**
+     * @brief Общий пул, используемый всеми параллельными этапами программы
+     * @return ссылка на общий пул
+     */
+    static task_scheduler& instance();
+
+    /**
+     * @brief Количество потоков пула, считая поток, ожидающий задачи
+     */
+    size_t threads() const noexcept;
+
+    /**
+     * @brief Текущие значения счётчиков
+     */
+    counters stats() const noexcept;
+
+private:
+    friend class task_group;
+
+    typedef std::function<void()> task_type;
+
+    struct queue {
+        std::mutex mutex;
+        std::deque<task_type> tasks;
+    };
+
+    /**
+     * @brief Ставит задачу в очередь текущего рабочего потока или в общую очередь
+     * @param task задача
+     */
+    void push(task_type task);
+
+    /**
+     * @brief Выполняет одну задачу: свою, из общей очереди или перехваченную
+     * @return false если задач не нашлось
+     */
+    bool runOne();
+
+    /**
+     * @brief Блокирует поток, ожидающий группу задач, пока группа не завершится или не появятся задачи
+     * @remarks Время блокировки учитывается как простой
+     * @param pending счётчик незавершённых задач группы
+     */
+    void block(const std::atomic<size_t>& pending);
+
+    /**
+     * @brief Будит потоки, заблокированные в block, после завершения последней задачи группы
+     */
+    void notifyWaiters();
+
+    /**
+     * @brief Тело рабочего потока
+     * @param index номер рабочего потока
+     */
+    void run(size_t index);
+
+private:
+    /// очереди рабочих потоков; последняя - общая очередь для задач из посторонних потоков
+    std::vector<std::unique_ptr<queue>> m_queues;
+    std::vector<std::thread> m_workers;
+
+    std::atomic<size_t> m_queued { 0 };
+    std::atomic<size_t> m_tasks { 0 };
+    std::atomic<size_t> m_steals { 0 };
+    std::atomic<long long> m_idle { 0 };
+    /// количество потоков, заблокированных в block
+    std::atomic<size_t> m_waiting { 0 };
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCv;
+    bool m_stop = false;
+};
+
+/**
+ * @class task_group
+ * @brief Группа задач fork/join поверх task_scheduler.
+ * @remarks wait выполняет задачи пула, пока группа не завершится, поэтому группы можно
+ * вкладывать друг в друга при рекурсивном обходе дерева. Если задач для перехвата нет,
+ * wait после короткого ожидания засыпает до завершения группы или появления новых задач.
+ */
+class task_group {
+public:
+    /**
+     * @brief Создаёт пустую группу
+     * @param scheduler пул, в котором выполняются задачи группы
+     */
+    explicit task_group(task_scheduler& scheduler = task_scheduler::instance());
+
+    /**
+     * @brief Дожидается завершения задач группы
+     */
+    ~task_group();
+
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+
+    /**
+     * @brief Запускает задачу в пуле
+     * @param func функциональный объект без аргументов
+     */
+    template <typename TFunc>
+    void run(TFunc&& func);
+
+    /**
+     * @brief Дожидается завершения всех задач группы, выполняя задачи пула
+     * @throw первое исключение, брошенное задачами группы
+     */
+    void wait();
+
+private:
+    /// сколько раз wait ищет задачи, прежде чем заснуть
+    static constexpr unsigned SPIN_COUNT = 64;
+
+    task_scheduler& m_scheduler;
+    std::atomic<size_t> m_pending { 0 };
+    std::mutex m_errorMutex;
+    std::exception_ptr m_error;
+};
+
+/**
+ * @brief Выполняет две функции параллельно и дожидается обеих
+ * @param first функция, выполняемая в текущем потоке
+ * @param second функция, отдаваемая пулу
+ */
+template <typename TFirst, typename TSecond>
+void fork_join(TFirst&& first, TSecond&& second)
+{
+    task_group group;
+    group.run(std::forward<TSecond>(second));
+    first();
+    group.wait();
+}
+
+/**
+ * @brief Выполняет func(0) ... func(count - 1) задачами общего пула и дожидается всех
+ * @param count количество вызовов
+ * @param func функция от номера вызова
+ */
+template <typename TFunc>
+void parallel_for(size_t count, const TFunc& func)
+{
+    task_group group;
+    for (size_t i = 0; i < count; ++i)
+        group.run([&func, i]() { func(i); });
+    group.wait();
+}
+
+template <typename TFunc>
+void task_group::run(TFunc&& func)
+{
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    m_scheduler.push([this, scheduler = &m_scheduler, func = std::forward<TFunc>(func)]() mutable {
+        try {
+            func();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            if (!m_error)
+                m_error = std::current_exception();
+        }
+        // После последнего уменьшения группа может быть уже разрушена, поэтому пул берётся из копии
+        if (m_pending.fetch_sub(1) == 1)
+            scheduler->notifyWaiters();
+    });
+}
+
+inline size_t task_scheduler::threads() const noexcept
+{
+    return m_workers.size() + 1;
+}
+
+#endif // TASK_SCHEDULER_H
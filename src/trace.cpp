@@ -0,0 +1,156 @@
+#include "trace.h"
+
+#ifdef TASK2GIS_TRACE
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+struct event {
+    const char* name;
+    const char* argName;
+    long long arg;
+    int64_t start;
+    int64_t duration;
+};
+
+/// Интервалы одного потока; переживает поток, чтобы stop мог их сохранить
+struct thread_buffer {
+    unsigned tid;
+    std::mutex mutex;
+    std::vector<event> events;
+};
+
+std::atomic<bool> g_recording { false };
+std::mutex g_mutex;
+std::string g_path;
+std::vector<std::shared_ptr<thread_buffer>> g_buffers;
+
+int64_t now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+thread_buffer& localBuffer()
+{
+    thread_local std::shared_ptr<thread_buffer> buffer = []() {
+        auto ret = std::make_shared<thread_buffer>();
+        std::lock_guard<std::mutex> lock(g_mutex);
+        ret->tid = static_cast<unsigned>(g_buffers.size() + 1);
+        g_buffers.push_back(ret);
+        return ret;
+    }();
+    return *buffer;
+}
+} // end of anonymous namespace
+
+trace::scope::scope(bool active, const char* name, const char* argName, long long arg) noexcept
+    : m_name(name)
+    , m_argName(argName)
+    , m_arg(arg)
+    , m_start((active && g_recording.load(std::memory_order_relaxed)) ? now() : 0)
+{
+}
+
+trace::scope::~scope()
+{
+    if (m_start == 0 || !g_recording.load(std::memory_order_relaxed))
+        return;
+    auto end = now();
+    auto& buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back({ m_name, m_argName, m_arg, m_start, end - m_start });
+}
+
+bool trace::enabled() noexcept
+{
+    return true;
+}
+
+void trace::start(std::string path)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_path = std::move(path);
+    for (auto& buffer : g_buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->events.clear();
+    }
+    g_recording = true;
+}
+
+void trace::stop()
+{
+    g_recording = false;
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_path.empty())
+        return;
+    // Путь сбрасывается сразу, чтобы повторный stop после ошибки ничего не делал
+    auto path = std::move(g_path);
+    g_path.clear();
+    std::ofstream os(std::filesystem::u8path(path), std::ios::binary);
+    if (!os.is_open())
+        throw std::runtime_error("Can't open '" + path + "'");
+
+    // Время - в микросекундах от первого интервала, как того требует формат
+    int64_t origin = INT64_MAX;
+    for (auto& buffer : g_buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        for (const auto& e : buffer->events)
+            origin = std::min(origin, e.start);
+    }
+
+    os << std::fixed << std::setprecision(3);
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (auto& buffer : g_buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        for (const auto& e : buffer->events) {
+            os << (first ? "\n" : ",\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+               << buffer->tid << ",\"ts\":" << (e.start - origin) / 1000.0 << ",\"dur\":" << e.duration / 1000.0;
+            if (e.argName)
+                os << ",\"args\":{\"" << e.argName << "\":" << e.arg << '}';
+            os << '}';
+            first = false;
+        }
+        buffer->events.clear();
+    }
+    os << "\n]}\n";
+    if (!os.flush())
+        throw std::runtime_error("Can't write '" + path + "'");
+}
+#else
+trace::scope::scope(bool, const char* name, const char* argName, long long arg) noexcept
+    : m_name(name)
+    , m_argName(argName)
+    , m_arg(arg)
+    , m_start(0)
+{
+}
+
+trace::scope::~scope()
+{
+}
+
+bool trace::enabled() noexcept
+{
+    return false;
+}
+
+void trace::start(std::string)
+{
+}
+
+void trace::stop()
+{
+}
+#endif
@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @class trace
+ * @brief Запись интервалов выполнения в формате Chrome trace events.
+ * @remarks Интервалы отмечаются макросами TRACE_SCOPE и TRACE_SCOPE_IF и записываются
+ * только в сборке с опцией TASK2GIS_TRACE; в обычной сборке макросы ничего не делают.
+ * Каждый поток копит интервалы в своём буфере, так что запись почти не мешает измеряемой работе.
+ * Полученный файл открывается в chrome://tracing или https://ui.perfetto.dev
+ */
+class trace {
+public:
+    /**
+     * @class scope
+     * @brief Интервал от конструирования до разрушения объекта
+     */
+    class scope {
+    public:
+        /**
+         * @brief Начинает интервал
+         * @param active false чтобы ничего не записывать
+         * @param name имя интервала; строка должна жить до окончания записи
+         * @param argName имя числового аргумента интервала или nullptr
+         * @param arg значение аргумента
+         */
+        explicit scope(bool active, const char* name, const char* argName = nullptr, long long arg = 0) noexcept;
+
+        /**
+         * @brief Завершает интервал и сохраняет его
+         */
+        ~scope();
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        const char* m_name;
+        const char* m_argName;
+        long long m_arg;
+        int64_t m_start;
+    };
+
+    /**
+     * @brief Включена ли запись в текущей сборке?
+     * @return false если программа собрана без TASK2GIS_TRACE
+     */
+    static bool enabled() noexcept;
+
+    /**
+     * @brief Начинает запись интервалов
+     * @param path путь к файлу, в который stop запишет интервалы
+     */
+    static void start(std::string path);
+
+    /**
+     * @brief Завершает запись и сохраняет интервалы всех потоков в файл
+     * @throw std::runtime_error если файл не удалось записать
+     */
+    static void stop();
+};
+
+#ifdef TASK2GIS_TRACE
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+/// Записывает интервал до конца текущей области видимости: TRACE_SCOPE(name[, argName, arg])
+#define TRACE_SCOPE(...) trace::scope TRACE_CONCAT(traceScope, __LINE__)(true, __VA_ARGS__)
+/// Записывает интервал, если выполнено условие: TRACE_SCOPE_IF(cond, name[, argName, arg])
+#define TRACE_SCOPE_IF(cond, ...) trace::scope TRACE_CONCAT(traceScope, __LINE__)((cond), __VA_ARGS__)
+#else
+#define TRACE_SCOPE(...) ((void)0)
+#define TRACE_SCOPE_IF(cond, ...) ((void)0)
+#endif
+
+#endif // TRACE_H
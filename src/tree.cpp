@@ -1,8 +1,14 @@
 #include "tree.h"
+#include "trace.h"
+#include "json/binary_writer.h"
+#include "json/detail/escape.h"
 #include "json/value.h"
 #include <algorithm>
 #include <boost/range/adaptors.hpp>
-#include <optional>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <type_traits>
 
 tree::tree(int value, std::vector<tree> childs) noexcept
     : m_node(std::move(value))
@@ -22,32 +28,211 @@ tree::tree(std::string value, std::vector<tree> childs) noexcept
 {
 }
 
+tree::tree(const tree& other)
+    : m_node(other.m_node)
+    , m_subnodes(other.m_subnodes)
+    , m_extra(other.m_extra ? std::make_unique<extra>(*other.m_extra) : nullptr)
+{
+}
+
+tree& tree::operator=(const tree& other)
+{
+    if (this != &other)
+        *this = tree(other);
+    return *this;
+}
+
+void tree::setNumberText(std::string text)
+{
+    if (!text.empty() && !std::holds_alternative<std::string>(m_node)) {
+        // Запись числа короче буфера короткой строки, поэтому сравнение обходится без выделений
+        std::string formatted;
+        appendValue(formatted, m_node, std::string_view());
+        if (formatted == text)
+            text.clear();
+    }
+
+    if (!text.empty()) {
+        if (!m_extra)
+            m_extra = std::make_unique<extra>();
+        m_extra->numberText = std::move(text);
+    } else if (m_extra) {
+        m_extra->numberText.clear();
+    }
+}
+
 tree tree::parse(const json::value& root)
 {
-    auto output = std::optional<tree> {};
-    const auto& value = root.at(NODE_FN);
-    if (value.is_double())
-        output = tree { value.as_double() };
-    else if (value.is_integer())
-        output = tree { value.as_integer() };
-    else if (value.is_string())
-        output = tree { value.as_string() };
-    else {
+    TRACE_SCOPE("tree::parse");
+    return parseImpl(root);
+}
+
+tree tree::parse(json::value&& root)
+{
+    TRACE_SCOPE("tree::parse");
+    return parseImpl(root);
+}
+
+template <typename TValue>
+tree tree::parseImpl(TValue& root)
+{
+    auto& value = root.at(NODE_FN);
+    auto output = [&]() {
+        if (value.is_double())
+            return tree { value.as_double() };
+        else if (value.is_integer())
+            return tree { value.as_integer() };
+        else if (value.is_string()) {
+            // Строку из перемещаемого JSON-значения забираем без копирования
+            if constexpr (std::is_const_v<TValue>)
+                return tree { value.as_string() };
+            else
+                return tree { std::move(value.as_string()) };
+        }
         throw tree_exception("can't parse tree");
-    }
+    }();
+    output.setNumberText(value.number_text());
 
     if (root.has_field(SUBNODES_FN)) {
-        const auto& childs = root.at(SUBNODES_FN).as_array();
-        output->childs().reserve(childs.size());
+        auto& childs = root.at(SUBNODES_FN).as_array();
+        output.m_subnodes.reserve(childs.size());
         std::transform(childs.begin(), childs.end(), ///
-            std::back_inserter(output->childs()), &tree::parse);
+            std::back_inserter(output.m_subnodes), &tree::parseImpl<TValue>);
     }
 
-    return output.value();
+    return output;
+}
+
+void tree::serialize(json::binary_writer& writer) const
+{
+    TRACE_SCOPE("tree::serialize(binary)");
+    // Количество элементов записывается в заголовке контейнера, поэтому закрывать контейнеры
+    // не нужно и узлы пишутся в прямом порядке обхода
+    for (const auto& node : preorder()) {
+        const auto& childs = node.m_subnodes;
+        writer.start_object(childs.empty() ? 1 : 2);
+        writer.write_string(NODE_KEY);
+        if (auto str = std::get_if<std::string>(&node.m_node))
+            writer.write_string(*str);
+        else if (auto integer = std::get_if<int>(&node.m_node))
+            writer.write_integer(*integer);
+        else
+            writer.write_double(std::get<double>(node.m_node));
+        if (!childs.empty()) {
+            writer.write_string(SUBNODES_KEY);
+            writer.start_array(childs.size());
+        }
+    }
+}
+
+void tree::serialize(const std::function<void(std::string)>& sink, size_t chunkSize) const
+{
+    TRACE_SCOPE("tree::serialize(stream)");
+    struct frame {
+        const tree* node;
+        unsigned level;
+        size_t next;
+    };
+
+    std::string out;
+    out.reserve(chunkSize + chunkSize / 8);
+    auto indent = [&](unsigned count) { out.append(count, ' '); };
+    auto flush = [&]() {
+        if (out.size() >= chunkSize) {
+            sink(std::move(out));
+            out = std::string();
+            out.reserve(chunkSize + chunkSize / 8);
+        }
+    };
+
+    // Раскладка текста совпадает с json::value::serialize: узел уровня level - объект уровня 2 * level,
+    // его массив subnodes - уровня 2 * level + 1
+    auto open = [&](const tree& node, unsigned level) {
+        indent(level * 2);
+        out += "{\n";
+        indent(level * 2 + 1);
+        out += '"';
+        out += NODE_KEY;
+        out += "\" : ";
+        appendValue(out, node.m_node, node.numberText());
+        if (node.m_subnodes.empty()) {
+            out += '\n';
+        } else {
+            out += ",\n";
+            indent(level * 2 + 1);
+            out += '"';
+            out += SUBNODES_KEY;
+            out += "\" : [\n";
+        }
+    };
+
+    std::vector<frame> stack;
+    open(*this, 0);
+    stack.push_back({ this, 0, 0 });
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        const auto& childs = top.node->m_subnodes;
+        if (top.next < childs.size()) {
+            const auto& child = childs[top.next++];
+            open(child, top.level + 1);
+            stack.push_back({ &child, top.level + 1, 0 });
+            flush();
+            continue;
+        }
+
+        auto level = top.level;
+        if (!childs.empty()) {
+            indent(level * 2 + 1);
+            out += "]\n";
+        }
+        indent(level * 2);
+        out += '}';
+        stack.pop_back();
+        if (!stack.empty()) {
+            const auto& parent = stack.back();
+            out += (parent.next == parent.node->m_subnodes.size()) ? "\n" : ",\n";
+        }
+        flush();
+    }
+    if (!out.empty())
+        sink(std::move(out));
+}
+
+void tree::appendValue(
+    std::string& out, const std::variant<std::string, int, double>& value, std::string_view numberText)
+{
+    if (!numberText.empty()) {
+        out += numberText;
+    } else if (auto str = std::get_if<std::string>(&value)) {
+        appendValue(out, *str);
+    } else if (auto integer = std::get_if<int>(&value)) {
+        char buffer[16];
+        auto res = std::to_chars(buffer, buffer + sizeof(buffer), *integer);
+        out.append(buffer, res.ptr);
+    } else {
+        auto number = std::get<double>(value);
+        if (std::isnan(number)) {
+            out += "NaN";
+        } else if (std::isinf(number)) {
+            out += (number < 0.0) ? "-Infinity" : "Infinity";
+        } else {
+            // Формат "%g" совпадает с выводом double в std::ostream по умолчанию
+            char buffer[32];
+            auto size = std::snprintf(buffer, sizeof(buffer), "%g", number);
+            out.append(buffer, static_cast<size_t>(size));
+        }
+    }
+}
+
+void tree::appendValue(std::string& out, std::string_view value)
+{
+    detail::escape(value, out);
 }
 
 json::value tree::serialize() const
 {
+    // Листья не отмечаются, иначе интервалов было бы столько же, сколько узлов
+    TRACE_SCOPE_IF(!m_subnodes.empty(), "tree::serialize", "childs", static_cast<long long>(m_subnodes.size()));
     auto output = json::value::object();
 
     std::visit(overloaded {
@@ -55,18 +240,24 @@ json::value tree::serialize() const
                        output[NODE_FN] = json::value::string(arg);
                    },
                    [&](int arg) {
-                       output[NODE_FN] = json::value::number(arg);
+                       output[NODE_FN] = numberText().empty()
+                           ? json::value::number(arg)
+                           : json::value::number(arg, numberText());
                    },
                    [&](double arg) {
-                       output[NODE_FN] = json::value::number(arg);
+                       output[NODE_FN] = numberText().empty()
+                           ? json::value::number(arg)
+                           : json::value::number(arg, numberText());
                    } },
         m_node);
 
-    for (const auto& sub : m_subnodes | boost::adaptors::indexed(0)) {
-        if (!output.has_field(SUBNODES_FN))
-            output[SUBNODES_FN] = json::value::array(m_subnodes.size());
-        auto& childs = output[SUBNODES_FN];
-        childs.at(sub.index()) = sub.value().serialize();
+    if (!m_subnodes.empty()) {
+        // Поле массива ищется один раз, а не на каждой итерации по дочерним элементам
+        auto& field = output[SUBNODES_FN];
+        field = json::value::array(m_subnodes.size());
+        auto& childs = field.as_array();
+        for (const auto& sub : m_subnodes | boost::adaptors::indexed(0))
+            childs.at(sub.index()) = sub.value().serialize();
     }
 
     return output;
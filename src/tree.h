@@ -1,14 +1,29 @@
 #ifndef TREE_H
 #define TREE_H
 
+#include "task_scheduler.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace json {
 class value;
+class binary_writer;
 } // end of namespace json
 
+class tree_preorder_iterator;
+class tree_postorder_iterator;
+class tree_levelorder_iterator;
+template <typename TIterator>
+class tree_range;
+
 /**
  * @class tree_exception
  */
@@ -35,6 +50,17 @@ public:
  */
 class tree {
 public:
+    /// Размер блока текста при потоковой сериализации по умолчанию
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+    /// Способ обхода дерева в reduce
+    enum class policy {
+        /// обход в одном потоке
+        Sequential,
+        /// обход с разбиением поддеревьев и больших контейнеров дочерних элементов между задачами общего пула task_scheduler
+        Parallel
+    };
+
     /**
      * @brief Конструирует дерево с целочисленным значением в корневом элементе
      * @param value целочисленное значение
@@ -56,6 +82,12 @@ public:
      */
     explicit tree(std::string value, std::vector<tree> childs = {}) noexcept;
 
+    tree(const tree& other);
+    tree(tree&&) noexcept = default;
+    tree& operator=(const tree& other);
+    tree& operator=(tree&&) noexcept = default;
+    ~tree() = default;
+
     /**
      * @brief Хранит ли корневой узел целочисленное значение?
      * @return false если не хранит
@@ -91,9 +123,19 @@ public:
     /**
      * @brief Возвращает хранимую в корневом узле строку
      * @throw std::bad_variant_access если узел хранит значение другого типа
-     * @return строка
+     * @remarks Возвращенная ссылка должна иметь такое же или меньшее время жизни, как this
+     * @return ссылка на строку
+     */
+    const std::string& asString() const;
+
+    /**
+     * @brief Возвращает исходный текст числа в корневом узле, если он был сохранён при загрузке
+     * @remarks Текст сохраняется только по запросу (см. tree_builder) и выводится при сериализации
+     * вместо повторного форматирования числа. Узел, созданный заново, текста не имеет; не имеет его
+     * и число, текст которого совпадает с записью значения
+     * @return исходный текст числа или пустая строка
      */
-    std::string asString() const;
+    const std::string& numberText() const noexcept;
 
     /**
      * @brief выполняет парсинг JSON-значения в дерево.
@@ -103,12 +145,55 @@ public:
      */
     static tree parse(const json::value& root);
 
+    /**
+     * @brief выполняет парсинг JSON-значения в дерево, забирая строки из root перемещением.
+     * @param root JSON-значение, которое больше не понадобится вызывающей стороне
+     * @throw tree_exception если парсинг не удался
+     * @return Созданный из парсинга JSON-значения экземпляр
+     */
+    static tree parse(json::value&& root);
+
     /**
      * @brief Выполняет сериализацию дерева в JSON-значение
      * @return JSON-значение
      */
     json::value serialize() const;
 
+    /**
+     * @brief Выполняет сериализацию дерева в JSON, передавая текст блоками по мере готовности
+     * @remarks Текст совпадает с tree::serialize().serialize(), но строится напрямую
+     * из узлов без рекурсии, а в памяти одновременно находится не больше одного блока
+     * @param sink приёмник блоков текста
+     * @param chunkSize размер блока, после которого текст передаётся приёмнику
+     */
+    void serialize(const std::function<void(std::string)>& sink, size_t chunkSize = DEFAULT_CHUNK_SIZE) const;
+
+    /**
+     * @brief Кодирует дерево в MessagePack или CBOR
+     * @remarks Узел записывается как объект с теми же полями, что и в JSON. Дерево обходится
+     * без рекурсии и без промежуточного JSON-значения; исходный текст чисел не записывается
+     * @param writer кодировщик
+     */
+    void serialize(json::binary_writer& writer) const;
+
+    /**
+     * @brief Дописывает значение узла в том виде, в каком оно записывается в JSON-текст дерева
+     * @remarks Общий формат значений для всех путей записи текста: tree::serialize,
+     * node_event_writer и external_tree. Числа записываются так же, как их записывает detail::generator
+     * @param out текст
+     * @param value значение узла
+     * @param numberText исходный текст числа; если не пуст, записывается вместо значения
+     */
+    static void appendValue(std::string& out, const std::variant<std::string, int, double>& value,
+        std::string_view numberText);
+
+    /**
+     * @brief Дописывает строковое значение узла в том виде, в каком оно записывается в JSON-текст дерева
+     * @param out текст
+     * @param value строка
+     */
+    static void appendValue(std::string& out, std::string_view value);
+
     /**
      * @brief Возвращает ссылку на контейнер дочерних элементов дерева
      * @return ссылка на контейнер дочерних элементов
@@ -121,12 +206,102 @@ public:
      */
     const std::vector<tree>& childs() const noexcept;
 
+    /**
+     * @brief Диапазон прямого обхода дерева (узел перед дочерними элементами)
+     * @remarks Итераторы диапазона сообщают глубину и родителя текущего узла
+     * @return диапазон обхода, совместимый с алгоритмами стандартной библиотеки
+     */
+    tree_range<tree_preorder_iterator> preorder() const;
+
+    /**
+     * @brief Диапазон обратного обхода дерева (узел после дочерних элементов)
+     * @remarks Итераторы диапазона сообщают глубину и родителя текущего узла
+     * @return диапазон обхода, совместимый с алгоритмами стандартной библиотеки
+     */
+    tree_range<tree_postorder_iterator> postorder() const;
+
+    /**
+     * @brief Диапазон обхода дерева в ширину (по уровням)
+     * @remarks Итераторы диапазона сообщают глубину и родителя текущего узла
+     * @return диапазон обхода, совместимый с алгоритмами стандартной библиотеки
+     */
+    tree_range<tree_levelorder_iterator> levelorder() const;
+
+    /**
+     * @brief Сворачивает все узлы дерева в одно значение
+     * @remarks visit вызывается для каждого узла как visit(T acc, const tree& node, unsigned level)
+     * и возвращает новое значение аккумулятора; level корневого узла равен 0.
+     * combine объединяет аккумуляторы независимо обработанных частей дерева как combine(T a, T b).
+     * При последовательном обходе узлы посещаются в прямом порядке, без рекурсии.
+     * При параллельном обходе каждая часть начинается с init, поэтому init должен быть нейтральным
+     * элементом combine, а combine - ассоциативной операцией; части объединяются слева направо.
+     * visit и combine при параллельном обходе вызываются из нескольких потоков одновременно.
+     * @param init начальное значение аккумулятора
+     * @param visit функция посещения узла
+     * @param combine функция объединения аккумуляторов
+     * @param how способ обхода
+     * @return итоговое значение аккумулятора
+     */
+    template <typename T, typename TVisit, typename TCombine>
+    T reduce(T init, TVisit visit, TCombine combine, policy how = policy::Sequential) const;
+
 private:
-    static inline const std::string NODE_FN = "node";
-    static inline const std::string SUBNODES_FN = "subnodes";
+    /**
+     * @brief Последовательно сворачивает поддеревья диапазона дочерних элементов
+     * @param first первое поддерево
+     * @param last запредельное поддерево
+     * @param level глубина поддеревьев диапазона
+     */
+    template <typename T, typename TVisit>
+    static T reduceRange(T acc, const tree* first, const tree* last, unsigned level, TVisit& visit);
+
+    /**
+     * @brief Параллельно сворачивает поддеревья диапазона дочерних элементов
+     * @param budget на сколько задач ещё можно разбить работу
+     */
+    template <typename T, typename TVisit, typename TCombine>
+    static T reduceParallel(const T& init, const tree* first, const tree* last, unsigned level,
+        TVisit& visit, TCombine& combine, size_t budget);
+
+    /**
+     * @brief Общая реализация parse для константного и перемещаемого JSON-значения
+     * @param root JSON-значение
+     * @return Созданный из парсинга JSON-значения экземпляр
+     */
+    template <typename TValue>
+    static tree parseImpl(TValue& root);
+
+    /**
+     * @brief Запоминает исходный текст числа
+     * @remarks Вызывается после того, как значение узла задано. Текст, совпадающий с записью значения
+     * (см. appendValue), не хранится: вывод от него не изменится. Поэтому сведения узла вне основной
+     * записи создаются только для чисел, записанных иначе, например "1.50" или "1e3"
+     * @param text исходный текст числа
+     */
+    void setNumberText(std::string text);
+
+private:
+    friend class tree_builder;
+    friend class external_tree;
+    friend class tree_cache;
+    friend class persistent_tree;
+    friend class node_event_writer;
+
+    static constexpr std::string_view NODE_KEY = "node";
+    static constexpr std::string_view SUBNODES_KEY = "subnodes";
+    static inline const std::string NODE_FN { NODE_KEY };
+    static inline const std::string SUBNODES_FN { SUBNODES_KEY };
+    static inline const std::string NO_TEXT;
+
+    /// Редко нужные сведения об узле; хранятся отдельно, чтобы не увеличивать каждый узел дерева
+    struct extra {
+        /// исходный текст числа
+        std::string numberText;
+    };
 
     std::variant<std::string, int, double> m_node;
     std::vector<tree> m_subnodes;
+    std::unique_ptr<extra> m_extra;
 };
 
 inline bool tree::isInteger() const noexcept
@@ -154,11 +329,16 @@ inline double tree::asDouble() const
     return std::get<double>(m_node);
 }
 
-inline std::string tree::asString() const
+inline const std::string& tree::asString() const
 {
     return std::get<std::string>(m_node);
 }
 
+inline const std::string& tree::numberText() const noexcept
+{
+    return m_extra ? m_extra->numberText : NO_TEXT;
+}
+
 inline std::vector<tree>& tree::childs() noexcept
 {
     return m_subnodes;
@@ -169,4 +349,78 @@ inline const std::vector<tree>& tree::childs() const noexcept
     return m_subnodes;
 }
 
+template <typename T, typename TVisit, typename TCombine>
+T tree::reduce(T init, TVisit visit, TCombine combine, policy how) const
+{
+    if (how == policy::Sequential)
+        return reduceRange(std::move(init), this, this + 1, 0, visit);
+
+    // Задач создаётся с запасом относительно ядер, чтобы сгладить разный размер поддеревьев
+    size_t budget = task_scheduler::instance().threads() * 4;
+    return reduceParallel(init, this, this + 1, 0, visit, combine, budget);
+}
+
+template <typename T, typename TVisit>
+T tree::reduceRange(T acc, const tree* first, const tree* last, unsigned level, TVisit& visit)
+{
+    // Явный стек вместо рекурсии: глубина дерева не ограничена размером стека потока
+    std::vector<std::pair<const tree*, unsigned>> stack;
+    for (auto it = last; it != first;)
+        stack.emplace_back(--it, level);
+
+    while (!stack.empty()) {
+        auto [node, nodeLevel] = stack.back();
+        stack.pop_back();
+        acc = visit(std::move(acc), *node, nodeLevel);
+        const auto& childs = node->m_subnodes;
+        for (auto it = childs.rbegin(); it != childs.rend(); ++it)
+            stack.emplace_back(&*it, nodeLevel + 1);
+    }
+    return acc;
+}
+
+template <typename T, typename TVisit, typename TCombine>
+T tree::reduceParallel(const T& init, const tree* first, const tree* last, unsigned level,
+    TVisit& visit, TCombine& combine, size_t budget)
+{
+    if (budget <= 1)
+        return reduceRange(init, first, last, level, visit);
+
+    // Цепочку единственных поддеревьев проходим в цикле, пока не встретится ветвление
+    auto head = init;
+    auto count = static_cast<size_t>(last - first);
+    while (count == 1) {
+        head = visit(std::move(head), *first, level);
+        const auto& childs = first->m_subnodes;
+        first = childs.data();
+        last = childs.data() + childs.size();
+        count = childs.size();
+        ++level;
+    }
+    if (count == 0)
+        return head;
+
+    // Диапазон делится на группы, каждая группа получает свою долю бюджета
+    auto groups = std::min(budget, count);
+    auto groupBudget = budget / groups;
+    std::vector<std::optional<T>> results(groups - 1);
+    task_group tasks;
+    for (size_t group = 1; group < groups; ++group) {
+        auto groupFirst = first + count * group / groups;
+        auto groupLast = first + count * (group + 1) / groups;
+        tasks.run([&, group, groupFirst, groupLast, level]() {
+            results[group - 1].emplace(
+                reduceParallel(init, groupFirst, groupLast, level, visit, combine, groupBudget));
+        });
+    }
+
+    auto acc = reduceParallel(init, first, first + count / groups, level, visit, combine, groupBudget);
+    tasks.wait();
+    for (auto& result : results)
+        acc = combine(std::move(acc), std::move(*result));
+    return combine(std::move(head), std::move(acc));
+}
+
+#include "tree_iterator.h"
+
 #endif // TREE_H
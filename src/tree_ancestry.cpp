@@ -0,0 +1,117 @@
+#include "tree_ancestry.h"
+#include "trace.h"
+#include <algorithm>
+
+namespace {
+/// Дерево меньшего размера индексируется в одном потоке: задачи обойдутся дороже
+constexpr size_t PARALLEL_THRESHOLD = 1 << 16;
+/// Количество элементов уровня таблицы, обрабатываемых одной задачей
+constexpr size_t CHUNK_SIZE = 1 << 14;
+
+/**
+ * @brief Выполняет func(first, last) для частей диапазона [0, count) в потоках пула или целиком
+ * @param count размер диапазона
+ * @param parallel true чтобы делить диапазон между задачами пула
+ * @param func функция от границ части
+ */
+template <typename TFunc>
+void forChunks(size_t count, bool parallel, const TFunc& func)
+{
+    if (!parallel || count <= CHUNK_SIZE) {
+        func(size_t { 0 }, count);
+        return;
+    }
+    parallel_for((count + CHUNK_SIZE - 1) / CHUNK_SIZE,
+        [&](size_t chunk) { func(chunk * CHUNK_SIZE, std::min(count, (chunk + 1) * CHUNK_SIZE)); });
+}
+} // end of anonymous namespace
+
+tree_ancestry tree_ancestry::build(const tree& root, tree::policy how)
+{
+    TRACE_SCOPE("tree_ancestry::build");
+    tree_ancestry ret;
+
+    // Номера предков текущего узла по глубинам
+    std::vector<uint64_t> path;
+    auto range = root.preorder();
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        auto depth = it.depth();
+        path.resize(depth);
+        ret.m_parents.push_back(path.empty() ? NO_PARENT : path.back());
+        ret.m_depths.push_back(depth);
+        path.push_back(ret.m_parents.size() - 1);
+    }
+
+    // Потомки идут после предков, поэтому размеры собираются одним обратным проходом
+    auto n = ret.m_parents.size();
+    ret.m_sizes.assign(n, 1);
+    for (auto i = n; i-- > 1;)
+        ret.m_sizes[ret.m_parents[i]] += ret.m_sizes[i];
+
+    bool parallel = how == tree::policy::Parallel && task_scheduler::instance().threads() > 1 && n >= PARALLEL_THRESHOLD;
+    auto blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    ret.m_sparse.emplace_back(blocks);
+    forChunks(blocks, parallel, [&](size_t first, size_t last) {
+        for (auto b = first; b < last; ++b) {
+            auto best = b * BLOCK_SIZE;
+            auto end = std::min(n, best + BLOCK_SIZE);
+            for (auto i = best + 1; i < end; ++i)
+                best = ret.shallower(best, i);
+            ret.m_sparse[0][b] = best;
+        }
+    });
+
+    for (size_t span = 1; span * 2 <= blocks; span *= 2) {
+        const auto& prev = ret.m_sparse.back();
+        std::vector<uint64_t> level(blocks - span * 2 + 1);
+        forChunks(level.size(), parallel, [&](size_t first, size_t last) {
+            for (auto b = first; b < last; ++b)
+                level[b] = ret.shallower(prev[b], prev[b + span]);
+        });
+        ret.m_sparse.push_back(std::move(level));
+    }
+    return ret;
+}
+
+uint64_t tree_ancestry::shallowest(uint64_t first, uint64_t last) const noexcept
+{
+    auto firstBlock = first / BLOCK_SIZE;
+    auto lastBlock = last / BLOCK_SIZE;
+    auto best = first;
+    if (firstBlock == lastBlock) {
+        for (auto i = first + 1; i <= last; ++i)
+            best = shallower(best, i);
+        return best;
+    }
+
+    // Неполные крайние блоки просматриваются, полные средние - берутся из таблицы
+    for (auto i = first + 1; i < (firstBlock + 1) * BLOCK_SIZE; ++i)
+        best = shallower(best, i);
+    for (auto i = lastBlock * BLOCK_SIZE; i <= last; ++i)
+        best = shallower(best, i);
+    if (lastBlock - firstBlock > 1) {
+        auto from = firstBlock + 1;
+        auto count = lastBlock - from;
+        // Два перекрывающихся отрезка длины 2^level покрывают count блоков
+        auto level = static_cast<size_t>(63 - __builtin_clzll(count));
+        const auto& table = m_sparse[level];
+        best = shallower(best, table[from]);
+        best = shallower(best, table[lastBlock - (uint64_t { 1 } << level)]);
+    }
+    return best;
+}
+
+uint64_t tree_ancestry::lca(uint64_t a, uint64_t b) const noexcept
+{
+    if (a > b)
+        std::swap(a, b);
+    if (isAncestor(a, b))
+        return a;
+    return m_parents[shallowest(a + 1, b)];
+}
+
+uint64_t tree_ancestry::lca(const std::vector<uint64_t>& ids) const noexcept
+{
+    auto range = std::minmax_element(ids.begin(), ids.end());
+    return lca(*range.first, *range.second);
+}
@@ -0,0 +1,124 @@
+#ifndef TREE_ANCESTRY_H
+#define TREE_ANCESTRY_H
+
+#include "tree.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class tree_ancestry
+ * @brief Индекс структуры дерева для проверки предков, размеров поддеревьев и поиска общего предка.
+ * @remarks Узлы обозначаются номерами в прямом порядке обхода, как в tree_columns и tree_index.
+ * В прямом порядке поддерево узла a занимает номера [a, a + subtreeSize(a)), поэтому проверка
+ * предка - два сравнения. Наименьший общий предок узлов u < v, если u не предок v, - родитель
+ * самого мелкого узла среди номеров (u, v]; его находит запрос минимума глубины: внутри блоков
+ * по BLOCK_SIZE узлов просмотром, между блоками - по разреженной таблице минимумов блоков.
+ * Таблица занимает O(n / BLOCK_SIZE * log n) = O(n) памяти, а запрос выполняется за O(1).
+ * Номера, передаваемые в запросы, должны быть меньше size().
+ */
+class tree_ancestry {
+public:
+    /// Родитель корня
+    static constexpr uint64_t NO_PARENT = UINT64_MAX;
+    /// Количество узлов в блоке запроса минимума
+    static constexpr size_t BLOCK_SIZE = 32;
+
+    /**
+     * @brief Строит индекс за линейное время
+     * @param root корень дерева
+     * @param how Parallel чтобы строить таблицу минимумов во всех потоках пула
+     * @return индекс
+     */
+    static tree_ancestry build(const tree& root, tree::policy how = tree::policy::Parallel);
+
+    /**
+     * @brief Количество узлов
+     */
+    size_t size() const noexcept;
+
+    /**
+     * @brief Является ли узел a предком узла b или самим b?
+     */
+    bool isAncestor(uint64_t a, uint64_t b) const noexcept;
+
+    /**
+     * @brief Количество узлов поддерева, включая его корень
+     */
+    uint64_t subtreeSize(uint64_t a) const noexcept;
+
+    /**
+     * @brief Глубина узла, у корня 0
+     */
+    unsigned depth(uint64_t a) const noexcept;
+
+    /**
+     * @brief Родитель узла, у корня NO_PARENT
+     */
+    uint64_t parent(uint64_t a) const noexcept;
+
+    /**
+     * @brief Наименьший общий предок двух узлов
+     * @return узел; если один узел - предок другого, то он сам
+     */
+    uint64_t lca(uint64_t a, uint64_t b) const noexcept;
+
+    /**
+     * @brief Наименьший общий предок нескольких узлов
+     * @remarks Совпадает с общим предком узлов с наименьшим и наибольшим номером, поэтому
+     * стоит O(k) сравнений и один запрос минимума
+     * @param ids непустой список узлов
+     * @return узел
+     */
+    uint64_t lca(const std::vector<uint64_t>& ids) const noexcept;
+
+private:
+    /**
+     * @brief Узел наименьшей глубины среди номеров [first, last]
+     */
+    uint64_t shallowest(uint64_t first, uint64_t last) const noexcept;
+
+    /**
+     * @brief Более мелкий из двух узлов; при равной глубине - первый
+     */
+    uint64_t shallower(uint64_t a, uint64_t b) const noexcept;
+
+private:
+    std::vector<uint64_t> m_parents;
+    std::vector<uint64_t> m_sizes;
+    std::vector<uint32_t> m_depths;
+    /// m_sparse[k][b] - самый мелкий узел блоков [b, b + 2^k)
+    std::vector<std::vector<uint64_t>> m_sparse;
+};
+
+inline size_t tree_ancestry::size() const noexcept
+{
+    return m_parents.size();
+}
+
+inline bool tree_ancestry::isAncestor(uint64_t a, uint64_t b) const noexcept
+{
+    return a <= b && b - a < m_sizes[a];
+}
+
+inline uint64_t tree_ancestry::subtreeSize(uint64_t a) const noexcept
+{
+    return m_sizes[a];
+}
+
+inline unsigned tree_ancestry::depth(uint64_t a) const noexcept
+{
+    return m_depths[a];
+}
+
+inline uint64_t tree_ancestry::parent(uint64_t a) const noexcept
+{
+    return m_parents[a];
+}
+
+inline uint64_t tree_ancestry::shallower(uint64_t a, uint64_t b) const noexcept
+{
+    return (m_depths[b] < m_depths[a]) ? b : a;
+}
+
+#endif // TREE_ANCESTRY_H
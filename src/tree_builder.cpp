@@ -0,0 +1,205 @@
+#include "tree_builder.h"
+#include "utils.h"
+#include "json/push_parser.h"
+
+tree_builder::tree_builder(bool strict, bool keepNumberText)
+    : m_strict(strict)
+    , m_keepNumberText(keepNumberText)
+{
+    m_frames.reserve(64);
+}
+
+tree tree_builder::take()
+{
+    return std::move(m_root.value());
+}
+
+tree tree_builder::parse(std::string_view text, bool strict)
+{
+    tree_builder builder(strict);
+    json::push_parser<tree_builder> parser(builder);
+    parser.feed(text);
+    parser.finish();
+    parser.check();
+    return builder.take();
+}
+
+json::parse_result tree_builder::parse(std::string_view text, tree& out, bool strict)
+{
+    tree_builder builder(strict);
+    json::push_parser<tree_builder> parser(builder);
+    if (parser.feed(text) && parser.finish())
+        out = builder.take();
+    return parser.result();
+}
+
+template <typename T>
+const char* tree_builder::scalar(T&& value)
+{
+    if (m_skip > 0)
+        return nullptr;
+
+    switch (m_role) {
+    case role::Node:
+        m_frames[m_depth - 1].value = std::forward<T>(value);
+        return nullptr;
+    case role::Tree:
+        return "tree node must be an object";
+    case role::Subnodes:
+        return "subnodes must be an array";
+    case role::Skip:
+        break;
+    }
+    return nullptr;
+}
+
+const char* tree_builder::onNull()
+{
+    if (m_skip == 0 && m_role == role::Node)
+        return "node must be a string or a number";
+    return scalar(std::monostate {});
+}
+
+template <typename T>
+const char* tree_builder::number(T value, std::string_view text)
+{
+    auto error = scalar(value);
+    if (!error && m_skip == 0 && m_role == role::Node) {
+        auto& numberText = m_frames[m_depth - 1].numberText;
+        if (m_keepNumberText && json::is_json_number(text))
+            numberText.assign(text);
+        else
+            numberText.clear();
+    }
+    return error;
+}
+
+const char* tree_builder::onInteger(int value, std::string_view text)
+{
+    return number(value, text);
+}
+
+const char* tree_builder::onDouble(double value, std::string_view text)
+{
+    return number(value, text);
+}
+
+const char* tree_builder::onString(std::string_view value)
+{
+    if (m_skip > 0 || m_role == role::Skip)
+        return nullptr;
+    if (m_role == role::Node)
+        m_frames[m_depth - 1].numberText.clear();
+    return scalar(std::string(value));
+}
+
+const char* tree_builder::onKey(std::string_view key)
+{
+    if (m_skip > 0)
+        return nullptr;
+
+    switch (matchField(key)) {
+    case field::Node:
+        m_role = role::Node;
+        break;
+    case field::Subnodes:
+        m_role = role::Subnodes;
+        break;
+    case field::Unknown:
+        if (m_unknownKeys++ == 0)
+            m_firstUnknownKey.assign(key);
+        if (m_strict)
+            return "unknown key";
+        m_role = role::Skip;
+        break;
+    }
+    return nullptr;
+}
+
+const char* tree_builder::onStartObject()
+{
+    if (m_skip > 0) {
+        ++m_skip;
+        return nullptr;
+    }
+
+    switch (m_role) {
+    case role::Tree:
+        if (m_depth == m_frames.size()) {
+            m_frames.emplace_back();
+        } else {
+            m_frames[m_depth].value = std::monostate {};
+            m_frames[m_depth].numberText.clear();
+            m_frames[m_depth].childs.clear();
+        }
+        ++m_depth;
+        return nullptr;
+    case role::Skip:
+        m_skip = 1;
+        return nullptr;
+    case role::Node:
+        return "node must be a string or a number";
+    case role::Subnodes:
+        return "subnodes must be an array";
+    }
+    return nullptr;
+}
+
+const char* tree_builder::onEndObject()
+{
+    if (m_skip > 0) {
+        --m_skip;
+        return nullptr;
+    }
+
+    auto& top = m_frames[m_depth - 1];
+    auto output = std::visit(overloaded {
+                                 [](std::monostate) { return std::optional<tree> {}; },
+                                 [&](auto& arg) {
+                                     return std::optional<tree> { tree { std::move(arg), std::move(top.childs) } };
+                                 } },
+        top.value);
+    if (!output)
+        return "node not found";
+    output->setNumberText(std::move(top.numberText));
+
+    --m_depth;
+    if (m_depth == 0) {
+        m_root = std::move(output);
+    } else {
+        m_frames[m_depth - 1].childs.push_back(std::move(*output));
+        m_role = role::Tree;
+    }
+    return nullptr;
+}
+
+const char* tree_builder::onStartArray()
+{
+    if (m_skip > 0) {
+        ++m_skip;
+        return nullptr;
+    }
+
+    switch (m_role) {
+    case role::Subnodes:
+        // При повторном ключе subnodes, как и в json::object, действует последнее значение
+        m_frames[m_depth - 1].childs.clear();
+        m_role = role::Tree;
+        return nullptr;
+    case role::Skip:
+        m_skip = 1;
+        return nullptr;
+    case role::Tree:
+        return "tree node must be an object";
+    case role::Node:
+        return "node must be a string or a number";
+    }
+    return nullptr;
+}
+
+const char* tree_builder::onEndArray()
+{
+    if (m_skip > 0)
+        --m_skip;
+    return nullptr;
+}
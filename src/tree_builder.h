@@ -0,0 +1,170 @@
+#ifndef TREE_BUILDER_H
+#define TREE_BUILDER_H
+
+#include "tree.h"
+#include "json/parse_result.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+/**
+ * @class tree_builder
+ * @brief Обработчик json::push_parser, собирающий дерево напрямую из текста.
+ * @remarks В отличие от пути json::value::parse + tree::parse, промежуточное JSON-значение
+ * не строится: ключи узла сравниваются с полями схемы на этапе компиляции,
+ * а значения сразу попадают в узлы дерева. Ключи узла допускаются в любом порядке.
+ * Значения посторонних ключей пропускаются; сами ключи учитываются,
+ * а в строгом режиме считаются ошибкой.
+ * По запросу в числовых узлах сохраняется исходный текст числа (см. tree::numberText),
+ * чтобы при сохранении дерева числа выводились без изменений.
+ */
+class tree_builder {
+public:
+    /// Поле узла дерева, которому соответствует ключ
+    enum class field : uint8_t {
+        /// ключ tree::NODE_FN
+        Node,
+        /// ключ tree::SUBNODES_FN
+        Subnodes,
+        /// посторонний ключ
+        Unknown
+    };
+
+    /**
+     * @brief Сопоставляет ключ полю схемы
+     * @remarks Ключи схемы различаются длиной, поэтому длина служит совершенной хэш-функцией
+     * и для каждого ключа выполняется не более одного сравнения строк
+     * @param key ключ
+     * @return поле схемы
+     */
+    static constexpr field matchField(std::string_view key) noexcept;
+
+    /**
+     * @brief Конструирует сборщик
+     * @param strict true чтобы считать посторонние ключи ошибкой
+     * @param keepNumberText true чтобы сохранять исходный текст чисел
+     */
+    explicit tree_builder(bool strict = false, bool keepNumberText = false);
+
+    /**
+     * @brief Забирает собранное дерево
+     * @remarks Вызывать после успешного завершения разбора
+     * @return дерево
+     */
+    tree take();
+
+    /**
+     * @brief Количество встреченных посторонних ключей
+     */
+    size_t unknownKeys() const noexcept;
+
+    /**
+     * @brief Первый встреченный посторонний ключ
+     * @return ключ, пустая строка если посторонних ключей не было
+     */
+    const std::string& firstUnknownKey() const noexcept;
+
+    /**
+     * @brief Выполняет парсинг текста в дерево
+     * @param text текст документа
+     * @param strict true чтобы считать посторонние ключи ошибкой
+     * @throw json::json_exception если текст не является корректным деревом
+     * @return дерево
+     */
+    static tree parse(std::string_view text, bool strict = false);
+
+    /**
+     * @brief Выполняет парсинг текста в дерево без исключений
+     * @remarks Ошибка не бросает исключение и не выделяет память
+     * @param text текст документа
+     * @param out дерево; изменяется только при успешном разборе
+     * @param strict true чтобы считать посторонние ключи ошибкой
+     * @return результат разбора с кодом и позицией первой ошибки
+     */
+    static json::parse_result parse(std::string_view text, tree& out, bool strict = false);
+
+    const char* onNull();
+    const char* onInteger(int value, std::string_view text);
+    const char* onDouble(double value, std::string_view text);
+    const char* onString(std::string_view value);
+    const char* onKey(std::string_view key);
+    const char* onStartObject();
+    const char* onEndObject();
+    const char* onStartArray();
+    const char* onEndArray();
+
+private:
+    /// Незавершённый узел дерева
+    struct frame {
+        std::variant<std::monostate, std::string, int, double> value;
+        std::string numberText;
+        std::vector<tree> childs;
+    };
+
+    /// Чем должно быть очередное значение
+    enum class role : uint8_t {
+        Tree,
+        Node,
+        Subnodes,
+        Skip
+    };
+
+    /**
+     * @brief Принимает скалярное значение узла
+     * @param value значение
+     */
+    template <typename T>
+    const char* scalar(T&& value);
+
+    /**
+     * @brief Принимает числовое значение узла
+     * @param value значение
+     * @param text исходный текст числа
+     */
+    template <typename T>
+    const char* number(T value, std::string_view text);
+
+private:
+    bool m_strict;
+    bool m_keepNumberText;
+    role m_role = role::Tree;
+    /// открытые узлы; элементы не удаляются, чтобы переиспользовать их память
+    std::vector<frame> m_frames;
+    size_t m_depth = 0;
+    /// глубина вложенности пропускаемого значения постороннего ключа
+    size_t m_skip = 0;
+    std::optional<tree> m_root;
+    size_t m_unknownKeys = 0;
+    std::string m_firstUnknownKey;
+};
+
+constexpr tree_builder::field tree_builder::matchField(std::string_view key) noexcept
+{
+    switch (key.size()) {
+    case tree::NODE_KEY.size():
+        return key == tree::NODE_KEY ? field::Node : field::Unknown;
+    case tree::SUBNODES_KEY.size():
+        return key == tree::SUBNODES_KEY ? field::Subnodes : field::Unknown;
+    default:
+        return field::Unknown;
+    }
+}
+
+static_assert(tree_builder::matchField("node") == tree_builder::field::Node);
+static_assert(tree_builder::matchField("subnodes") == tree_builder::field::Subnodes);
+static_assert(tree_builder::matchField("nodes") == tree_builder::field::Unknown);
+
+inline size_t tree_builder::unknownKeys() const noexcept
+{
+    return m_unknownKeys;
+}
+
+inline const std::string& tree_builder::firstUnknownKey() const noexcept
+{
+    return m_firstUnknownKey;
+}
+
+#endif // TREE_BUILDER_H
@@ -0,0 +1,278 @@
+#include "tree_cache.h"
+#include "mapped_file.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char MAGIC[8] = { 'T', '2', 'G', 'T', 'R', 'E', 'E', '\0' };
+/// Версия формата; увеличивается при любом его изменении
+constexpr uint32_t VERSION = 2;
+constexpr uint32_t FLAG_NUMBER_TEXT = 1;
+constexpr uint32_t FLAG_MESSAGE_PACK = 2;
+constexpr uint32_t FLAG_CBOR = 4;
+
+/// Заголовок записи кэша
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t inputSize;
+    int64_t inputMtime;
+    uint64_t nodes;
+    uint64_t textSize;
+    uint64_t unknownKeys;
+    /// первый посторонний ключ лежит в начале блока текста
+    uint64_t firstKeySize;
+};
+
+enum class kind : uint8_t {
+    Integer,
+    Double,
+    String
+};
+
+/// Запись узла; узлы идут в прямом порядке обхода
+struct record {
+    uint64_t childs;
+    /// целое или вещественное значение
+    uint64_t value;
+    /// строка или исходный текст числа в блоке текста
+    uint64_t textOffset;
+    uint32_t textSize;
+    kind type;
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(header) == 64 && sizeof(record) == 32, "cache format must not depend on the compiler");
+
+/**
+ * @brief Флаги заголовка для параметров разбора
+ */
+uint32_t flagsOf(const tree_cache::parse_options& options)
+{
+    uint32_t flags = options.keepNumberText ? FLAG_NUMBER_TEXT : 0;
+    if (options.binary == json::binary_format::MessagePack)
+        flags |= FLAG_MESSAGE_PACK;
+    else if (options.binary == json::binary_format::Cbor)
+        flags |= FLAG_CBOR;
+    return flags;
+}
+
+uint64_t fnv1a(std::string_view text)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (auto ch : text) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+} // end of anonymous namespace
+
+tree_cache::tree_cache(std::string dir)
+    : m_dir(std::move(dir))
+{
+}
+
+std::string tree_cache::entryPath(const std::string& input, const parse_options& options) const
+{
+    std::error_code ec;
+    auto absolute = fs::weakly_canonical(fs::u8path(input), ec);
+    if (ec)
+        absolute = fs::absolute(fs::u8path(input));
+
+    // Записи разных параметров разбора одного файла хранятся рядом и не вытесняют друг друга
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx-%x.tree", static_cast<unsigned long long>(fnv1a(absolute.string())),
+        static_cast<unsigned>(flagsOf(options)));
+    return (fs::u8path(m_dir) / name).string();
+}
+
+std::optional<tree_cache::stamp> tree_cache::stampOf(const std::string& input)
+{
+    std::error_code ec;
+    auto path = fs::u8path(input);
+    stamp ret;
+    ret.size = fs::file_size(path, ec);
+    if (ec)
+        return std::nullopt;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec)
+        return std::nullopt;
+    ret.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    return ret;
+}
+
+std::optional<tree_cache::entry> tree_cache::load(const std::string& input, const parse_options& options) const
+{
+    auto current = stampOf(input);
+    if (!current)
+        return std::nullopt;
+
+    mapped_file file(entryPath(input, options));
+    if (file.size() < sizeof(header))
+        return std::nullopt;
+
+    const auto& head = *reinterpret_cast<const header*>(file.data());
+    if (std::memcmp(head.magic, MAGIC, sizeof(MAGIC)) != 0 || head.version != VERSION
+        || head.flags != flagsOf(options) || head.inputSize != current->size
+        || head.inputMtime != current->mtime || head.nodes == 0
+        || head.nodes > (file.size() - sizeof(header)) / sizeof(record)
+        || file.size() - sizeof(header) - head.nodes * sizeof(record) != head.textSize
+        || head.firstKeySize > head.textSize)
+        return std::nullopt;
+
+    auto records = reinterpret_cast<const record*>(file.data() + sizeof(header));
+    auto text = file.data() + sizeof(header) + head.nodes * sizeof(record);
+
+    // Дерево восстанавливается без рекурсии: стек хранит узлы, чьи дочерние элементы ещё читаются
+    struct frame {
+        tree node;
+        uint64_t remaining;
+    };
+    std::vector<frame> stack;
+    std::optional<tree> root;
+
+    for (uint64_t i = 0; i < head.nodes; ++i) {
+        const auto& rec = records[i];
+        if (root || rec.textOffset > head.textSize || rec.textSize > head.textSize - rec.textOffset)
+            return std::nullopt;
+
+        auto str = std::string_view(text + rec.textOffset, rec.textSize);
+        auto node = [&]() -> std::optional<tree> {
+            int integer;
+            double number;
+            switch (rec.type) {
+            case kind::Integer:
+                std::memcpy(&integer, &rec.value, sizeof(integer));
+                return tree { integer };
+            case kind::Double:
+                std::memcpy(&number, &rec.value, sizeof(number));
+                return tree { number };
+            case kind::String:
+                return tree { std::string(str) };
+            }
+            return std::nullopt;
+        }();
+        if (!node)
+            return std::nullopt;
+        if (rec.type != kind::String)
+            node->setNumberText(std::string(str));
+
+        if (rec.childs > 0) {
+            if (rec.childs > head.nodes - i - 1)
+                return std::nullopt;
+            node->m_subnodes.reserve(rec.childs);
+            stack.push_back({ std::move(*node), rec.childs });
+            continue;
+        }
+
+        // Завершённый узел поднимается вверх, пока у родителей не кончаются дочерние элементы
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            top.node.m_subnodes.push_back(std::move(*node));
+            if (--top.remaining > 0)
+                break;
+            node = std::move(top.node);
+            stack.pop_back();
+        }
+        if (stack.empty())
+            root = std::move(node);
+    }
+    if (!root)
+        return std::nullopt;
+
+    return entry { std::move(*root), head.unknownKeys, std::string(text, head.firstKeySize) };
+}
+
+bool tree_cache::store(const std::string& input, const parse_options& options, const stamp& before, const entry& value) const
+{
+    // Файл, изменённый во время разбора, мог быть прочитан частично в старом виде
+    auto current = stampOf(input);
+    if (!current || *current != before)
+        return true;
+
+    std::error_code ec;
+    fs::create_directories(fs::u8path(m_dir), ec);
+    if (ec)
+        return false;
+
+    auto path = entryPath(input, options);
+    auto temp = path + ".tmp" + std::to_string(::getpid());
+    bool written = false;
+    try {
+        written = write(temp, options, before, value);
+    } catch (...) {
+        fs::remove(fs::u8path(temp), ec);
+        throw;
+    }
+    if (written)
+        fs::rename(fs::u8path(temp), fs::u8path(path), ec);
+    if (!written || ec) {
+        fs::remove(fs::u8path(temp), ec);
+        return false;
+    }
+    return true;
+}
+
+bool tree_cache::write(const std::string& path, const parse_options& options, const stamp& input, const entry& value)
+{
+    std::ofstream os(fs::u8path(path), std::ios::binary | std::ios::trunc);
+    if (!os)
+        return false;
+
+    header head {};
+    std::memcpy(head.magic, MAGIC, sizeof(MAGIC));
+    head.version = VERSION;
+    head.flags = flagsOf(options);
+    head.inputSize = input.size;
+    head.inputMtime = input.mtime;
+    head.unknownKeys = value.unknownKeys;
+    head.firstKeySize = value.firstUnknownKey.size();
+    os.write(reinterpret_cast<const char*>(&head), sizeof(head));
+
+    // Первый проход пишет записи узлов, второй - их текст в том же порядке
+    auto textOf = [](const tree& node) -> const std::string& {
+        return node.isString() ? node.asString() : node.numberText();
+    };
+    uint64_t textSize = head.firstKeySize;
+    for (const auto& node : value.value.preorder()) {
+        record rec {};
+        rec.childs = node.childs().size();
+        if (node.isInteger()) {
+            auto integer = node.asInteger();
+            std::memcpy(&rec.value, &integer, sizeof(integer));
+            rec.type = kind::Integer;
+        } else if (node.isDouble()) {
+            auto number = node.asDouble();
+            std::memcpy(&rec.value, &number, sizeof(number));
+            rec.type = kind::Double;
+        } else {
+            rec.type = kind::String;
+        }
+        const auto& str = textOf(node);
+        if (str.size() > UINT32_MAX)
+            return false;
+        rec.textOffset = textSize;
+        rec.textSize = static_cast<uint32_t>(str.size());
+        textSize += str.size();
+        os.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+        ++head.nodes;
+    }
+
+    os << value.firstUnknownKey;
+    for (const auto& node : value.value.preorder())
+        os << textOf(node);
+
+    head.textSize = textSize;
+    os.seekp(0);
+    os.write(reinterpret_cast<const char*>(&head), sizeof(head));
+    return static_cast<bool>(os.flush());
+}
@@ -0,0 +1,117 @@
+#ifndef TREE_CACHE_H
+#define TREE_CACHE_H
+
+#include "tree.h"
+#include "json/binary_format.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/**
+ * @class tree_cache
+ * @brief Постоянный кэш разобранных деревьев на диске.
+ * @remarks Дерево хранится в двоичном виде, пригодном для отображения в память (mmap):
+ * заголовок, массив записей узлов фиксированного размера в прямом порядке обхода и общий блок
+ * текста строк. Запись находится по ключу из пути к входному файлу и параметров разбора
+ * (формата входного файла и сохранения текста чисел), а действительна, пока у входного файла
+ * не изменились размер и время модификации.
+ * Хэш содержимого не используется: для его расчёта пришлось бы читать весь входной файл.
+ */
+class tree_cache {
+public:
+    /// Закэшированное дерево вместе со сведениями о разборе
+    struct entry {
+        tree value;
+        /// количество посторонних ключей, пропущенных при разборе
+        size_t unknownKeys = 0;
+        /// первый посторонний ключ
+        std::string firstUnknownKey;
+    };
+
+    /// Параметры разбора, от которых зависит дерево
+    struct parse_options {
+        /// двоичный формат входного файла; std::nullopt - текст JSON
+        std::optional<json::binary_format> binary;
+        /// сохранялся ли при разборе исходный текст чисел
+        bool keepNumberText = false;
+    };
+
+    /// Размер и время модификации входного файла
+    struct stamp {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+
+        bool operator==(const stamp& other) const noexcept;
+        bool operator!=(const stamp& other) const noexcept;
+    };
+
+    /**
+     * @brief Конструирует кэш
+     * @param dir каталог кэша; создаётся при первой записи
+     */
+    explicit tree_cache(std::string dir);
+
+    /**
+     * @brief Загружает дерево из кэша
+     * @remarks Повреждённая или устаревшая запись считается отсутствующей
+     * @param input путь к входному файлу
+     * @param options параметры разбора; запись, сделанная с другими параметрами, не подходит
+     * @return дерево, если в кэше есть действительная запись
+     */
+    std::optional<entry> load(const std::string& input, const parse_options& options) const;
+
+    /**
+     * @brief Сохраняет дерево в кэш
+     * @remarks Запись сначала пишется во временный файл, который затем атомарно переименовывается,
+     * поэтому параллельно работающие экземпляры программы не видят недописанных записей.
+     * Если входной файл изменился с начала чтения, запись не сохраняется: дерево может
+     * не соответствовать новому содержимому.
+     * Ошибки записи не считаются фатальными: кэш лишь ускоряет повторные запуски
+     * @param input путь к входному файлу
+     * @param options параметры разбора
+     * @param before размер и время модификации входного файла до начала чтения (см. stampOf)
+     * @param value дерево с результатами разбора
+     * @return false если записать не удалось
+     */
+    bool store(const std::string& input, const parse_options& options, const stamp& before, const entry& value) const;
+
+    /**
+     * @brief Размер и время модификации входного файла
+     * @return std::nullopt если файл недоступен
+     */
+    static std::optional<stamp> stampOf(const std::string& input);
+
+private:
+    /**
+     * @brief Путь к записи кэша для входного файла
+     * @param input путь к входному файлу
+     * @param options параметры разбора
+     * @return путь к записи
+     */
+    std::string entryPath(const std::string& input, const parse_options& options) const;
+
+    /**
+     * @brief Записывает дерево в файл записи кэша
+     * @param path путь к файлу
+     * @param options параметры разбора
+     * @param input размер и время модификации входного файла
+     * @param value дерево с результатами разбора
+     * @return false если записать не удалось; недописанный файл удаляет вызывающая сторона
+     */
+    static bool write(const std::string& path, const parse_options& options, const stamp& input, const entry& value);
+
+private:
+    std::string m_dir;
+};
+
+inline bool tree_cache::stamp::operator==(const stamp& other) const noexcept
+{
+    return size == other.size && mtime == other.mtime;
+}
+
+inline bool tree_cache::stamp::operator!=(const stamp& other) const noexcept
+{
+    return !(*this == other);
+}
+
+#endif // TREE_CACHE_H
@@ -0,0 +1,117 @@
+#include "tree_columns.h"
+#include "trace.h"
+#include "tree.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+constexpr char MAGIC[8] = { 'T', '2', 'G', 'C', 'O', 'L', 'S', '\0' };
+/// Версия формата; увеличивается при любом его изменении
+constexpr uint32_t VERSION = 1;
+/// Выравнивание массивов в файле: строка кэша и самый широкий регистр AVX-512
+constexpr uint64_t ALIGNMENT = 64;
+constexpr size_t ARRAYS = 7;
+
+/// Заголовок файла столбцов
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t nodes;
+    uint64_t integers;
+    uint64_t doubles;
+    uint64_t strings;
+    uint64_t stringBytes;
+    /// смещения массивов от начала файла
+    uint64_t offsets[ARRAYS];
+    uint8_t padding[16];
+};
+
+static_assert(sizeof(header) == 128, "columns format must not depend on the compiler");
+
+uint64_t alignUp(uint64_t offset) noexcept
+{
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+} // end of anonymous namespace
+
+tree_columns tree_columns::collect(const tree& tree)
+{
+    TRACE_SCOPE("tree_columns::collect");
+    tree_columns ret;
+    // Номера предков текущего узла по глубинам
+    std::vector<int64_t> path;
+    auto range = tree.preorder();
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        auto id = static_cast<int64_t>(ret.kinds.size());
+        auto depth = it.depth();
+        path.resize(depth);
+        ret.parents.push_back(path.empty() ? NO_PARENT : path.back());
+        path.push_back(id);
+
+        if (it->isInteger()) {
+            ret.kinds.push_back(kind::Integer);
+            ret.rows.push_back(ret.integers.size());
+            ret.integers.push_back(it->asInteger());
+        } else if (it->isDouble()) {
+            ret.kinds.push_back(kind::Double);
+            ret.rows.push_back(ret.doubles.size());
+            ret.doubles.push_back(it->asDouble());
+        } else {
+            ret.kinds.push_back(kind::String);
+            ret.rows.push_back(ret.stringOffsets.size() - 1);
+            ret.stringBytes += it->asString();
+            ret.stringOffsets.push_back(ret.stringBytes.size());
+        }
+    }
+    return ret;
+}
+
+void tree_columns::write(std::ostream& os) const
+{
+    const std::pair<const void*, uint64_t> arrays[ARRAYS] = {
+        { kinds.data(), kinds.size() * sizeof(kind) },
+        { rows.data(), rows.size() * sizeof(uint64_t) },
+        { parents.data(), parents.size() * sizeof(int64_t) },
+        { integers.data(), integers.size() * sizeof(int64_t) },
+        { doubles.data(), doubles.size() * sizeof(double) },
+        { stringOffsets.data(), stringOffsets.size() * sizeof(uint64_t) },
+        { stringBytes.data(), stringBytes.size() },
+    };
+
+    header head {};
+    std::memcpy(head.magic, MAGIC, sizeof(MAGIC));
+    head.version = VERSION;
+    head.nodes = kinds.size();
+    head.integers = integers.size();
+    head.doubles = doubles.size();
+    head.strings = stringOffsets.size() - 1;
+    head.stringBytes = stringBytes.size();
+    uint64_t offset = sizeof(header);
+    for (size_t i = 0; i < ARRAYS; ++i) {
+        head.offsets[i] = alignUp(offset);
+        offset = head.offsets[i] + arrays[i].second;
+    }
+
+    static constexpr char ZEROS[ALIGNMENT] = {};
+    os.write(reinterpret_cast<const char*>(&head), sizeof(head));
+    offset = sizeof(header);
+    for (size_t i = 0; i < ARRAYS; ++i) {
+        os.write(ZEROS, static_cast<std::streamsize>(head.offsets[i] - offset));
+        os.write(static_cast<const char*>(arrays[i].first), static_cast<std::streamsize>(arrays[i].second));
+        offset = head.offsets[i] + arrays[i].second;
+    }
+}
+
+void tree_columns::save(const std::string& path) const
+{
+    std::ofstream os(std::filesystem::u8path(path), std::ios::binary | std::ios::trunc);
+    if (!os)
+        throw std::runtime_error("Can't open '" + path + "'");
+    write(os);
+    if (!os.flush())
+        throw std::runtime_error("Can't write columns file");
+}
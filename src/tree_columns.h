@@ -0,0 +1,90 @@
+#ifndef TREE_COLUMNS_H
+#define TREE_COLUMNS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class tree;
+
+/**
+ * @struct tree_columns
+ * @brief Значения узлов дерева в виде типизированных столбцов для векторной обработки.
+ * @remarks Узлы нумеруются в прямом порядке обхода, корень - узел 0. Для узла i kinds[i]
+ * указывает столбец его значения, а rows[i] - строку в этом столбце; parents[i] - номер
+ * родителя, у корня NO_PARENT. Строка k занимает байты [stringOffsets[k], stringOffsets[k + 1])
+ * в stringBytes. Все столбцы - непрерывные массивы, которые можно обрабатывать SIMD-ядрами
+ * или передавать numpy и Arrow без копирования.
+ */
+struct tree_columns {
+    /// Столбец значения узла
+    enum class kind : uint8_t {
+        Integer,
+        Double,
+        String
+    };
+
+    /// Родитель корня
+    static constexpr int64_t NO_PARENT = -1;
+
+    std::vector<kind> kinds;
+    std::vector<uint64_t> rows;
+    std::vector<int64_t> parents;
+    std::vector<int64_t> integers;
+    std::vector<double> doubles;
+    /// начала строк в stringBytes и размер stringBytes в конце; на один элемент больше числа строк
+    std::vector<uint64_t> stringOffsets { 0 };
+    std::string stringBytes;
+
+    /**
+     * @brief Раскладывает значения узлов по столбцам
+     * @param tree дерево
+     * @return столбцы
+     */
+    static tree_columns collect(const tree& tree);
+
+    /**
+     * @brief Количество узлов
+     */
+    size_t size() const noexcept;
+
+    /**
+     * @brief Строка из столбца строк
+     * @param row номер строки
+     */
+    std::string_view string(size_t row) const noexcept;
+
+    /**
+     * @brief Записывает столбцы в двоичном виде
+     * @remarks Заголовок из 128 байтов: "T2GCOLS\0", версия (uint32), резерв (uint32),
+     * количества узлов, целых, вещественных, строк и байтов строк (uint64), затем смещения
+     * от начала файла семи массивов в порядке kinds, rows, parents, integers, doubles,
+     * stringOffsets, stringBytes (uint64). Каждый массив выровнен на 64 байта, числа записаны
+     * в порядке байтов машины, поэтому файл можно отобразить в память и читать массивы на месте,
+     * например numpy.frombuffer(data, dtype, count, offset)
+     * @param os поток вывода, открытый в двоичном режиме
+     */
+    void write(std::ostream& os) const;
+
+    /**
+     * @brief Записывает столбцы в файл (см. write)
+     * @param path путь к файлу
+     * @throw std::runtime_error если записать не удалось
+     */
+    void save(const std::string& path) const;
+};
+
+inline size_t tree_columns::size() const noexcept
+{
+    return kinds.size();
+}
+
+inline std::string_view tree_columns::string(size_t row) const noexcept
+{
+    return std::string_view(stringBytes).substr(stringOffsets[row], stringOffsets[row + 1] - stringOffsets[row]);
+}
+
+#endif // TREE_COLUMNS_H
@@ -0,0 +1,362 @@
+#include "tree_index.h"
+#include "mapped_file.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+constexpr char MAGIC[8] = { 'T', '2', 'G', 'I', 'N', 'D', 'X', '\0' };
+/// Версия формата; увеличивается при любом его изменении
+constexpr uint32_t VERSION = 1;
+/// Дерево меньшего размера индексируется в одном потоке: задачи обойдутся дороже
+constexpr size_t PARALLEL_THRESHOLD = 1 << 16;
+/// Предельное количество сегментов - 2^MAX_SHARD_BITS
+constexpr unsigned MAX_SHARD_BITS = 8;
+
+/// Заголовок файла индекса; за ним идут ячейки, номера узлов и блок текста
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t shardBits;
+    uint64_t shardSlots;
+    uint64_t values;
+    uint64_t nodes;
+    uint64_t textSize;
+    uint64_t reserved[2];
+};
+
+static_assert(sizeof(header) == 64, "index format must not depend on the compiler");
+
+/// Финализатор splitmix64: перемешивает все биты, поэтому годятся и старшие, и младшие
+uint64_t mix(uint64_t x) noexcept
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t fnv1a(std::string_view text) noexcept
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (auto ch : text) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Выполняет func(0) ... func(count - 1) в потоках пула или последовательно
+ * @param count количество вызовов
+ * @param parallel true чтобы выполнять в пуле
+ * @param func функция от номера вызова
+ */
+template <typename TFunc>
+void forEach(size_t count, bool parallel, const TFunc& func)
+{
+    if (!parallel) {
+        for (size_t i = 0; i < count; ++i)
+            func(i);
+        return;
+    }
+    parallel_for(count, func);
+}
+} // end of anonymous namespace
+
+struct tree_index::segment {
+    /// ячейки значений: start относительно nodes, начало строки относительно text
+    std::vector<slot> values;
+    std::vector<uint64_t> nodes;
+    std::vector<char> text;
+};
+
+tree_index::key tree_index::keyOf(int value) noexcept
+{
+    auto payload = static_cast<uint64_t>(static_cast<int64_t>(value));
+    return { mix(payload), payload, std::string_view(), kind::Integer };
+}
+
+tree_index::key tree_index::keyOf(double value) noexcept
+{
+    // Равные значения должны давать равные биты
+    if (value == 0.0)
+        value = 0.0;
+    else if (std::isnan(value))
+        value = std::numeric_limits<double>::quiet_NaN();
+    uint64_t payload;
+    std::memcpy(&payload, &value, sizeof(payload));
+    return { mix(payload + 1), payload, std::string_view(), kind::Double };
+}
+
+tree_index::key tree_index::keyOf(std::string_view value) noexcept
+{
+    return { mix(fnv1a(value) + 2), 0, value, kind::String };
+}
+
+tree_index::key tree_index::keyOf(const tree& node) noexcept
+{
+    if (node.isInteger())
+        return keyOf(node.asInteger());
+    if (node.isDouble())
+        return keyOf(node.asDouble());
+    return keyOf(std::string_view(node.asString()));
+}
+
+std::vector<const tree*> tree_index::preorder(const tree& root)
+{
+    std::vector<const tree*> ret;
+    for (const auto& node : root.preorder())
+        ret.push_back(&node);
+    return ret;
+}
+
+tree_index tree_index::build(const tree& root, tree::policy how)
+{
+    TRACE_SCOPE("tree_index::build");
+    auto nodes = preorder(root);
+    auto threads = task_scheduler::instance().threads();
+    bool parallel = how == tree::policy::Parallel && threads > 1 && nodes.size() >= PARALLEL_THRESHOLD;
+
+    unsigned shardBits = 0;
+    while (parallel && shardBits < MAX_SHARD_BITS && (size_t { 1 } << shardBits) < threads * 4)
+        ++shardBits;
+    size_t shards = size_t { 1 } << shardBits;
+    auto shardOf = [shardBits](uint64_t hash) { return shardBits ? static_cast<size_t>(hash >> (64 - shardBits)) : 0; };
+
+    // Хэши узлов и количество узлов каждого сегмента в каждой части дерева
+    size_t chunks = parallel ? threads * 4 : 1;
+    size_t chunkSize = (nodes.size() + chunks - 1) / chunks;
+    std::vector<uint64_t> hashes(nodes.size());
+    std::vector<std::vector<size_t>> counts(chunks, std::vector<size_t>(shards));
+    forEach(chunks, parallel, [&](size_t chunk) {
+        auto last = std::min(nodes.size(), (chunk + 1) * chunkSize);
+        for (auto i = chunk * chunkSize; i < last; ++i) {
+            hashes[i] = keyOf(*nodes[i]).hash;
+            ++counts[chunk][shardOf(hashes[i])];
+        }
+    });
+
+    // Раскладываем узлы по сегментам
+    std::vector<size_t> bounds(shards + 1);
+    for (size_t shard = 0, offset = 0; shard < shards; ++shard) {
+        bounds[shard] = offset;
+        for (auto& count : counts) {
+            auto size = count[shard];
+            count[shard] = offset;
+            offset += size;
+        }
+    }
+    bounds[shards] = nodes.size();
+    std::vector<std::pair<uint64_t, uint64_t>> order(nodes.size());
+    forEach(chunks, parallel, [&](size_t chunk) {
+        auto last = std::min(nodes.size(), (chunk + 1) * chunkSize);
+        for (auto i = chunk * chunkSize; i < last; ++i)
+            order[counts[chunk][shardOf(hashes[i])]++] = { hashes[i], i };
+    });
+    hashes = std::vector<uint64_t>();
+
+    // Сегменты группируют узлы с равными значениями независимо друг от друга
+    std::vector<segment> segments(shards);
+    forEach(shards, parallel, [&](size_t shard) {
+        auto& seg = segments[shard];
+        auto first = order.begin() + static_cast<ptrdiff_t>(bounds[shard]);
+        auto last = order.begin() + static_cast<ptrdiff_t>(bounds[shard + 1]);
+        // Узлы с равным хэшем остаются упорядочены по номеру
+        std::sort(first, last);
+        seg.nodes.reserve(static_cast<size_t>(last - first));
+
+        std::vector<uint64_t> pending;
+        for (auto run = first; run != last;) {
+            auto k = keyOf(*nodes[run->second]);
+            auto runEnd = std::find_if(run + 1, last, [&](const auto& item) { return item.first != k.hash; });
+            pending.clear();
+            for (; run != runEnd; ++run)
+                pending.push_back(run->second);
+            // Разные значения с одним хэшем редки, поэтому хватает повторных проходов по серии
+            for (bool firstValue = true; !pending.empty(); firstValue = false) {
+                if (!firstValue)
+                    k = keyOf(*nodes[pending.front()]);
+                slot value {};
+                value.hash = k.hash;
+                value.payload = (k.type == kind::String) ? seg.text.size() : k.payload;
+                value.start = seg.nodes.size();
+                value.textSize = static_cast<uint32_t>(k.text.size());
+                value.type = k.type;
+                seg.text.insert(seg.text.end(), k.text.begin(), k.text.end());
+
+                if (pending.size() == 1) {
+                    seg.nodes.push_back(pending.front());
+                    pending.clear();
+                }
+                size_t kept = 0;
+                for (auto id : pending) {
+                    auto other = keyOf(*nodes[id]);
+                    if (other.type == k.type && other.payload == k.payload && other.text == k.text)
+                        seg.nodes.push_back(id);
+                    else
+                        pending[kept++] = id;
+                }
+                pending.resize(kept);
+                value.count = seg.nodes.size() - value.start;
+                seg.values.push_back(value);
+            }
+        }
+    });
+
+    // Сегменты занимают в таблице равные диапазоны ячеек, заполненные не больше чем наполовину
+    size_t maxValues = 0;
+    tree_index ret;
+    for (const auto& seg : segments) {
+        maxValues = std::max(maxValues, seg.values.size());
+        ret.m_values += seg.values.size();
+    }
+    ret.m_shardBits = shardBits;
+    while (ret.m_shardSlots < maxValues * 2)
+        ret.m_shardSlots <<= 1;
+    ret.m_ownSlots.resize(ret.m_shardSlots * shards);
+    ret.m_ownNodes.resize(nodes.size());
+    std::vector<size_t> textBounds(shards + 1);
+    for (size_t shard = 0; shard < shards; ++shard)
+        textBounds[shard + 1] = textBounds[shard] + segments[shard].text.size();
+    ret.m_ownText.resize(textBounds[shards]);
+
+    forEach(shards, parallel, [&](size_t shard) {
+        auto& seg = segments[shard];
+        std::copy(seg.nodes.begin(), seg.nodes.end(), ret.m_ownNodes.begin() + static_cast<ptrdiff_t>(bounds[shard]));
+        std::copy(seg.text.begin(), seg.text.end(), ret.m_ownText.begin() + static_cast<ptrdiff_t>(textBounds[shard]));
+
+        auto table = ret.m_ownSlots.data() + shard * ret.m_shardSlots;
+        auto mask = ret.m_shardSlots - 1;
+        for (auto value : seg.values) {
+            value.start += bounds[shard];
+            if (value.type == kind::String)
+                value.payload += textBounds[shard];
+            auto pos = value.hash & mask;
+            while (table[pos].count != 0)
+                pos = (pos + 1) & mask;
+            table[pos] = value;
+        }
+        seg = segment();
+    });
+
+    ret.m_slots = ret.m_ownSlots.data();
+    ret.m_nodes = ret.m_ownNodes.data();
+    ret.m_nodeCount = ret.m_ownNodes.size();
+    ret.m_text = ret.m_ownText.data();
+    ret.m_textSize = ret.m_ownText.size();
+    return ret;
+}
+
+tree_index tree_index::load(const std::string& path)
+{
+    auto file = std::make_shared<mapped_file>(path);
+    if (!file->data())
+        throw std::runtime_error("Can't open '" + path + "'");
+
+    auto invalid = [&]() { return std::runtime_error("'" + path + "' is not a tree index"); };
+    if (file->size() < sizeof(header))
+        throw invalid();
+    header head;
+    std::memcpy(&head, file->data(), sizeof(head));
+    if (std::memcmp(head.magic, MAGIC, sizeof(MAGIC)) != 0 || head.version != VERSION
+        || head.shardBits > MAX_SHARD_BITS || head.shardSlots == 0 || (head.shardSlots & (head.shardSlots - 1)) != 0)
+        throw invalid();
+
+    // Размеры проверяются делением, чтобы повреждённый заголовок не вызвал переполнения
+    auto left = file->size() - sizeof(header);
+    auto slots = head.shardSlots << head.shardBits;
+    if ((slots >> head.shardBits) != head.shardSlots || slots > left / sizeof(slot))
+        throw invalid();
+    left -= slots * sizeof(slot);
+    if (head.nodes > left / sizeof(uint64_t) || left - head.nodes * sizeof(uint64_t) != head.textSize)
+        throw invalid();
+
+    tree_index ret;
+    ret.m_shardBits = head.shardBits;
+    ret.m_shardSlots = head.shardSlots;
+    ret.m_values = head.values;
+    auto data = file->data() + sizeof(header);
+    ret.m_slots = reinterpret_cast<const slot*>(data);
+    ret.m_nodes = reinterpret_cast<const uint64_t*>(data + slots * sizeof(slot));
+    ret.m_nodeCount = head.nodes;
+    ret.m_text = data + slots * sizeof(slot) + head.nodes * sizeof(uint64_t);
+    ret.m_textSize = head.textSize;
+    ret.m_file = std::move(file);
+    return ret;
+}
+
+void tree_index::save(const std::string& path) const
+{
+    std::ofstream os(std::filesystem::u8path(path), std::ios::binary | std::ios::trunc);
+    if (!os)
+        throw std::runtime_error("Can't open '" + path + "'");
+
+    header head {};
+    std::memcpy(head.magic, MAGIC, sizeof(MAGIC));
+    head.version = VERSION;
+    head.shardBits = m_shardBits;
+    head.shardSlots = m_shardSlots;
+    head.values = m_values;
+    head.nodes = m_nodeCount;
+    head.textSize = m_textSize;
+    os.write(reinterpret_cast<const char*>(&head), sizeof(head));
+    os.write(reinterpret_cast<const char*>(m_slots),
+        static_cast<std::streamsize>((m_shardSlots << m_shardBits) * sizeof(slot)));
+    os.write(reinterpret_cast<const char*>(m_nodes), static_cast<std::streamsize>(m_nodeCount * sizeof(uint64_t)));
+    os.write(m_text, static_cast<std::streamsize>(m_textSize));
+    if (!os.flush())
+        throw std::runtime_error("Can't write index file");
+}
+
+tree_index::ids tree_index::find(int value) const
+{
+    return lookup(keyOf(value));
+}
+
+tree_index::ids tree_index::find(double value) const
+{
+    return lookup(keyOf(value));
+}
+
+tree_index::ids tree_index::find(std::string_view value) const
+{
+    return lookup(keyOf(value));
+}
+
+tree_index::ids tree_index::lookup(const key& k) const
+{
+    if (!m_slots)
+        return ids();
+
+    auto shard = m_shardBits ? k.hash >> (64 - m_shardBits) : 0;
+    auto table = m_slots + shard * m_shardSlots;
+    auto mask = m_shardSlots - 1;
+    auto pos = k.hash & mask;
+    // Число проб ограничено на случай повреждённого файла без пустых ячеек
+    for (uint64_t probe = 0; probe < m_shardSlots; ++probe, pos = (pos + 1) & mask) {
+        const auto& s = table[pos];
+        if (s.count == 0)
+            break;
+        if (s.hash != k.hash || s.type != k.type)
+            continue;
+        if (k.type == kind::String) {
+            if (s.payload > m_textSize || s.textSize > m_textSize - s.payload
+                || std::string_view(m_text + s.payload, s.textSize) != k.text)
+                continue;
+        } else if (s.payload != k.payload) {
+            continue;
+        }
+        if (s.start > m_nodeCount || s.count > m_nodeCount - s.start)
+            break;
+        return ids(m_nodes + s.start, m_nodes + s.start + s.count);
+    }
+    return ids();
+}
@@ -0,0 +1,212 @@
+#ifndef TREE_INDEX_H
+#define TREE_INDEX_H
+
+#include "tree.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class mapped_file;
+
+/**
+ * @class tree_index
+ * @brief Хэш-индекс узлов дерева по значению.
+ * @remarks Узлы обозначаются номерами в прямом порядке обхода, как в tree_columns; по номеру
+ * узел находится через preorder. Значения разных типов различаются: строка "1", целое 1
+ * и вещественное 1.0 - разные ключи. Вещественные числа сравниваются по значению
+ * (0.0 и -0.0 совпадают), NaN совпадает с NaN.
+ * Индекс - таблица с открытой адресацией, разбитая на сегменты по старшим битам хэша:
+ * сегменты строятся независимо в потоках пула, а номера узлов одного значения лежат подряд
+ * по возрастанию. В файле индекс хранится в том же виде, что и в памяти, поэтому load
+ * только отображает файл в память, а поиск сразу читает отображённые страницы.
+ */
+class tree_index {
+public:
+    /// Номера узлов с одним значением
+    class ids {
+    public:
+        ids() noexcept = default;
+        ids(const uint64_t* first, const uint64_t* last) noexcept;
+
+        const uint64_t* begin() const noexcept;
+        const uint64_t* end() const noexcept;
+        size_t size() const noexcept;
+        bool empty() const noexcept;
+
+    private:
+        const uint64_t* m_first = nullptr;
+        const uint64_t* m_last = nullptr;
+    };
+
+    tree_index() = default;
+    tree_index(tree_index&&) = default;
+    tree_index& operator=(tree_index&&) = default;
+    tree_index(const tree_index&) = delete;
+    tree_index& operator=(const tree_index&) = delete;
+
+    /**
+     * @brief Строит индекс за один проход по дереву
+     * @param root корень дерева
+     * @param how Parallel чтобы хэшировать узлы и строить сегменты во всех потоках пула
+     * @return индекс
+     */
+    static tree_index build(const tree& root, tree::policy how = tree::policy::Parallel);
+
+    /**
+     * @brief Отображает в память индекс, сохранённый save
+     * @param path путь к файлу индекса
+     * @throw std::runtime_error если файл недоступен или не является индексом
+     * @return индекс
+     */
+    static tree_index load(const std::string& path);
+
+    /**
+     * @brief Сохраняет индекс в файл
+     * @remarks Числа записываются в порядке байтов машины
+     * @param path путь к файлу
+     * @throw std::runtime_error если записать не удалось
+     */
+    void save(const std::string& path) const;
+
+    /**
+     * @brief Узлы с целочисленным значением
+     * @param value значение
+     * @return номера узлов по возрастанию; действительны, пока жив индекс
+     */
+    ids find(int value) const;
+
+    /**
+     * @brief Узлы с числом с плавающей точкой
+     * @param value значение
+     * @return номера узлов по возрастанию; действительны, пока жив индекс
+     */
+    ids find(double value) const;
+
+    /**
+     * @brief Узлы со строкой
+     * @param value значение
+     * @return номера узлов по возрастанию; действительны, пока жив индекс
+     */
+    ids find(std::string_view value) const;
+
+    /**
+     * @brief Количество различных значений
+     */
+    size_t values() const noexcept;
+
+    /**
+     * @brief Количество узлов дерева
+     */
+    size_t nodes() const noexcept;
+
+    /**
+     * @brief Узлы дерева по номерам, которые использует индекс
+     * @param root корень дерева
+     * @return указатели на узлы в прямом порядке обхода
+     */
+    static std::vector<const tree*> preorder(const tree& root);
+
+private:
+    enum class kind : uint8_t {
+        Integer,
+        Double,
+        String
+    };
+
+    /// Ячейка таблицы: одно значение и его узлы
+    struct slot {
+        uint64_t hash;
+        /// целое, биты вещественного числа или начало строки в блоке текста
+        uint64_t payload;
+        /// начало номеров узлов
+        uint64_t start;
+        /// количество узлов; 0 - ячейка пуста
+        uint64_t count;
+        uint32_t textSize;
+        kind type;
+        uint8_t reserved[3];
+    };
+
+    /// Искомое значение в том виде, в каком оно лежит в ячейке
+    struct key {
+        uint64_t hash;
+        uint64_t payload;
+        std::string_view text;
+        kind type;
+    };
+
+    /// Сегмент индекса до размещения в общей таблице
+    struct segment;
+
+    static key keyOf(int value) noexcept;
+    static key keyOf(double value) noexcept;
+    static key keyOf(std::string_view value) noexcept;
+    static key keyOf(const tree& node) noexcept;
+
+    /**
+     * @brief Ищет ячейку значения
+     * @param k значение
+     * @return номера узлов; пусто если значения нет
+     */
+    ids lookup(const key& k) const;
+
+private:
+    unsigned m_shardBits = 0;
+    /// количество ячеек в одном сегменте, степень двойки
+    uint64_t m_shardSlots = 1;
+    size_t m_values = 0;
+
+    const slot* m_slots = nullptr;
+    const uint64_t* m_nodes = nullptr;
+    size_t m_nodeCount = 0;
+    const char* m_text = nullptr;
+    size_t m_textSize = 0;
+
+    /// данные построенного индекса
+    std::vector<slot> m_ownSlots;
+    std::vector<uint64_t> m_ownNodes;
+    std::vector<char> m_ownText;
+    /// данные загруженного индекса
+    std::shared_ptr<mapped_file> m_file;
+};
+
+inline tree_index::ids::ids(const uint64_t* first, const uint64_t* last) noexcept
+    : m_first(first)
+    , m_last(last)
+{
+}
+
+inline const uint64_t* tree_index::ids::begin() const noexcept
+{
+    return m_first;
+}
+
+inline const uint64_t* tree_index::ids::end() const noexcept
+{
+    return m_last;
+}
+
+inline size_t tree_index::ids::size() const noexcept
+{
+    return static_cast<size_t>(m_last - m_first);
+}
+
+inline bool tree_index::ids::empty() const noexcept
+{
+    return m_first == m_last;
+}
+
+inline size_t tree_index::values() const noexcept
+{
+    return m_values;
+}
+
+inline size_t tree_index::nodes() const noexcept
+{
+    return m_nodeCount;
+}
+
+#endif // TREE_INDEX_H
@@ -0,0 +1,315 @@
+#ifndef TREE_ITERATOR_H
+#define TREE_ITERATOR_H
+
+#include "tree.h"
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <vector>
+
+namespace detail {
+/**
+ * @brief Подсказка процессору загрузить в кэш узел
+ * @remarks Только адрес: чтение полей узла здесь было бы обычной загрузкой, которая
+ * ждёт промаха кэша и лишает подсказку смысла
+ * @param node узел, который скоро понадобится обходу
+ */
+inline void prefetchNode(const tree* node) noexcept
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(node);
+#else
+    (void)node;
+#endif
+}
+
+/**
+ * @class tree_stack_iterator
+ * @brief Общая часть итераторов обхода в глубину.
+ * @remarks Хранит путь от корня до текущего узла как стек диапазонов дочерних элементов,
+ * поэтому память обхода пропорциональна глубине дерева, а рекурсия не используется.
+ */
+class tree_stack_iterator {
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef tree value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const tree* pointer;
+    typedef const tree& reference;
+
+    reference operator*() const noexcept { return *m_stack.back().current; }
+    pointer operator->() const noexcept { return m_stack.back().current; }
+
+    /**
+     * @brief Глубина текущего узла; у корня обхода 0
+     */
+    unsigned depth() const noexcept { return static_cast<unsigned>(m_stack.size() - 1); }
+
+    /**
+     * @brief Родитель текущего узла
+     * @return указатель на родителя, nullptr для корня обхода
+     */
+    const tree* parent() const noexcept
+    {
+        return m_stack.size() > 1 ? m_stack[m_stack.size() - 2].current : nullptr;
+    }
+
+    bool operator==(const tree_stack_iterator& other) const noexcept
+    {
+        if (m_stack.empty() || other.m_stack.empty())
+            return m_stack.empty() == other.m_stack.empty();
+        return m_stack.back().current == other.m_stack.back().current;
+    }
+
+    bool operator!=(const tree_stack_iterator& other) const noexcept { return !(*this == other); }
+
+protected:
+    struct frame {
+        const tree* current;
+        const tree* end;
+    };
+
+    tree_stack_iterator() = default;
+
+    explicit tree_stack_iterator(const tree& root) { m_stack.push_back({ &root, &root + 1 }); }
+
+    /**
+     * @brief Спускается к первому дочернему элементу текущего узла
+     * @return false если дочерних элементов нет
+     */
+    bool descend()
+    {
+        const auto& childs = m_stack.back().current->childs();
+        if (childs.empty())
+            return false;
+        m_stack.push_back({ childs.data(), childs.data() + childs.size() });
+        prefetchChilds();
+        return true;
+    }
+
+    /**
+     * @brief Переходит к следующему брату текущего узла
+     * @return false если братьев больше нет
+     */
+    bool nextSibling()
+    {
+        auto& top = m_stack.back();
+        if (++top.current == top.end)
+            return false;
+        prefetchChilds();
+        return true;
+    }
+
+    /**
+     * @brief Подгружает первый дочерний элемент текущего узла - следующий узел обхода в глубину
+     * @remarks Текущий узел уже читается обходом, поэтому указатель на его дочерние элементы
+     * доступен без лишнего ожидания
+     */
+    void prefetchChilds() const noexcept
+    {
+        const auto& childs = m_stack.back().current->childs();
+        if (!childs.empty())
+            prefetchNode(childs.data());
+    }
+
+    std::vector<frame> m_stack;
+};
+} // end of namespace detail
+
+/**
+ * @class tree_preorder_iterator
+ * @brief Итератор прямого обхода дерева: узел посещается перед своими дочерними элементами
+ */
+class tree_preorder_iterator : public detail::tree_stack_iterator {
+public:
+    /**
+     * @brief Конструирует запредельный итератор
+     */
+    tree_preorder_iterator() = default;
+
+    /**
+     * @brief Конструирует итератор, указывающий на корень обхода
+     * @param root корень обхода
+     */
+    explicit tree_preorder_iterator(const tree& root)
+        : tree_stack_iterator(root)
+    {
+    }
+
+    tree_preorder_iterator& operator++()
+    {
+        if (descend())
+            return *this;
+        while (!m_stack.empty() && !nextSibling())
+            m_stack.pop_back();
+        return *this;
+    }
+
+    tree_preorder_iterator operator++(int)
+    {
+        auto ret = *this;
+        ++*this;
+        return ret;
+    }
+};
+
+/**
+ * @class tree_postorder_iterator
+ * @brief Итератор обратного обхода дерева: узел посещается после всех своих дочерних элементов
+ */
+class tree_postorder_iterator : public detail::tree_stack_iterator {
+public:
+    /**
+     * @brief Конструирует запредельный итератор
+     */
+    tree_postorder_iterator() = default;
+
+    /**
+     * @brief Конструирует итератор, указывающий на самый левый лист дерева
+     * @param root корень обхода
+     */
+    explicit tree_postorder_iterator(const tree& root)
+        : tree_stack_iterator(root)
+    {
+        while (descend()) {
+        }
+    }
+
+    tree_postorder_iterator& operator++()
+    {
+        if (nextSibling()) {
+            while (descend()) {
+            }
+        } else {
+            m_stack.pop_back();
+        }
+        return *this;
+    }
+
+    tree_postorder_iterator operator++(int)
+    {
+        auto ret = *this;
+        ++*this;
+        return ret;
+    }
+};
+
+/**
+ * @class tree_levelorder_iterator
+ * @brief Итератор обхода дерева в ширину: узлы посещаются по уровням, слева направо
+ * @remarks Память обхода пропорциональна ширине дерева
+ */
+class tree_levelorder_iterator {
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef tree value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const tree* pointer;
+    typedef const tree& reference;
+
+    /**
+     * @brief Конструирует запредельный итератор
+     */
+    tree_levelorder_iterator() = default;
+
+    /**
+     * @brief Конструирует итератор, указывающий на корень обхода
+     * @param root корень обхода
+     */
+    explicit tree_levelorder_iterator(const tree& root) { m_queue.push_back({ &root, nullptr, 0 }); }
+
+    reference operator*() const noexcept { return *m_queue.front().node; }
+    pointer operator->() const noexcept { return m_queue.front().node; }
+
+    /**
+     * @brief Глубина текущего узла; у корня обхода 0
+     */
+    unsigned depth() const noexcept { return m_queue.front().depth; }
+
+    /**
+     * @brief Родитель текущего узла
+     * @return указатель на родителя, nullptr для корня обхода
+     */
+    const tree* parent() const noexcept { return m_queue.front().parent; }
+
+    tree_levelorder_iterator& operator++()
+    {
+        auto current = m_queue.front();
+        m_queue.pop_front();
+        for (const auto& child : current.node->childs())
+            m_queue.push_back({ &child, current.node, current.depth + 1 });
+        // Новый текущий узел понадобится сразу, подсказка нужна для следующего за ним
+        if (m_queue.size() > 1)
+            detail::prefetchNode(m_queue[1].node);
+        return *this;
+    }
+
+    tree_levelorder_iterator operator++(int)
+    {
+        auto ret = *this;
+        ++*this;
+        return ret;
+    }
+
+    bool operator==(const tree_levelorder_iterator& other) const noexcept
+    {
+        if (m_queue.empty() || other.m_queue.empty())
+            return m_queue.empty() == other.m_queue.empty();
+        return m_queue.front().node == other.m_queue.front().node;
+    }
+
+    bool operator!=(const tree_levelorder_iterator& other) const noexcept { return !(*this == other); }
+
+private:
+    struct entry {
+        const tree* node;
+        const tree* parent;
+        unsigned depth;
+    };
+
+    std::deque<entry> m_queue;
+};
+
+/**
+ * @class tree_range
+ * @brief Диапазон обхода дерева для range-based for и алгоритмов <algorithm>
+ */
+template <typename TIterator>
+class tree_range {
+public:
+    typedef TIterator iterator;
+    typedef TIterator const_iterator;
+
+    /**
+     * @brief Конструирует диапазон обхода
+     * @param root корень обхода
+     * @warning время жизни диапазона и его итераторов не должно превышать время жизни дерева
+     */
+    explicit tree_range(const tree& root)
+        : m_root(&root)
+    {
+    }
+
+    iterator begin() const { return iterator(*m_root); }
+    iterator end() const { return iterator(); }
+
+private:
+    const tree* m_root;
+};
+
+inline tree_range<tree_preorder_iterator> tree::preorder() const
+{
+    return tree_range<tree_preorder_iterator>(*this);
+}
+
+inline tree_range<tree_postorder_iterator> tree::postorder() const
+{
+    return tree_range<tree_postorder_iterator>(*this);
+}
+
+inline tree_range<tree_levelorder_iterator> tree::levelorder() const
+{
+    return tree_range<tree_levelorder_iterator>(*this);
+}
+
+#endif // TREE_ITERATOR_H
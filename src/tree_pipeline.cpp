@@ -0,0 +1,509 @@
+#include "tree_pipeline.h"
+#include "tree.h"
+#include "tree_builder.h"
+#include "json/push_parser.h"
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+/// Сколько раз ожидающий этап проверяет очередь, не уступая процессор
+constexpr unsigned SPIN_TRIES = 64;
+/// Сколько раз затем проверяет, уступая процессор, прежде чем засыпать
+constexpr unsigned YIELD_TRIES = 256;
+/// Длительность сна между проверками долго пустой очереди
+constexpr std::chrono::microseconds SLEEP_TIME { 100 };
+
+bool isSpace(char c) noexcept
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+} // end of anonymous namespace
+
+tree_pipeline::event_builder::event_builder(tree_pipeline& owner, bool strict, bool keepNumberText)
+    : m_owner(owner)
+    , m_strict(strict)
+    , m_keepNumberText(keepNumberText)
+{
+    m_frames.reserve(64);
+}
+
+void tree_pipeline::event_builder::emit(node_event&& event)
+{
+    if (m_heldFrom > 0)
+        m_held.push_back(std::move(event));
+    else
+        m_owner.push(std::move(event));
+}
+
+void tree_pipeline::event_builder::open()
+{
+    auto& top = m_frames[m_depth - 1];
+    if (!top.hasValue) {
+        // Значение узла ещё впереди: события поддерева ждут его в m_held
+        top.openPos = m_held.size();
+        if (m_heldFrom == 0)
+            m_heldFrom = m_depth;
+        return;
+    }
+
+    node_event event;
+    event.depth = static_cast<unsigned>(m_depth - 1);
+    event.value = std::move(top.value);
+    event.numberText = std::move(top.numberText);
+    top.opened = true;
+    emit(std::move(event));
+}
+
+template <typename T>
+const char* tree_pipeline::event_builder::scalar(T&& value, std::string_view numberText)
+{
+    if (m_skip > 0)
+        return nullptr;
+
+    switch (m_role) {
+    case role::Node:
+        break;
+    case role::Tree:
+        return "tree node must be an object";
+    case role::Subnodes:
+        return "subnodes must be an array";
+    case role::Skip:
+        return nullptr;
+    }
+
+    auto& top = m_frames[m_depth - 1];
+    if (top.opened)
+        return "repeated node key after subnodes is not supported by the pipeline";
+    top.value = std::forward<T>(value);
+    top.hasValue = true;
+    if (m_keepNumberText && json::is_json_number(numberText))
+        top.numberText.assign(numberText);
+    else
+        top.numberText.clear();
+    if (top.openPos == NOT_HELD)
+        return nullptr;
+
+    // Ставим начало узла перед уже отложенными событиями его поддерева
+    node_event event;
+    event.depth = static_cast<unsigned>(m_depth - 1);
+    event.value = std::move(top.value);
+    event.numberText = std::move(top.numberText);
+    m_held.insert(m_held.begin() + static_cast<ptrdiff_t>(top.openPos), std::move(event));
+    top.opened = true;
+    top.openPos = NOT_HELD;
+    if (m_heldFrom == m_depth) {
+        m_heldFrom = 0;
+        for (auto& held : m_held)
+            m_owner.push(std::move(held));
+        m_held.clear();
+    }
+    return nullptr;
+}
+
+const char* tree_pipeline::event_builder::onNull()
+{
+    if (m_skip == 0 && m_role == role::Node)
+        return "node must be a string or a number";
+    if (m_skip > 0 || m_role == role::Skip)
+        return nullptr;
+    return (m_role == role::Tree) ? "tree node must be an object" : "subnodes must be an array";
+}
+
+const char* tree_pipeline::event_builder::onInteger(int value, std::string_view text)
+{
+    return scalar(value, text);
+}
+
+const char* tree_pipeline::event_builder::onDouble(double value, std::string_view text)
+{
+    return scalar(value, text);
+}
+
+const char* tree_pipeline::event_builder::onString(std::string_view value)
+{
+    if (m_skip > 0 || m_role == role::Skip)
+        return nullptr;
+    return scalar(std::string(value), std::string_view());
+}
+
+const char* tree_pipeline::event_builder::onKey(std::string_view key)
+{
+    if (m_skip > 0)
+        return nullptr;
+
+    switch (tree_builder::matchField(key)) {
+    case tree_builder::field::Node:
+        m_role = role::Node;
+        break;
+    case tree_builder::field::Subnodes:
+        m_role = role::Subnodes;
+        break;
+    case tree_builder::field::Unknown:
+        if (m_unknownKeys++ == 0)
+            m_firstUnknownKey.assign(key);
+        if (m_strict)
+            return "unknown key";
+        m_role = role::Skip;
+        break;
+    }
+    return nullptr;
+}
+
+const char* tree_pipeline::event_builder::onStartObject()
+{
+    if (m_skip > 0) {
+        ++m_skip;
+        return nullptr;
+    }
+
+    switch (m_role) {
+    case role::Tree:
+        // Начало первого дочернего элемента означает, что у родителя есть subnodes
+        if (m_depth > 0 && !m_frames[m_depth - 1].hasChildren) {
+            m_frames[m_depth - 1].hasChildren = true;
+            open();
+        }
+        if (m_depth == m_frames.size())
+            m_frames.emplace_back();
+        else
+            m_frames[m_depth] = frame();
+        ++m_depth;
+        return nullptr;
+    case role::Skip:
+        m_skip = 1;
+        return nullptr;
+    case role::Node:
+        return "node must be a string or a number";
+    case role::Subnodes:
+        return "subnodes must be an array";
+    }
+    return nullptr;
+}
+
+const char* tree_pipeline::event_builder::onEndObject()
+{
+    if (m_skip > 0) {
+        --m_skip;
+        return nullptr;
+    }
+
+    auto& top = m_frames[m_depth - 1];
+    if (!top.hasValue)
+        return "node not found";
+    if (!top.opened)
+        open();
+
+    node_event event;
+    event.type = node_event::kind::Close;
+    event.depth = static_cast<unsigned>(m_depth - 1);
+    emit(std::move(event));
+
+    --m_depth;
+    if (m_depth > 0)
+        m_role = role::Tree;
+    return nullptr;
+}
+
+const char* tree_pipeline::event_builder::onStartArray()
+{
+    if (m_skip > 0) {
+        ++m_skip;
+        return nullptr;
+    }
+
+    switch (m_role) {
+    case role::Subnodes:
+        // Выданных дочерних элементов уже не вернуть, поэтому заменить их повторный ключ не может
+        if (m_frames[m_depth - 1].hasChildren)
+            return "repeated subnodes key is not supported by the pipeline";
+        m_role = role::Tree;
+        return nullptr;
+    case role::Skip:
+        m_skip = 1;
+        return nullptr;
+    case role::Tree:
+        return "tree node must be an object";
+    case role::Node:
+        return "node must be a string or a number";
+    }
+    return nullptr;
+}
+
+const char* tree_pipeline::event_builder::onEndArray()
+{
+    if (m_skip > 0)
+        --m_skip;
+    return nullptr;
+}
+
+tree_pipeline::tree_pipeline(bool strict, bool keepNumberText)
+    : m_strict(strict)
+    , m_keepNumberText(keepNumberText)
+{
+}
+
+tree_pipeline::~tree_pipeline()
+{
+    m_stopped.store(true, std::memory_order_release);
+    join();
+}
+
+void tree_pipeline::addStage(transform_type transform)
+{
+    m_stages.push_back({ std::move(transform) });
+}
+
+void tree_pipeline::run(const std::function<void(event_builder&)>& parse,
+    const std::function<void(const node_event&)>& consumer)
+{
+    if (!m_batches.empty())
+        throw std::logic_error("tree_pipeline::run can be called only once");
+
+    // Пока один пакет заполняется и по одному обрабатывается на каждом этапе,
+    // ещё столько же ждут в очередях
+    auto count = 2 * (m_stages.size() + 2);
+    m_free = std::make_unique<mpsc_queue<batch*>>(count);
+    for (size_t i = 0; i < count; ++i) {
+        m_batches.push_back(std::make_unique<batch>());
+        m_batches.back()->events.reserve(BATCH_SIZE);
+        m_free->try_push(m_batches.back().get());
+    }
+    // В очереди помещаются все пакеты, поэтому отправка ждёт только при остановке
+    for (size_t i = 0; i <= m_stages.size(); ++i)
+        m_links.push_back(std::make_unique<spsc_queue<batch*>>(count));
+
+    for (size_t i = 0; i < m_stages.size(); ++i)
+        m_threads.emplace_back(&tree_pipeline::runStage, this, i);
+    m_threads.emplace_back([this, &consumer]() { runConsumer(consumer); });
+
+    try {
+        event_builder builder(*this, m_strict, m_keepNumberText);
+        parse(builder);
+        send(true);
+    } catch (const stopped&) {
+        // Ошибка другого этапа уже запомнена
+    } catch (...) {
+        fail(std::current_exception());
+    }
+    join();
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+template <typename TAttempt>
+void tree_pipeline::waitFor(TAttempt&& attempt)
+{
+    for (unsigned tries = 0; !attempt(); ++tries) {
+        if (m_stopped.load(std::memory_order_acquire))
+            throw stopped {};
+        if (tries < SPIN_TRIES)
+            continue;
+        if (tries < SPIN_TRIES + YIELD_TRIES)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(SLEEP_TIME);
+    }
+}
+
+void tree_pipeline::push(node_event&& event)
+{
+    if (!m_current)
+        waitFor([&]() { return m_free->try_pop(m_current); });
+    m_current->events.push_back(std::move(event));
+    if (m_current->events.size() >= BATCH_SIZE)
+        send(false);
+}
+
+void tree_pipeline::send(bool last)
+{
+    if (!m_current)
+        waitFor([&]() { return m_free->try_pop(m_current); });
+    m_current->last = last;
+    waitFor([&]() { return m_links.front()->try_push(m_current); });
+    m_current = nullptr;
+}
+
+void tree_pipeline::runStage(size_t index)
+{
+    try {
+        auto& in = *m_links[index];
+        auto& out = *m_links[index + 1];
+        for (;;) {
+            batch* b = nullptr;
+            waitFor([&]() { return in.try_pop(b); });
+            apply(m_stages[index], *b);
+            auto last = b->last;
+            // Пакет, отброшенный целиком, сразу возвращается разборщику
+            if (b->events.empty() && !last)
+                waitFor([&]() { return m_free->try_push(b); });
+            else
+                waitFor([&]() { return out.try_push(b); });
+            if (last)
+                break;
+        }
+    } catch (const stopped&) {
+    } catch (...) {
+        fail(std::current_exception());
+    }
+}
+
+void tree_pipeline::runConsumer(const std::function<void(const node_event&)>& consumer)
+{
+    try {
+        auto& in = *m_links.back();
+        for (;;) {
+            batch* b = nullptr;
+            waitFor([&]() { return in.try_pop(b); });
+            for (const auto& event : b->events)
+                consumer(event);
+            if (b->last)
+                break;
+            b->events.clear();
+            waitFor([&]() { return m_free->try_push(b); });
+        }
+    } catch (const stopped&) {
+    } catch (...) {
+        fail(std::current_exception());
+    }
+}
+
+void tree_pipeline::apply(stage& s, batch& b)
+{
+    auto& events = b.events;
+    size_t kept = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+        auto& event = events[i];
+        if (s.pruning) {
+            if (event.type == node_event::kind::Close && event.depth == s.pruneDepth)
+                s.pruning = false;
+            continue;
+        }
+        if (event.type == node_event::kind::Open && !s.transform(event)) {
+            if (event.depth == 0)
+                throw tree_exception("root node can't be pruned");
+            s.pruning = true;
+            s.pruneDepth = event.depth;
+            continue;
+        }
+        if (kept != i)
+            events[kept] = std::move(event);
+        ++kept;
+    }
+    events.resize(kept);
+}
+
+void tree_pipeline::fail(std::exception_ptr error)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+        if (!m_error)
+            m_error = std::move(error);
+    }
+    m_stopped.store(true, std::memory_order_release);
+}
+
+void tree_pipeline::join()
+{
+    for (auto& thread : m_threads) {
+        if (thread.joinable())
+            thread.join();
+    }
+    m_threads.clear();
+}
+
+tree_pipeline::transform_type tree_pipeline::trimStrings()
+{
+    return [](node_event& event) {
+        if (auto str = std::get_if<std::string>(&event.value)) {
+            size_t end = str->size();
+            while (end > 0 && isSpace((*str)[end - 1]))
+                --end;
+            size_t begin = 0;
+            while (begin < end && isSpace((*str)[begin]))
+                ++begin;
+            str->erase(end);
+            str->erase(0, begin);
+        }
+        return true;
+    };
+}
+
+tree_pipeline::transform_type tree_pipeline::lowercase()
+{
+    return [](node_event& event) {
+        if (auto str = std::get_if<std::string>(&event.value)) {
+            // Байты многобайтовых символов UTF-8 не попадают в диапазон 'A'-'Z'
+            for (auto& c : *str) {
+                if (c >= 'A' && c <= 'Z')
+                    c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        return true;
+    };
+}
+
+tree_pipeline::transform_type tree_pipeline::scaleNumbers(double factor)
+{
+    bool integral = std::trunc(factor) == factor;
+    return [factor, integral](node_event& event) {
+        if (auto integer = std::get_if<int>(&event.value)) {
+            auto scaled = *integer * factor;
+            if (integral && scaled >= INT_MIN && scaled <= INT_MAX)
+                event.value = static_cast<int>(scaled);
+            else
+                event.value = scaled;
+            event.numberText.clear();
+        } else if (auto number = std::get_if<double>(&event.value)) {
+            *number *= factor;
+            event.numberText.clear();
+        }
+        return true;
+    };
+}
+
+tree_pipeline::transform_type tree_pipeline::pruneDeeperThan(unsigned depth)
+{
+    return [depth](node_event& event) { return event.depth <= depth; };
+}
+
+void node_event_writer::write(const node_event& event, std::string& out)
+{
+    // Узел глубины level - объект уровня 2 * level, его массив subnodes - уровня 2 * level + 1
+    auto level = event.depth;
+    if (event.type == node_event::kind::Open) {
+        if (m_previous == node_event::kind::Open && m_started) {
+            // Первый дочерний элемент открывает массив subnodes родителя
+            out += ",\n";
+            indent(out, level * 2 - 1);
+            out += '"';
+            out += tree::SUBNODES_KEY;
+            out += "\" : [\n";
+        } else if (m_started) {
+            out += ",\n";
+        }
+        indent(out, level * 2);
+        out += "{\n";
+        indent(out, level * 2 + 1);
+        out += '"';
+        out += tree::NODE_KEY;
+        out += "\" : ";
+        tree::appendValue(out, event.value, event.numberText);
+    } else {
+        out += '\n';
+        if (m_previous == node_event::kind::Close) {
+            indent(out, level * 2 + 1);
+            out += "]\n";
+        }
+        indent(out, level * 2);
+        out += '}';
+    }
+    m_previous = event.type;
+    m_started = true;
+}
+
+void node_event_writer::indent(std::string& out, unsigned count)
+{
+    out.append(count, ' ');
+}
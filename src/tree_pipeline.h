@@ -0,0 +1,338 @@
+#ifndef TREE_PIPELINE_H
+#define TREE_PIPELINE_H
+
+#include "mpsc_queue.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+/**
+ * @struct node_event
+ * @brief Событие обхода дерева в прямом порядке: начало или конец узла.
+ * @remarks Последовательность событий совпадает с обходом tree::preorder, в котором
+ * дополнительно отмечен конец каждого узла, поэтому по ней можно потоково записать текст дерева
+ */
+struct node_event {
+    enum class kind : uint8_t {
+        /// начало узла; значение узла заполнено
+        Open,
+        /// конец узла; значение не используется
+        Close
+    };
+
+    kind type = kind::Open;
+    /// глубина узла, у корня 0
+    unsigned depth = 0;
+    std::variant<std::string, int, double> value;
+    /// исходный текст числа (см. tree::numberText)
+    std::string numberText;
+};
+
+/**
+ * @class tree_pipeline
+ * @brief Конвейер "разбор - преобразования - запись", не строящий дерево в памяти.
+ * @remarks Разборщик выдаёт события узлов (node_event) пакетами; каждое преобразование
+ * работает в своём потоке, потребитель (запись результата) - тоже. Соседние этапы связаны
+ * очередями без блокировок на одного производителя и одного потребителя (spsc_queue),
+ * а опустевшие пакеты возвращаются разборщику через общую очередь (mpsc_queue): их отдаёт
+ * и потребитель, и любое преобразование, отбросившее пакет целиком.
+ * Количество пакетов постоянно, поэтому быстрый разборщик ждёт медленные этапы
+ * и память ограничена независимо от размера дерева. Исключение - узлы, у которых ключ
+ * tree::NODE_FN записан после дочерних элементов: события их поддерева держатся в памяти,
+ * пока не станет известно значение узла.
+ * Грамматика и сообщения об ошибках совпадают с tree_builder, но повторные ключи
+ * tree::NODE_FN и tree::SUBNODES_FN в одном узле допускаются, только пока дочерние
+ * элементы узла ещё не выданы.
+ */
+class tree_pipeline {
+public:
+    /**
+     * @brief Преобразование узла
+     * @remarks Вызывается для событий начала узлов в прямом порядке и может менять значение узла.
+     * Если вернуло false, узел вместе с поддеревом отбрасывается
+     */
+    typedef std::function<bool(node_event&)> transform_type;
+
+    /// Максимальное количество событий в пакете
+    static constexpr size_t BATCH_SIZE = 4096;
+
+    /**
+     * @class event_builder
+     * @brief Обработчик json::push_parser и json::binary_parser, выдающий события узлов в конвейер
+     */
+    class event_builder {
+    public:
+        const char* onNull();
+        const char* onInteger(int value, std::string_view text);
+        const char* onDouble(double value, std::string_view text);
+        const char* onString(std::string_view value);
+        const char* onKey(std::string_view key);
+        const char* onStartObject();
+        const char* onEndObject();
+        const char* onStartArray();
+        const char* onEndArray();
+
+        /**
+         * @brief Количество пропущенных посторонних ключей
+         */
+        size_t unknownKeys() const noexcept;
+
+        /**
+         * @brief Первый пропущенный посторонний ключ
+         */
+        const std::string& firstUnknownKey() const noexcept;
+
+    private:
+        friend class tree_pipeline;
+
+        enum class role : uint8_t {
+            Tree,
+            Node,
+            Subnodes,
+            Skip
+        };
+
+        /// Незакрытый узел
+        struct frame {
+            std::variant<std::string, int, double> value;
+            std::string numberText;
+            /// значение узла задано
+            bool hasValue = false;
+            /// начало узла выдано
+            bool opened = false;
+            /// начался хотя бы один дочерний элемент
+            bool hasChildren = false;
+            /// место события начала узла в m_held или NOT_HELD
+            size_t openPos = NOT_HELD;
+        };
+
+        static constexpr size_t NOT_HELD = SIZE_MAX;
+
+        event_builder(tree_pipeline& owner, bool strict, bool keepNumberText);
+
+        template <typename T>
+        const char* scalar(T&& value, std::string_view numberText);
+
+        /**
+         * @brief Выдаёт событие в конвейер или откладывает его, пока не известно значение предка
+         * @param event событие
+         */
+        void emit(node_event&& event);
+
+        /**
+         * @brief Выдаёт начало узла на вершине стека или отмечает, что его события откладываются
+         */
+        void open();
+
+    private:
+        tree_pipeline& m_owner;
+        bool m_strict;
+        bool m_keepNumberText;
+        std::vector<frame> m_frames;
+        size_t m_depth = 0;
+        role m_role = role::Tree;
+        /// глубина вложенности внутри значения постороннего ключа
+        size_t m_skip = 0;
+        /// отложенные события
+        std::vector<node_event> m_held;
+        /// глубина (с 1) самого внешнего узла, чьи события откладываются; 0 - ничего не откладывается
+        size_t m_heldFrom = 0;
+        size_t m_unknownKeys = 0;
+        std::string m_firstUnknownKey;
+    };
+
+    /**
+     * @brief Создаёт конвейер без преобразований
+     * @param strict true чтобы считать посторонние ключи ошибкой
+     * @param keepNumberText true чтобы сохранять исходный текст чисел
+     */
+    explicit tree_pipeline(bool strict = false, bool keepNumberText = false);
+
+    /**
+     * @brief Останавливает потоки этапов, если run не дождался их из-за ошибки
+     */
+    ~tree_pipeline();
+
+    tree_pipeline(const tree_pipeline&) = delete;
+    tree_pipeline& operator=(const tree_pipeline&) = delete;
+
+    /**
+     * @brief Добавляет этап преобразования в конец конвейера
+     * @remarks Выполнять перед вызовом run
+     * @param transform преобразование
+     */
+    void addStage(transform_type transform);
+
+    /**
+     * @brief Прогоняет дерево через конвейер
+     * @remarks Разбор выполняется в вызывающем потоке, преобразования и потребитель - в своих.
+     * Первая ошибка любого этапа останавливает весь конвейер и выбрасывается из run.
+     * Вызывается один раз
+     * @param parse функция, передающая разборщику обработчик; завершается после конца документа
+     * @param consumer потребитель событий
+     * @throw json::json_exception если разбор не удался
+     * @throw tree_exception если отброшен корень дерева
+     */
+    void run(const std::function<void(event_builder&)>& parse,
+        const std::function<void(const node_event&)>& consumer);
+
+    /**
+     * @brief Преобразование, удаляющее пробельные символы ASCII в начале и конце строк
+     */
+    static transform_type trimStrings();
+
+    /**
+     * @brief Преобразование, переводящее буквы ASCII в строках в нижний регистр
+     */
+    static transform_type lowercase();
+
+    /**
+     * @brief Преобразование, умножающее числа на коэффициент
+     * @remarks Целое число остаётся целым, если коэффициент целый и результат помещается в int.
+     * Исходный текст числа отбрасывается
+     * @param factor коэффициент
+     */
+    static transform_type scaleNumbers(double factor);
+
+    /**
+     * @brief Преобразование, отбрасывающее узлы глубже заданной
+     * @param depth максимальная глубина; у корня 0
+     */
+    static transform_type pruneDeeperThan(unsigned depth);
+
+private:
+    /// Пакет событий
+    struct batch {
+        std::vector<node_event> events;
+        /// последний пакет документа
+        bool last = false;
+    };
+
+    /// Этап преобразования
+    struct stage {
+        transform_type transform;
+        /// отбрасывается поддерево узла глубины pruneDepth
+        bool pruning = false;
+        unsigned pruneDepth = 0;
+    };
+
+    /// Выбрасывается в потоке этапа, когда конвейер остановлен из-за ошибки другого этапа
+    struct stopped {
+    };
+
+    /**
+     * @brief Ждёт, пока действие не удастся, сначала активно, затем уступая процессор
+     * @param attempt действие, например try_pop очереди
+     * @throw stopped если конвейер остановлен
+     */
+    template <typename TAttempt>
+    void waitFor(TAttempt&& attempt);
+
+    /**
+     * @brief Добавляет событие в текущий пакет разборщика и отправляет заполненный пакет
+     * @param event событие
+     */
+    void push(node_event&& event);
+
+    /**
+     * @brief Отправляет текущий пакет разборщика первому этапу
+     * @param last true если документ закончился
+     */
+    void send(bool last);
+
+    /**
+     * @brief Тело потока преобразования
+     * @param index номер этапа
+     */
+    void runStage(size_t index);
+
+    /**
+     * @brief Тело потока потребителя
+     * @param consumer потребитель событий
+     */
+    void runConsumer(const std::function<void(const node_event&)>& consumer);
+
+    /**
+     * @brief Применяет преобразование к пакету
+     * @param s этап
+     * @param b пакет
+     * @throw tree_exception если отброшен корень дерева
+     */
+    static void apply(stage& s, batch& b);
+
+    /**
+     * @brief Останавливает конвейер, запоминая первую ошибку
+     * @param error ошибка
+     */
+    void fail(std::exception_ptr error);
+
+    /**
+     * @brief Дожидается завершения потоков этапов
+     */
+    void join();
+
+private:
+    bool m_strict;
+    bool m_keepNumberText;
+    std::vector<stage> m_stages;
+    std::vector<std::unique_ptr<batch>> m_batches;
+    /// очереди между соседними этапами: [0] - от разборщика, последняя - к потребителю
+    std::vector<std::unique_ptr<spsc_queue<batch*>>> m_links;
+    /// опустевшие пакеты, возвращаемые разборщику
+    std::unique_ptr<mpsc_queue<batch*>> m_free;
+    /// пакет, заполняемый разборщиком
+    batch* m_current = nullptr;
+    std::vector<std::thread> m_threads;
+    std::atomic<bool> m_stopped { false };
+    std::exception_ptr m_error;
+    std::mutex m_errorMutex;
+};
+
+inline size_t tree_pipeline::event_builder::unknownKeys() const noexcept
+{
+    return m_unknownKeys;
+}
+
+inline const std::string& tree_pipeline::event_builder::firstUnknownKey() const noexcept
+{
+    return m_firstUnknownKey;
+}
+
+/**
+ * @class node_event_writer
+ * @brief Потоковая запись событий узлов в JSON.
+ * @remarks Текст совпадает с tree::serialize. Разделители после узла
+ * зависят от следующего события, поэтому дописываются при его записи
+ */
+class node_event_writer {
+public:
+    /**
+     * @brief Дописывает текст события
+     * @param event событие
+     * @param out текст
+     */
+    void write(const node_event& event, std::string& out);
+
+private:
+    /**
+     * @brief Дописывает отступ
+     * @param out текст
+     * @param count количество пробелов
+     */
+    static void indent(std::string& out, unsigned count);
+
+private:
+    bool m_started = false;
+    node_event::kind m_previous = node_event::kind::Open;
+};
+
+#endif // TREE_PIPELINE_H
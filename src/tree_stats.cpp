@@ -0,0 +1,71 @@
+#include "tree_stats.h"
+#include "tree.h"
+
+namespace {
+size_t lengthBucket(size_t length)
+{
+    size_t bucket = 0;
+    while (length != 0 && bucket + 1 < tree_stats::HISTOGRAM_SIZE) {
+        length >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+} // end of anonymous namespace
+
+tree_stats tree_stats::collect(const tree& tree, bool parallel)
+{
+    auto visit = [](tree_stats acc, const ::tree& node, unsigned level) {
+        ++acc.nodes;
+        acc.depth = std::max(acc.depth, size_t(level) + 1);
+        if (node.isInteger()) {
+            ++acc.integers;
+            acc.sum += node.asInteger();
+        } else if (node.isDouble()) {
+            ++acc.doubles;
+            acc.sum += node.asDouble();
+        } else if (node.isString()) {
+            ++acc.strings;
+            ++acc.lengths[lengthBucket(node.asString().size())];
+        }
+        return acc;
+    };
+    auto combine = [](tree_stats a, const tree_stats& b) { return a += b; };
+
+    return tree.reduce(tree_stats {}, visit, combine,
+        parallel ? tree::policy::Parallel : tree::policy::Sequential);
+}
+
+tree_stats& tree_stats::operator+=(const tree_stats& other)
+{
+    nodes += other.nodes;
+    integers += other.integers;
+    doubles += other.doubles;
+    strings += other.strings;
+    depth = std::max(depth, other.depth);
+    sum += other.sum;
+    for (size_t i = 0; i < lengths.size(); ++i)
+        lengths[i] += other.lengths[i];
+    return *this;
+}
+
+std::ostream& operator<<(std::ostream& os, const tree_stats& stats)
+{
+    os << "nodes: " << stats.nodes << '\n'
+       << "integers: " << stats.integers << '\n'
+       << "doubles: " << stats.doubles << '\n'
+       << "strings: " << stats.strings << '\n'
+       << "depth: " << stats.depth << '\n'
+       << "numeric sum: " << stats.sum << '\n'
+       << "string lengths:" << '\n';
+    for (size_t i = 0; i < stats.lengths.size(); ++i) {
+        if (stats.lengths[i] == 0)
+            continue;
+        if (i <= 1)
+            os << "  " << i;
+        else
+            os << "  " << (size_t(1) << (i - 1)) << '-' << ((size_t(1) << i) - 1);
+        os << ": " << stats.lengths[i] << '\n';
+    }
+    return os;
+}
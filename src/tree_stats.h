@@ -0,0 +1,54 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <array>
+#include <cstddef>
+#include <ostream>
+
+class tree;
+
+/**
+ * @struct tree_stats
+ * @brief Сводная статистика по узлам дерева
+ */
+struct tree_stats {
+    /// Количество корзин гистограммы длин строк
+    static constexpr size_t HISTOGRAM_SIZE = 33;
+
+    /// количество узлов
+    size_t nodes = 0;
+    /// количество узлов с целочисленным значением
+    size_t integers = 0;
+    /// количество узлов с числом с плавающей точкой
+    size_t doubles = 0;
+    /// количество узлов со строкой
+    size_t strings = 0;
+    /// максимальная глубина; дерево из одного корня имеет глубину 1
+    size_t depth = 0;
+    /// сумма всех числовых значений
+    double sum = 0;
+    /// гистограмма длин строк: корзина 0 - пустые строки, корзина k - длины [2^(k-1), 2^k)
+    std::array<size_t, HISTOGRAM_SIZE> lengths {};
+
+    /**
+     * @brief Собирает статистику по дереву
+     * @param tree дерево
+     * @param parallel true чтобы обходить дерево в нескольких потоках
+     * @return статистика
+     */
+    static tree_stats collect(const tree& tree, bool parallel = true);
+
+    /**
+     * @brief Объединяет статистику двух независимых частей дерева
+     * @param other статистика другой части
+     * @return ссылка на this
+     */
+    tree_stats& operator+=(const tree_stats& other);
+};
+
+/**
+ * @brief Печатает статистику в человекочитаемом виде
+ */
+std::ostream& operator<<(std::ostream& os, const tree_stats& stats);
+
+#endif // TREE_STATS_H
@@ -0,0 +1,164 @@
+#include "validator.h"
+#include <algorithm>
+
+validator::validator()
+    : m_parser(m_schema)
+{
+}
+
+validator::validator(json::binary_format format)
+    : m_parser(m_schema)
+{
+    m_binary.emplace(m_schema, format);
+}
+
+bool validator::feed(std::string_view chunk)
+{
+    return m_binary ? m_binary->feed(chunk) : m_parser.feed(chunk);
+}
+
+validator::result validator::finish()
+{
+    result res;
+    res.valid = m_binary ? m_binary->finish() : m_parser.finish();
+    res.nodes = m_schema.m_nodes;
+    res.depth = m_schema.m_maxDepth;
+    if (!res.valid && m_binary) {
+        res.message = m_binary->message();
+        res.offset = m_binary->offset();
+    } else if (!res.valid) {
+        res.message = m_parser.message();
+        res.offset = m_parser.offset();
+        res.line = m_parser.line();
+        res.column = m_parser.column();
+    }
+    return res;
+}
+
+validator::result validator::validate(std::string_view text)
+{
+    validator v;
+    v.feed(text);
+    return v.finish();
+}
+
+validator::schema::schema()
+{
+    m_stack.reserve(64);
+}
+
+const char* validator::schema::scalar(bool null)
+{
+    switch (m_role) {
+    case role::Tree:
+        return "tree node must be an object";
+    case role::Subnodes:
+        return "subnodes must be an array";
+    case role::Node:
+        if (null)
+            return "node must be a string or a number";
+        break;
+    case role::Any:
+        break;
+    }
+    return nullptr;
+}
+
+const char* validator::schema::onNull()
+{
+    return scalar(true);
+}
+
+const char* validator::schema::onInteger(int, std::string_view)
+{
+    return scalar(false);
+}
+
+const char* validator::schema::onDouble(double, std::string_view)
+{
+    return scalar(false);
+}
+
+const char* validator::schema::onString(std::string_view)
+{
+    return scalar(false);
+}
+
+const char* validator::schema::onKey(std::string_view key)
+{
+    auto& top = m_stack.back();
+    m_role = role::Any;
+    if (top == frame::Tree || top == frame::TreeWithNode) {
+        if (key == "node") {
+            m_role = role::Node;
+            top = frame::TreeWithNode;
+        } else if (key == "subnodes") {
+            m_role = role::Subnodes;
+        }
+    }
+    return nullptr;
+}
+
+const char* validator::schema::onStartObject()
+{
+    switch (m_role) {
+    case role::Tree:
+        m_stack.push_back(frame::Tree);
+        ++m_nodes;
+        m_maxDepth = std::max(m_maxDepth, ++m_depth);
+        return nullptr;
+    case role::Any:
+        m_stack.push_back(frame::AnyObject);
+        return nullptr;
+    case role::Node:
+        return "node must be a string or a number";
+    case role::Subnodes:
+        return "subnodes must be an array";
+    }
+    return nullptr;
+}
+
+const char* validator::schema::onEndObject()
+{
+    auto top = m_stack.back();
+    if (top == frame::Tree)
+        return "node not found";
+    if (top == frame::TreeWithNode)
+        --m_depth;
+    m_stack.pop_back();
+    afterClose();
+    return nullptr;
+}
+
+const char* validator::schema::onStartArray()
+{
+    switch (m_role) {
+    case role::Subnodes:
+        m_stack.push_back(frame::Subnodes);
+        m_role = role::Tree;
+        return nullptr;
+    case role::Any:
+        m_stack.push_back(frame::AnyArray);
+        return nullptr;
+    case role::Tree:
+        return "tree node must be an object";
+    case role::Node:
+        return "node must be a string or a number";
+    }
+    return nullptr;
+}
+
+const char* validator::schema::onEndArray()
+{
+    m_stack.pop_back();
+    afterClose();
+    return nullptr;
+}
+
+void validator::schema::afterClose()
+{
+    // Следующим значением может быть только очередной элемент открытого массива,
+    // роль значений объекта задаётся их ключом
+    if (!m_stack.empty())
+        m_role = (m_stack.back() == frame::Subnodes) ? role::Tree : role::Any;
+}
@@ -0,0 +1,137 @@
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include "json/binary_parser.h"
+#include "json/push_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class validator
+ * @brief Проверка документа на соответствие схеме дерева без построения дерева.
+ * @remarks Проверяется синтаксис JSON (в том же объёме, что и у json::value::parse)
+ * и схема tree: корень и каждый элемент "subnodes" - объекты с полем "node",
+ * значение "node" - строка или число, значение "subnodes" - массив.
+ * Проверка выполняется за один проход по тексту, без выделения памяти на каждый узел:
+ * память нужна только под стек вложенности, который растёт с глубиной документа.
+ * Текст можно передавать кусками произвольной длины. Документ в MessagePack или CBOR
+ * проверяется по той же схеме, позиция ошибки в нём - только смещение.
+ */
+class validator {
+public:
+    /// Результат проверки документа
+    struct result {
+        /// true если документ является корректным деревом
+        bool valid = false;
+        /// количество узлов дерева (объектов со схемой tree), просмотренных до конца проверки
+        size_t nodes = 0;
+        /// максимальная глубина дерева; дерево из одного корня имеет глубину 1
+        size_t depth = 0;
+        /// смещение в байтах первой ошибки от начала текста
+        size_t offset = 0;
+        /// номер строки первой ошибки, начиная с 1; 0 для двоичных форматов
+        size_t line = 0;
+        /// номер столбца первой ошибки, начиная с 1; 0 для двоичных форматов
+        size_t column = 0;
+        /// описание первой ошибки, nullptr если ошибок нет
+        const char* message = nullptr;
+    };
+
+    /**
+     * @brief Конструирует валидатор для нового документа в JSON
+     */
+    validator();
+
+    /**
+     * @brief Конструирует валидатор для нового документа в двоичном формате
+     * @param format формат документа
+     */
+    explicit validator(json::binary_format format);
+
+    validator(const validator&) = delete;
+    validator& operator=(const validator&) = delete;
+
+    /**
+     * @brief Проверяет очередной кусок текста документа
+     * @param chunk кусок текста
+     * @return false если ошибка уже обнаружена, дальнейшие куски можно не передавать
+     */
+    bool feed(std::string_view chunk);
+
+    /**
+     * @brief Завершает проверку документа
+     * @return результат проверки
+     */
+    result finish();
+
+    /**
+     * @brief Проверяет текст документа целиком
+     * @param text текст документа
+     * @return результат проверки
+     */
+    static result validate(std::string_view text);
+
+    /// Обработчик json::push_parser, проверяющий схему дерева
+    class schema {
+    public:
+        schema();
+
+        const char* onNull();
+        const char* onInteger(int value, std::string_view text);
+        const char* onDouble(double value, std::string_view text);
+        const char* onString(std::string_view value);
+        const char* onKey(std::string_view key);
+        const char* onStartObject();
+        const char* onEndObject();
+        const char* onStartArray();
+        const char* onEndArray();
+
+    private:
+        friend class validator;
+
+        /// Чем должно быть очередное значение с точки зрения схемы
+        enum class role : uint8_t {
+            Tree,
+            Node,
+            Subnodes,
+            Any
+        };
+
+        /// Открытый контейнер на стеке вложенности
+        enum class frame : uint8_t {
+            Tree,
+            TreeWithNode,
+            Subnodes,
+            AnyObject,
+            AnyArray
+        };
+
+        /**
+         * @brief Проверяет скалярное значение с учётом его роли
+         * @param null true для null, false для строки или числа
+         */
+        const char* scalar(bool null);
+
+        /**
+         * @brief Вычисляет роль следующего значения после закрытия контейнера
+         */
+        void afterClose();
+
+        std::vector<frame> m_stack;
+        role m_role = role::Tree;
+        size_t m_depth = 0;
+        size_t m_nodes = 0;
+        size_t m_maxDepth = 0;
+    };
+
+private:
+    schema m_schema;
+    json::push_parser<schema> m_parser;
+    /// парсер двоичного формата; если задан, m_parser не используется
+    std::optional<json::binary_parser<schema>> m_binary;
+};
+
+#endif // VALIDATOR_H
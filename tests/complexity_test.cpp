@@ -0,0 +1,265 @@
+#include "alloc_stats.h"
+#include "json/value.h"
+#include "tree.h"
+#include "tree_builder.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Проверка сложности загрузки и сохранения дерева.
+ * Для деревьев разной формы и удваивающегося размера измеряются время и количество выделений памяти
+ * на каждом этапе; показатель степени роста находится методом наименьших квадратов в логарифмическом
+ * масштабе. Рост хуже линейного (показатель выше порога) считается ошибкой. Квадратичная регрессия
+ * даёт показатель около 2 и не проходит порог с большим запасом.
+ * Рост считается относительно объёма обработанного текста: при загрузке - входного, при сохранении -
+ * выходного. Для большинства деревьев он пропорционален количеству узлов, но отступы в выходном тексте
+ * цепочки дают O(n^2) байт, и линейное по узлам сохранение для неё невозможно.
+ * Отдельно по точным счётчикам выделений проверяется, что построение дерева не копирует поддеревья.
+ */
+
+namespace {
+/// Размеры деревьев: каждый следующий вдвое больше предыдущего
+constexpr size_t MIN_NODES = 1 << 12;
+constexpr size_t MAX_NODES = 1 << 15;
+/// Размер дерева для проверки построения. Счётчики выделений точны и на малых деревьях, а рекурсивный
+/// разбор через AST в json::value::parse не выдерживает цепочек глубже нескольких сотен узлов
+constexpr size_t CONSTRUCTION_NODES = 1 << 8;
+/// Время берётся лучшим из нескольких запусков, чтобы отсечь помехи от других процессов
+constexpr int REPEATS = 5;
+/// Допустимые показатели роста. Счётчики выделений детерминированы, время шумит и
+/// растёт быстрее из-за кэшей, поэтому его порог мягче
+constexpr double MAX_ALLOC_EXPONENT = 1.1;
+constexpr double MAX_TIME_EXPONENT = 1.4;
+
+/// Замер этапа на дереве одного размера
+struct sample {
+    size_t nodes = 0;
+    /// объём обработанного текста в байтах
+    size_t bytes = 0;
+    double seconds = 0;
+    size_t allocations = 0;
+};
+
+/**
+ * @brief Текст узла дерева без закрывающей скобки
+ * @param id номер узла; чётные узлы - числа, нечётные - строки
+ * @param hasChilds true если за значением следует массив дочерних узлов
+ */
+std::string openNode(size_t id, bool hasChilds)
+{
+    auto value = (id % 2) ? "\"long enough string " + std::to_string(id) + "\"" : std::to_string(id);
+    return "{\"node\": " + value + (hasChilds ? ", \"subnodes\": [" : "");
+}
+
+/**
+ * @brief Цепочка: у каждого узла один дочерний узел
+ */
+std::string deepChain(size_t nodes)
+{
+    std::string text;
+    for (size_t i = 0; i < nodes; ++i)
+        text += openNode(i, i + 1 < nodes);
+    for (size_t i = 0; i < nodes; ++i)
+        text += (i == 0) ? "}" : "]}";
+    return text;
+}
+
+/**
+ * @brief Веер: все узлы, кроме корня, - листья корня
+ */
+std::string wideFan(size_t nodes)
+{
+    auto text = openNode(0, true);
+    for (size_t i = 1; i < nodes; ++i) {
+        if (i > 1)
+            text += ", ";
+        text += openNode(i, false) + "}";
+    }
+    return text + "]}";
+}
+
+/**
+ * @brief Сбалансированное двоичное дерево: дочерние узлы узла i - 2i + 1 и 2i + 2
+ */
+std::string balanced(size_t nodes)
+{
+    std::string text;
+    std::function<void(size_t)> write = [&](size_t id) {
+        auto left = id * 2 + 1;
+        text += openNode(id, left < nodes);
+        if (left < nodes) {
+            write(left);
+            if (left + 1 < nodes) {
+                text += ", ";
+                write(left + 1);
+            }
+            text += ']';
+        }
+        text += '}';
+    };
+    write(0);
+    return text;
+}
+
+/**
+ * @brief Выполняет этап несколько раз
+ * @param nodes размер дерева
+ * @param bytes объём текста, обрабатываемого этапом
+ * @param stage этап
+ * @return лучшее время и количество выделений памяти за один запуск
+ */
+sample measure(size_t nodes, size_t bytes, const std::function<void()>& stage)
+{
+    sample ret;
+    ret.nodes = nodes;
+    ret.bytes = bytes;
+    ret.seconds = INFINITY;
+    for (int i = 0; i < REPEATS; ++i) {
+        auto before = alloc_stats::current();
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        ret.seconds = std::min(ret.seconds, elapsed.count());
+        ret.allocations = alloc_stats::delta(before, alloc_stats::current()).allocations;
+    }
+    return ret;
+}
+
+/**
+ * @brief Показатель степени зависимости величины от объёма текста
+ * @remarks Наклон прямой, приближающей точки (log bytes, log y) методом наименьших квадратов
+ */
+template <typename TMetric>
+double exponent(const std::vector<sample>& samples, TMetric metric)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (const auto& s : samples) {
+        auto x = std::log(static_cast<double>(s.bytes));
+        auto y = std::log(std::max(static_cast<double>(s.*metric), 1e-9));
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    auto n = static_cast<double>(samples.size());
+    return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+/**
+ * @brief Проверяет рост времени и выделений памяти этапа
+ * @return true если рост не хуже линейного
+ */
+bool check(const char* shape, const char* stage, const std::vector<sample>& samples)
+{
+    auto timeExp = exponent(samples, &sample::seconds);
+    auto allocExp = exponent(samples, &sample::allocations);
+    bool ok = timeExp <= MAX_TIME_EXPONENT && allocExp <= MAX_ALLOC_EXPONENT;
+
+    std::printf("%-8s %-5s", shape, stage);
+    for (const auto& s : samples)
+        std::printf("  %zu: %.2f ms, %zu allocs", s.nodes, s.seconds * 1e3, s.allocations);
+    std::printf("\n%-14s time ~ bytes^%.2f, allocations ~ bytes^%.2f%s\n", "", timeExp, allocExp, ok ? "" : "  FAILED");
+    return ok;
+}
+
+/**
+ * @brief Количество выделений памяти при выполнении функции
+ */
+size_t countAllocations(const std::function<void()>& func)
+{
+    auto before = alloc_stats::current();
+    func();
+    return alloc_stats::delta(before, alloc_stats::current()).allocations;
+}
+
+/**
+ * @brief Проверяет, что построение дерева из n и 2n узлов не копирует поддеревья
+ * @remarks Строковые значения длиннее буфера короткой строки, так что каждая копия строки - выделение.
+ * Копирование поддерева на каждом уровне, как было в tree::parse, даёт O(n * depth) выделений.
+ * При перемещении tree::parse выделяет только массивы дочерних узлов, то есть меньше выделений,
+ * чем узлов; копии строк эту границу нарушают. Перемещение готового дерева не выделяет памяти вовсе
+ * @param shape название формы дерева
+ * @param generate генератор текста дерева
+ * @param nodes меньший из двух размеров
+ * @return true если проверки прошли
+ */
+bool checkConstruction(const char* shape, std::string (*generate)(size_t), size_t nodes)
+{
+    struct counts {
+        size_t ast = 0;
+        size_t push = 0;
+        size_t convert = 0;
+        size_t move = 0;
+    };
+    auto measureCounts = [&](size_t n) {
+        auto text = generate(n);
+        counts ret;
+        json::value value;
+        ret.ast = countAllocations([&]() { value = json::value::parse(text); });
+        json::value pushed;
+        ret.push = countAllocations([&]() { json::value::parse(std::string_view(text), pushed); });
+        std::optional<tree> root;
+        ret.convert = countAllocations([&]() { root.emplace(tree::parse(std::move(value))); });
+        ret.move = countAllocations([&]() { tree moved(std::move(*root)); *root = std::move(moved); });
+        return ret;
+    };
+    auto small = measureCounts(nodes);
+    auto large = measureCounts(nodes * 2);
+
+    bool ok = true;
+    auto expect = [&](bool condition, const char* what, size_t smallCount, size_t largeCount) {
+        std::printf("%-8s %-32s %zu: %zu allocs  %zu: %zu allocs%s\n", shape, what, nodes, smallCount,
+            nodes * 2, largeCount, condition ? "" : "  FAILED");
+        ok = ok && condition;
+    };
+    // Удвоение дерева при линейном построении удваивает и количество выделений
+    auto linear = [](size_t smallCount, size_t largeCount) { return largeCount * 10 <= smallCount * 22; };
+    expect(linear(small.ast, large.ast), "json::value::parse (ast)", small.ast, large.ast);
+    expect(linear(small.push, large.push), "json::value::parse (push)", small.push, large.push);
+    expect(linear(small.convert, large.convert) && large.convert < nodes * 2,
+        "tree::parse(json::value&&)", small.convert, large.convert);
+    expect(small.move == 0 && large.move == 0, "tree move", small.move, large.move);
+    return ok;
+}
+} // end of anonymous namespace
+
+int main()
+{
+    if (!alloc_stats::enabled()) {
+        std::printf("allocation counters are not built in\n");
+        return 1;
+    }
+
+    struct shape {
+        const char* name;
+        std::string (*generate)(size_t);
+    };
+    const shape shapes[] = { { "chain", deepChain }, { "fan", wideFan }, { "balanced", balanced } };
+
+    bool ok = true;
+    for (const auto& [name, generate] : shapes) {
+        std::vector<sample> load, save;
+        for (auto nodes = MIN_NODES; nodes <= MAX_NODES; nodes *= 2) {
+            auto text = generate(nodes);
+            load.push_back(measure(nodes, text.size(), [&]() { tree_builder::parse(text); }));
+
+            auto root = tree_builder::parse(text);
+            size_t written = 0;
+            root.serialize([&](std::string chunk) { written += chunk.size(); });
+            save.push_back(measure(nodes, written, [&]() {
+                root.serialize([](std::string) {});
+            }));
+        }
+        ok = check(name, "load", load) && ok;
+        ok = check(name, "save", save) && ok;
+    }
+    for (const auto& [name, generate] : shapes)
+        ok = checkConstruction(name, generate, CONSTRUCTION_NODES) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include "persistent_tree.h"
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * Проверка снимков persistent_tree при одновременной работе читателей и писателя.
+ * Писатель публикует через tree_versions версии со вставленными и удалёнными поддеревьями;
+ * в каждой версии значение узла равно размеру его поддерева. Читатели берут снимки,
+ * проверяют это свойство, держат часть снимков, пока писатель публикует новые версии,
+ * проверяют их повторно и отпускают в своём потоке. Снимок, изменившийся после получения,
+ * или узел с неверным значением - ошибка. Гонки, которые не меняют значений, ловит сборка
+ * с -fsanitize=thread. Отдельный барьер std::atomic_thread_fence в persistent_tree::node::~node
+ * ThreadSanitizer не учитывает и сообщает о гонке в деструкторе узла ложно.
+ */
+
+namespace {
+/// Количество версий, публикуемых писателем
+constexpr int VERSIONS = 5000;
+/// Количество читающих потоков
+constexpr int READERS = 3;
+/// Сколько снимков читатель держит одновременно
+constexpr size_t HELD_SNAPSHOTS = 8;
+/// Размер дерева, после которого писатель только удаляет поддеревья
+constexpr int MAX_NODES = 500;
+
+/**
+ * @brief Проверяет, что значение каждого узла равно размеру его поддерева
+ * @remarks Дерево обходится без рекурсии
+ * @return размер дерева; 0 если значение какого-то узла неверно
+ */
+int validate(const persistent_tree& snapshot)
+{
+    // Узлы в прямом порядке обхода с номером родителя; потомки идут после предков,
+    // поэтому размеры поддеревьев собираются одним обратным проходом
+    std::vector<std::pair<const persistent_tree::node*, size_t>> order;
+    std::vector<std::pair<const persistent_tree::node*, size_t>> stack { { &snapshot.root(), SIZE_MAX } };
+    while (!stack.empty()) {
+        auto item = stack.back();
+        stack.pop_back();
+        order.push_back(item);
+        for (const auto& child : item.first->childs())
+            stack.emplace_back(child.get(), order.size() - 1);
+    }
+
+    std::vector<int> sizes(order.size(), 1);
+    for (auto i = order.size(); i-- > 0;) {
+        if (order[i].first->asInteger() != sizes[i])
+            return 0;
+        if (order[i].second != SIZE_MAX)
+            sizes[order[i].second] += sizes[i];
+    }
+    return sizes[0];
+}
+
+/**
+ * @brief Строит следующую версию: вставляет лист или удаляет поддерево случайного узла
+ * @remarks Значения всех предков изменённого места пересчитываются, так что свойство
+ * из validate сохраняется
+ */
+persistent_tree change(const persistent_tree& current, std::mt19937& random)
+{
+    // Случайный путь: на каждом уровне спуск продолжается с вероятностью 3/4
+    persistent_tree::path where;
+    const auto* node = &current.root();
+    while (!node->childs().empty() && random() % 4 != 0) {
+        auto index = random() % node->childs().size();
+        where.push_back(index);
+        node = node->childs()[index].get();
+    }
+
+    persistent_tree next = current;
+    int delta = 0;
+    if (!node->childs().empty() && (random() % 3 == 0 || current.root().asInteger() > MAX_NODES)) {
+        auto index = random() % node->childs().size();
+        delta = -node->childs()[index]->asInteger();
+        auto erased = where;
+        erased.push_back(index);
+        next = next.erase(erased);
+    } else {
+        delta = 1;
+        next = next.insert(where, random() % (node->childs().size() + 1), persistent_tree(1));
+    }
+
+    // Предки пересчитываются снизу вверх: путь к каждому из них не меняется
+    for (auto depth = where.size() + 1; depth-- > 0;) {
+        persistent_tree::path ancestor(where.begin(), where.begin() + static_cast<ptrdiff_t>(depth));
+        next = next.assign(ancestor, next.at(ancestor).asInteger() + delta);
+    }
+    return next;
+}
+} // end of anonymous namespace
+
+int main()
+{
+    tree_versions versions { persistent_tree(1) };
+    std::atomic<bool> done { false };
+    std::atomic<long> errors { 0 };
+    std::atomic<long> checks { 0 };
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < READERS; ++r) {
+        readers.emplace_back([&]() {
+            // Снимок вместе с размером, найденным при получении
+            std::deque<std::pair<persistent_tree, int>> held;
+            while (!done.load(std::memory_order_relaxed)) {
+                auto snapshot = versions.current();
+                auto size = validate(snapshot);
+                if (size == 0)
+                    errors.fetch_add(1);
+                held.emplace_back(std::move(snapshot), size);
+                if (held.size() > HELD_SNAPSHOTS) {
+                    // Снимок, полученный давно, не должен измениться от новых версий
+                    if (validate(held.front().first) != held.front().second)
+                        errors.fetch_add(1);
+                    held.pop_front();
+                }
+                checks.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    std::mt19937 random(12345);
+    auto current = versions.current();
+    for (int v = 0; v < VERSIONS; ++v) {
+        current = change(current, random);
+        versions.publish(current);
+    }
+    done = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    auto size = validate(versions.current());
+    if (size == 0)
+        errors.fetch_add(1);
+    std::printf("versions %d, final size %d, snapshot checks %ld, errors %ld\n", VERSIONS, size, checks.load(),
+        errors.load());
+    return errors.load() == 0 ? 0 : 1;
+}